@@ -0,0 +1,351 @@
+// Microbenchmarks for the attack's hot functions. Separate program from the demos:
+//
+//   g++ -std=c++14 -O2 -march=native -o bench bench.cpp srandom.cpp xorshft.cpp csprng.cpp
+//   ./bench [--json] [--filter text] [--min-time seconds] [--seed seed]
+//
+// Each benchmark is run for at least min-time (default 0.25 s), five times, and the fastest
+// run is reported. Cycles are the time stamp counter so they count at the base clock, not
+// whatever turbo does. Simulated devices start from SrandomSim::reset(seed) (default 1), so
+// the same branches are taken on every run and machine.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+#endif
+#include "srandom.h"
+#include "xorshft.h"
+#include "csprng.h"
+
+// Keeps results alive so nothing gets optimized out
+static volatile uint64_t g_sink;
+static uint64_t          g_seed = 1;
+
+static uint64_t cycles()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// ## Benchmarks ##
+// Each does ops operations, param is the read size for the srandom_read ones
+
+static void bench_xorshft64(uint64_t ops, size_t)
+{
+	uint64_t state = g_sink;
+	uint64_t sum   = 0;
+
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		sum += xorshft64(state);
+	}
+	g_sink = sum;
+}
+
+static void bench_xorshft64_getState(uint64_t ops, size_t)
+{
+	uint64_t z = g_sink;
+
+	// Each call depends on the last so this is latency, like the real use
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		z = xorshft64_getState(z);
+	}
+	g_sink = z;
+}
+
+static void bench_xorshft128(uint64_t ops, size_t)
+{
+	uint64_t state[2] = {g_sink | 1, 0x123456789abcdef};
+	uint64_t sum      = 0;
+
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		sum += xorshft128(state);
+	}
+	g_sink = sum;
+}
+
+static void bench_xorshft128_undo(uint64_t ops, size_t)
+{
+	uint64_t state[2] = {g_sink | 1, 0x123456789abcdef};
+
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		xorshft128_undo(state);
+	}
+	g_sink = state[0] ^ state[1];
+}
+
+static void bench_xorshft128_getState(uint64_t ops, size_t)
+{
+	uint64_t output[2] = {g_sink, 0xfedcba987654321};
+	uint64_t state[2];
+
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		xorshft128_getState(state, output);
+		output[0] ^= state[0];
+		output[1] ^= state[1];
+	}
+	g_sink = output[0] ^ output[1];
+}
+
+static void bench_update_sarray(uint64_t ops, size_t)
+{
+	SrandomSim sim(SRANDOM_VERSION_NORM);
+
+	sim.reset(g_seed);
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		update_sarray(sim.prngArray(0), sim.xorshft64State(), sim.xorshft128State());
+	}
+	g_sink = sim.prngArray(0)[0];
+}
+
+static void bench_update_sarray_uhs(uint64_t ops, size_t)
+{
+	SrandomSim sim(SRANDOM_VERSION_UHS);
+
+	sim.reset(g_seed);
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		update_sarray_uhs(sim.prngArray(0), sim.xorshft64State());
+	}
+	g_sink = sim.prngArray(0)[0];
+}
+
+static void bench_nextbuffer(uint64_t ops, size_t)
+{
+	SrandomSim sim(SRANDOM_VERSION_NORM);
+	uint64_t   sum = 0;
+
+	sim.reset(g_seed);
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		sum += nextbuffer(sim.prngArrays(), sim.numPrngArrays(), sim.xorshft64State(), sim.xorshft128State(), sim.arraysBufferPosition());
+	}
+	g_sink = sum;
+}
+
+static void bench_csprng_get(uint64_t ops, size_t param)
+{
+	uint8_t  buffer[64];
+	uint64_t sum = 0;
+
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		Csprng::get(buffer, param);
+		sum += buffer[0];
+	}
+	g_sink = sum;
+}
+
+static void bench_srandom_reset(uint64_t ops, size_t)
+{
+	SrandomSim sim(SRANDOM_VERSION_NORM);
+
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		sim.reset();
+	}
+	g_sink = sim.xorshft64State();
+}
+
+static void bench_srandom_reset_seeded(uint64_t ops, size_t)
+{
+	SrandomSim sim(SRANDOM_VERSION_NORM);
+
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		sim.reset(g_seed, i);
+	}
+	g_sink = sim.xorshft64State();
+}
+
+template <int VERSION>
+static void bench_srandom_read(uint64_t ops, size_t param)
+{
+	SrandomSim           sim(VERSION);
+	std::vector<uint8_t> buffer(param);
+
+	sim.reset(g_seed);
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		srandom_read(buffer.data(), param, sim.prngArrays(), sim.xorshft64State(), sim.xorshft128State(), sim.arraysBufferPosition(), VERSION);
+	}
+	g_sink = buffer[0];
+}
+
+struct Benchmark
+{
+	const char *name;
+	void      (*run)(uint64_t ops, size_t param);
+	size_t      param;
+	size_t      bytesPerOp; // 0 when the op doesn't make output
+};
+
+static const Benchmark BENCHMARKS[] =
+{
+	{"xorshft64",                 bench_xorshft64,                                    0,     8},
+	{"xorshft64_getState",        bench_xorshft64_getState,                           0,     0},
+	{"xorshft128",                bench_xorshft128,                                   0,     8},
+	{"xorshft128_undo",           bench_xorshft128_undo,                              0,     0},
+	{"xorshft128_getState",       bench_xorshft128_getState,                          0,     0},
+	{"update_sarray",             bench_update_sarray,                                0,     512},
+	{"update_sarray_uhs",         bench_update_sarray_uhs,                            0,     512},
+	{"nextbuffer",                bench_nextbuffer,                                   0,     0},
+	{"csprng_get/8",              bench_csprng_get,                                   8,     8},
+	{"csprng_get/64",             bench_csprng_get,                                   64,    64},
+	{"srandom_reset/norm",        bench_srandom_reset,                                0,     0},
+	{"srandom_reset/seeded",      bench_srandom_reset_seeded,                         0,     0},
+	{"srandom_read/norm/8",       bench_srandom_read<SRANDOM_VERSION_NORM>,           8,     8},
+	{"srandom_read/norm/512",     bench_srandom_read<SRANDOM_VERSION_NORM>,           512,   512},
+	{"srandom_read/norm/4096",    bench_srandom_read<SRANDOM_VERSION_NORM>,           4096,  4096},
+	{"srandom_read/norm/65536",   bench_srandom_read<SRANDOM_VERSION_NORM>,           65536, 65536},
+	{"srandom_read/normbug/4096", bench_srandom_read<SRANDOM_VERSION_NORM_ARRAY_BUG>, 4096,  4096},
+	{"srandom_read/uhs/8",        bench_srandom_read<SRANDOM_VERSION_UHS>,            8,     8},
+	{"srandom_read/uhs/512",      bench_srandom_read<SRANDOM_VERSION_UHS>,            512,   512},
+	{"srandom_read/uhs/4096",     bench_srandom_read<SRANDOM_VERSION_UHS>,            4096,  4096},
+	{"srandom_read/uhs/65536",    bench_srandom_read<SRANDOM_VERSION_UHS>,            65536, 65536},
+};
+
+struct Result
+{
+	double nsPerOp;
+	double cyclesPerOp;
+};
+
+static Result measure(const Benchmark &bench, double minTime)
+{
+	Result   best = {0.0, 0.0};
+	uint64_t ops  = 1;
+
+	// Grow ops until a run takes minTime
+	for (;;)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bench.run(ops, bench.param);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (seconds >= minTime)
+		{
+			break;
+		}
+		ops *= seconds > minTime / 16 ? 2 : 16;
+	}
+
+	for (int i = 0; i < 5; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		uint64_t startCycles = cycles();
+		bench.run(ops, bench.param);
+		uint64_t endCycles   = cycles();
+		double   seconds     = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (i == 0 || seconds * 1e9 / ops < best.nsPerOp)
+		{
+			best.nsPerOp     = seconds * 1e9 / ops;
+			best.cyclesPerOp = (double) (endCycles - startCycles) / ops;
+		}
+	}
+
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filter  = NULL;
+	double      minTime = 0.25;
+	int         json    = 0;
+	int         first   = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--json") == 0)
+		{
+			json = 1;
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--filter") == 0)
+		{
+			filter = argv[++i];
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--min-time") == 0)
+		{
+			minTime = atof(argv[++i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0)
+		{
+			g_seed = strtoull(argv[++i], NULL, 0);
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--json] [--filter text] [--min-time seconds] [--seed seed]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (json)
+	{
+		printf("{\n  \"seed\": %" PRIu64 ",\n  \"benchmarks\": [", g_seed);
+	}
+	else
+	{
+		printf("%-26s %12s %14s %12s %12s\n", "benchmark", "ns/op", "ops/sec", "cycles/op", "cycles/byte");
+	}
+	for (size_t i = 0; i < sizeof(BENCHMARKS) / sizeof(*BENCHMARKS); i++)
+	{
+		const Benchmark &bench = BENCHMARKS[i];
+		Result           result;
+
+		if (filter != NULL && strstr(bench.name, filter) == NULL)
+		{
+			continue;
+		}
+		result = measure(bench, minTime);
+
+		if (json)
+		{
+			printf("%s\n    {\"name\": \"%s\", \"ns_per_op\": %.3f, \"ops_per_sec\": %.0f, \"cycles_per_op\": %.2f, \"cycles_per_byte\": ",
+				first ? "" : ",", bench.name, result.nsPerOp, 1e9 / result.nsPerOp, result.cyclesPerOp);
+			if (bench.bytesPerOp != 0)
+			{
+				printf("%.3f}", result.cyclesPerOp / bench.bytesPerOp);
+			}
+			else
+			{
+				printf("null}");
+			}
+		}
+		else
+		{
+			printf("%-26s %12.2f %14.0f %12.1f ", bench.name, result.nsPerOp, 1e9 / result.nsPerOp, result.cyclesPerOp);
+			if (bench.bytesPerOp != 0)
+			{
+				printf("%12.3f\n", result.cyclesPerOp / bench.bytesPerOp);
+			}
+			else
+			{
+				printf("%12s\n", "-");
+			}
+		}
+		fflush(stdout);
+		first = 0;
+	}
+	if (json)
+	{
+		printf("\n  ]\n}\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,291 @@
+#include <string.h>
+#include <inttypes.h>
+#include "capture.h"
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// ## CaptureFile ##
+
+CaptureFile::CaptureFile()
+{
+	m_map     = NULL;
+	m_mapSize = 0;
+	m_header  = NULL;
+	m_index   = NULL;
+#ifdef _WIN32
+	m_file    = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#endif
+}
+
+CaptureFile::~CaptureFile()
+{
+	close();
+}
+
+int CaptureFile::open(const char *fileName)
+{
+	close();
+
+#ifdef _WIN32
+	LARGE_INTEGER size;
+
+	m_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "Error CreateFile \"%s\"\n", fileName);
+		return 1;
+	}
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart < (LONGLONG) sizeof(CaptureHeader))
+	{
+		fprintf(stderr, "Error \"%s\" is too small to be a capture\n", fileName);
+		close();
+		return 1;
+	}
+	m_mapSize = (uint64_t) size.QuadPart;
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping == NULL)
+	{
+		fprintf(stderr, "Error CreateFileMapping \"%s\"\n", fileName);
+		close();
+		return 1;
+	}
+	m_map = (const uint8_t*) MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_map == NULL)
+	{
+		fprintf(stderr, "Error MapViewOfFile \"%s\"\n", fileName);
+		close();
+		return 1;
+	}
+#else
+	struct stat st;
+	int         fd = ::open(fileName, O_RDONLY);
+	void       *map;
+
+	if (fd < 0)
+	{
+		perror(fileName);
+		return 1;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(CaptureHeader))
+	{
+		fprintf(stderr, "Error \"%s\" is too small to be a capture\n", fileName);
+		::close(fd);
+		return 1;
+	}
+	m_mapSize = (uint64_t) st.st_size;
+	map = mmap(NULL, (size_t) m_mapSize, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+	{
+		perror("mmap");
+		m_mapSize = 0;
+		return 1;
+	}
+	m_map = (const uint8_t*) map;
+	madvise(map, (size_t) m_mapSize, MADV_SEQUENTIAL);
+#endif
+
+	m_header = (const CaptureHeader*) m_map;
+	if (memcmp(m_header->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0 || m_header->formatVersion != CAPTURE_FORMAT_VERSION)
+	{
+		fprintf(stderr, "Error \"%s\" isn't a version %u capture\n", fileName, CAPTURE_FORMAT_VERSION);
+		close();
+		return 1;
+	}
+	if (m_header->dataOffset   > m_mapSize || m_header->dataSize  > m_mapSize - m_header->dataOffset ||
+		m_header->indexOffset  > m_mapSize || m_header->readCount > (m_mapSize - m_header->indexOffset) / sizeof(uint64_t) ||
+		m_header->indexOffset % sizeof(uint64_t) != 0)
+	{
+		fprintf(stderr, "Error \"%s\" is truncated\n", fileName);
+		close();
+		return 1;
+	}
+	m_index = (const uint64_t*) (m_map + m_header->indexOffset);
+	for (uint64_t i = 0, end = 0; i < m_header->readCount; i++)
+	{
+		if (m_index[i] < end || m_index[i] > m_header->dataSize)
+		{
+			fprintf(stderr, "Error \"%s\" has a bad index at read %" PRIu64 "\n", fileName, i);
+			close();
+			return 1;
+		}
+		end = m_index[i];
+	}
+
+	return 0;
+}
+
+void CaptureFile::close()
+{
+#ifdef _WIN32
+	if (m_map != NULL)
+	{
+		UnmapViewOfFile(m_map);
+	}
+	if (m_mapping != NULL)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+	}
+	m_mapping = NULL;
+	m_file    = INVALID_HANDLE_VALUE;
+#else
+	if (m_map != NULL)
+	{
+		munmap((void*) m_map, (size_t) m_mapSize);
+	}
+#endif
+	m_map     = NULL;
+	m_mapSize = 0;
+	m_header  = NULL;
+	m_index   = NULL;
+}
+
+CaptureSpan CaptureFile::readSpan(uint64_t read) const
+{
+	CaptureSpan span = {NULL, 0};
+
+	if (read < m_header->readCount)
+	{
+		uint64_t begin = read == 0 ? 0 : m_index[read - 1];
+
+		span.data = m_map + m_header->dataOffset + begin;
+		span.size = (size_t) (m_index[read] - begin);
+	}
+	return span;
+}
+
+// ## CaptureTarget ##
+
+const uint8_t *CaptureTarget::readSpan(size_t bufferSize)
+{
+	CaptureSpan span = m_capture.readSpan(m_read);
+
+	if (span.data == NULL)
+	{
+		return NULL; // end of capture
+	}
+	if (span.size != bufferSize)
+	{
+		fprintf(stderr, "Error capture read %" PRIu64 " is %zu bytes not %zu\n", m_read, span.size, bufferSize);
+		return NULL;
+	}
+	m_read++;
+	return span.data;
+}
+
+size_t CaptureTarget::read(void *buffer, size_t bufferSize)
+{
+	const uint8_t *span = readSpan(bufferSize);
+
+	if (span == NULL)
+	{
+		return 0;
+	}
+	memcpy(buffer, span, bufferSize);
+	return bufferSize;
+}
+
+// ## CaptureRecorder ##
+
+CaptureRecorder::CaptureRecorder()
+{
+	m_fout = NULL;
+}
+
+CaptureRecorder::~CaptureRecorder()
+{
+	if (m_fout != NULL)
+	{
+		close();
+	}
+}
+
+int CaptureRecorder::open(const char *fileName, int srandomVersion)
+{
+	static const uint8_t zeros[CAPTURE_DATA_ALIGN] = {0};
+
+	m_fout = fopen(fileName, "wb");
+	if (m_fout == NULL)
+	{
+		perror(fileName);
+		return 1;
+	}
+
+	memset(&m_header, 0, sizeof(m_header));
+	memcpy(m_header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+	m_header.formatVersion  = CAPTURE_FORMAT_VERSION;
+	m_header.srandomVersion = (uint32_t) srandomVersion;
+	m_header.numPrngArrays  = srandomVersion < SRANDOM_VERSION_UHS_ARRAY_BUG ? NUMBER_OF_PRNG_ARRAYS_NORM : NUMBER_OF_PRNG_ARRAYS_UHS;
+	m_header.prngArraySize  = srandomVersion < SRANDOM_VERSION_UHS_ARRAY_BUG ? PRNG_ARRAY_SIZE_NORM       : PRNG_ARRAY_SIZE_UHS;
+	m_header.dataOffset     = CAPTURE_DATA_ALIGN;
+	m_index.clear();
+
+	// Header is written for real by close()
+	if (fwrite(zeros, sizeof(zeros), 1, m_fout) != 1)
+	{
+		perror("fwrite");
+		return 1;
+	}
+	return 0;
+}
+
+int CaptureRecorder::write(const void *data, size_t size)
+{
+	if (size > 0 && fwrite(data, size, 1, m_fout) != 1)
+	{
+		perror("fwrite");
+		return 1;
+	}
+	m_header.dataSize += size;
+	m_index.push_back(m_header.dataSize);
+	return 0;
+}
+
+int CaptureRecorder::close()
+{
+	static const uint8_t zeros[sizeof(uint64_t)] = {0};
+	size_t               padding = (size_t) ((sizeof(uint64_t) - m_header.dataSize % sizeof(uint64_t)) % sizeof(uint64_t));
+	int                  ret     = 0;
+
+	m_header.indexOffset = m_header.dataOffset + m_header.dataSize + padding;
+	m_header.readCount   = m_index.size();
+	if ((padding > 0 && fwrite(zeros, padding, 1, m_fout) != 1) ||
+		(m_index.size() > 0 && fwrite(m_index.data(), m_index.size() * sizeof(uint64_t), 1, m_fout) != 1) ||
+		fseek(m_fout, 0, SEEK_SET) != 0 ||
+		fwrite(&m_header, sizeof(m_header), 1, m_fout) != 1)
+	{
+		perror("fwrite");
+		ret = 1;
+	}
+	if (fclose(m_fout) != 0)
+	{
+		perror("fclose");
+		ret = 1;
+	}
+	m_fout = NULL;
+	return ret;
+}
+
+// ## RecordingTarget ##
+
+size_t RecordingTarget::read(void *buffer, size_t bufferSize)
+{
+	size_t ret = m_target.read(buffer, bufferSize);
+
+	if (ret > 0 && m_recorder.write(buffer, ret))
+	{
+		m_error = 1;
+	}
+	return ret;
+}
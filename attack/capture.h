@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <vector>
+#include "recover.h"
+
+// Capture file, all little endian:
+//   CaptureHeader
+//   padding to CAPTURE_DATA_ALIGN
+//   data, every read back to back (header.dataSize bytes)
+//   index, the end offset into data of each read (header.readCount uint64_t)
+//
+// Read boundaries are kept since srandom's output depends on them. Each read starts on a
+// freshly picked array, so 512 bytes from one read aren't 512 bytes from two reads of 256.
+const char     CAPTURE_MAGIC[8]       = {'S', 'R', 'N', 'D', 'C', 'A', 'P', 0};
+const uint32_t CAPTURE_FORMAT_VERSION = 1;
+const uint64_t CAPTURE_DATA_ALIGN     = 4096;
+
+struct CaptureHeader
+{
+	char     magic[8];
+	uint32_t formatVersion;
+	uint32_t srandomVersion; // SRANDOM_VERSION_*
+	uint32_t numPrngArrays;
+	uint32_t prngArraySize;
+	uint64_t dataOffset;
+	uint64_t dataSize;
+	uint64_t indexOffset;
+	uint64_t readCount;
+};
+
+struct CaptureSpan
+{
+	const uint8_t *data;
+	size_t         size;
+};
+
+// Read only view of a capture file. The file is mapped, not loaded, so the OS pages in only
+// what is touched.
+class CaptureFile
+{
+public:
+	CaptureFile();
+	~CaptureFile();
+
+	// Returns 0 on success, otherwise 1
+	int  open(const char *fileName);
+	void close();
+
+	const CaptureHeader &header()    const { return *m_header; }
+	uint64_t             readCount() const { return m_header->readCount; }
+	CaptureSpan          readSpan(uint64_t read) const;
+
+private:
+	CaptureFile(const CaptureFile&);
+	CaptureFile &operator=(const CaptureFile&);
+
+	const uint8_t       *m_map;
+	uint64_t             m_mapSize;
+	const CaptureHeader *m_header;
+	const uint64_t      *m_index;
+#ifdef _WIN32
+	void                *m_file;
+	void                *m_mapping;
+#endif
+};
+
+// Replays a capture, one recorded read per read. Reads have to ask for exactly the recorded
+// size, anything else is an error.
+class CaptureTarget : public SrandomTarget
+{
+public:
+	CaptureTarget(const CaptureFile &capture) : m_capture(capture), m_read(0) {}
+
+	size_t         read(void *buffer, size_t bufferSize);
+	const uint8_t *readSpan(size_t bufferSize);
+	int            version() const { return (int) m_capture.header().srandomVersion; }
+
+	uint64_t       position() const { return m_read; }
+
+private:
+	const CaptureFile &m_capture;
+	uint64_t           m_read;
+};
+
+// Writes a capture. Data is streamed to the file, only the index is kept in memory.
+class CaptureRecorder
+{
+public:
+	CaptureRecorder();
+	~CaptureRecorder();
+
+	// Returns 0 on success, otherwise 1
+	int  open(const char *fileName, int srandomVersion);
+	int  write(const void *data, size_t size);
+	int  close();
+
+private:
+	FILE                 *m_fout;
+	CaptureHeader         m_header;
+	std::vector<uint64_t> m_index;
+};
+
+// Passes reads through to a target and records them
+class RecordingTarget : public SrandomTarget
+{
+public:
+	RecordingTarget(SrandomTarget &target, CaptureRecorder &recorder) : m_target(target), m_recorder(recorder), m_error(0) {}
+
+	size_t read(void *buffer, size_t bufferSize);
+	int    version() const { return m_target.version(); }
+
+	int    error()   const { return m_error; }
+
+private:
+	SrandomTarget   &m_target;
+	CaptureRecorder &m_recorder;
+	int              m_error;
+};
@@ -0,0 +1,164 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "checkpoint.h"
+#ifdef _WIN32
+	#include <windows.h>
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+uint64_t checkpoint_fnv1a(const void *data, size_t size, uint64_t hash)
+{
+	const uint8_t *bytes = (const uint8_t*) data;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * UINT64_C(0x100000001b3);
+	}
+	return hash;
+}
+
+static uint64_t checksum(CheckpointHeader header, const uint64_t *words)
+{
+	header.checksum = 0;
+	return checkpoint_fnv1a(words, (size_t) header.wordCount * sizeof(uint64_t), checkpoint_fnv1a(&header, sizeof(header)));
+}
+
+// Makes sure it's on disk before the rename, or a crash could leave an empty file behind
+static int syncFile(FILE *fout)
+{
+#ifdef _WIN32
+	return FlushFileBuffers((HANDLE) _get_osfhandle(_fileno(fout))) ? 0 : 1;
+#else
+	return fsync(fileno(fout));
+#endif
+}
+
+static int replaceFile(const char *from, const char *to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : 1;
+#else
+	return rename(from, to);
+#endif
+}
+
+int checkpoint_writeFile(const char *fileName, const void *data, size_t size)
+{
+	std::string tmpName = std::string(fileName) + ".tmp";
+	FILE       *fout    = fopen(tmpName.c_str(), "wb");
+
+	if (fout == NULL)
+	{
+		perror(tmpName.c_str());
+		return 1;
+	}
+	if (fwrite(data, size, 1, fout) != 1 ||
+		fflush(fout) != 0 ||
+		syncFile(fout))
+	{
+		perror("fwrite");
+		fclose(fout);
+		remove(tmpName.c_str());
+		return 1;
+	}
+	if (fclose(fout) != 0)
+	{
+		perror("fclose");
+		remove(tmpName.c_str());
+		return 1;
+	}
+	if (replaceFile(tmpName.c_str(), fileName))
+	{
+		fprintf(stderr, "Error renaming \"%s\" to \"%s\"\n", tmpName.c_str(), fileName);
+		remove(tmpName.c_str());
+		return 1;
+	}
+	return 0;
+}
+
+int checkpoint_save(const char *fileName, SrandomSim &sim, uint64_t position)
+{
+	CheckpointHeader     header;
+	std::vector<uint8_t> file(sizeof(header) + sim.prngArraysSize() * sizeof(uint64_t));
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	header.formatVersion        = CHECKPOINT_FORMAT_VERSION;
+	header.srandomVersion       = (uint32_t) sim.version();
+	header.wordCount            = sim.prngArraysSize();
+	header.xorshft64_state      = sim.xorshft64State();
+	header.xorshft128_state[0]  = sim.xorshft128State()[0];
+	header.xorshft128_state[1]  = sim.xorshft128State()[1];
+	header.arraysBufferPosition = sim.arraysBufferPosition();
+	header.workThreadIteration  = sim.workThreadIteration();
+	header.position             = position;
+	header.checksum             = checksum(header, sim.prngArrays());
+
+	memcpy(file.data(), &header, sizeof(header));
+	memcpy(file.data() + sizeof(header), sim.prngArrays(), sim.prngArraysSize() * sizeof(uint64_t));
+	return checkpoint_writeFile(fileName, file.data(), file.size());
+}
+
+int checkpoint_load(const char *fileName, SrandomSim &sim, uint64_t *position)
+{
+	CheckpointHeader      header;
+	std::vector<uint64_t> words;
+	FILE                 *fin = fopen(fileName, "rb");
+
+	if (fin == NULL)
+	{
+		perror(fileName);
+		return 1;
+	}
+	if (fread(&header, sizeof(header), 1, fin) != 1 ||
+		memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+	{
+		fprintf(stderr, "Error \"%s\" isn't a checkpoint\n", fileName);
+		fclose(fin);
+		return 1;
+	}
+	if (header.formatVersion != CHECKPOINT_FORMAT_VERSION)
+	{
+		fprintf(stderr, "Error \"%s\" is checkpoint format %u, this reads %u\n", fileName, header.formatVersion, CHECKPOINT_FORMAT_VERSION);
+		fclose(fin);
+		return 1;
+	}
+	if (header.srandomVersion > SRANDOM_VERSION_UHS || header.wordCount != SrandomSim((int) header.srandomVersion).prngArraysSize())
+	{
+		fprintf(stderr, "Error \"%s\" has a bad srandom version or size\n", fileName);
+		fclose(fin);
+		return 1;
+	}
+	words.resize((size_t) header.wordCount);
+	if (fread(words.data(), words.size() * sizeof(uint64_t), 1, fin) != 1)
+	{
+		fprintf(stderr, "Error \"%s\" is truncated\n", fileName);
+		fclose(fin);
+		return 1;
+	}
+	fclose(fin);
+	if (checksum(header, words.data()) != header.checksum)
+	{
+		fprintf(stderr, "Error \"%s\" fails its checksum\n", fileName);
+		return 1;
+	}
+
+	sim = SrandomSim((int) header.srandomVersion);
+	memcpy(sim.prngArrays(), words.data(), words.size() * sizeof(uint64_t));
+	sim.xorshft64State()       = header.xorshft64_state;
+	sim.xorshft128State()[0]   = header.xorshft128_state[0];
+	sim.xorshft128State()[1]   = header.xorshft128_state[1];
+	sim.arraysBufferPosition() = header.arraysBufferPosition;
+	sim.workThreadIteration()  = header.workThreadIteration;
+	if (position != NULL)
+	{
+		*position = header.position;
+	}
+	return 0;
+}
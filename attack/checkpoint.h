@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "srandom.h"
+
+// Checkpoint file, all little endian:
+//   CheckpointHeader
+//   prngArrays, header.wordCount uint64_t (the index array is the last row)
+//
+// Everything SrandomSim needs to carry on, so a long tracking or cloning session can pick up
+// where it left off instead of reading thousands of times from the target to recover again.
+// position is the caller's, e.g. how many reads into the stream the state is. The checksum is
+// FNV-1a over the header (with checksum 0) and the words. Saves go to a temporary file that's
+// renamed over the old one, so a crash leaves either the old checkpoint or the new one.
+const char     CHECKPOINT_MAGIC[8]       = {'S', 'R', 'N', 'D', 'C', 'K', 'P', 0};
+const uint32_t CHECKPOINT_FORMAT_VERSION = 1;
+
+struct CheckpointHeader
+{
+	char     magic[8];
+	uint32_t formatVersion;
+	uint32_t srandomVersion; // SRANDOM_VERSION_*
+	uint64_t wordCount;
+	uint64_t xorshft64_state;
+	uint64_t xorshft128_state[2];
+	int32_t  arraysBufferPosition;
+	int32_t  workThreadIteration;
+	uint64_t position;
+	uint64_t checksum;
+};
+
+// Both return 0 on success, otherwise 1. On failure sim is left alone.
+int checkpoint_save(const char *fileName, SrandomSim &sim, uint64_t position = 0);
+int checkpoint_load(const char *fileName, SrandomSim &sim, uint64_t *position = NULL);
+
+// For other checkpoint formats. FNV-1a, chained by passing the last return as hash. The write
+// is done the same way as checkpoint_save(), returns 0 on success, otherwise 1.
+const uint64_t CHECKPOINT_FNV1A_START = UINT64_C(0xcbf29ce484222325);
+
+uint64_t checkpoint_fnv1a(const void *data, size_t size, uint64_t hash = CHECKPOINT_FNV1A_START);
+int      checkpoint_writeFile(const char *fileName, const void *data, size_t size);
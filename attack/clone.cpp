@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <string.h>
+#include "clone.h"
+#include "checkpoint.h"
+#include "xorshft.h"
+
+// How far each update steps the generators. update_sarray() takes 3 xorshft64() and 2 xorshft128()
+// outputs for each of its 16 rounds, update_sarray_uhs() 1 xorshft64() output and 1 more a round.
+static const uint64_t NORM_XORSHFT64_STEPS  = 3;
+static const uint64_t NORM_XORSHFT128_STEPS = 32;
+static const uint64_t UHS_XORSHFT64_STEPS   = 17;
+
+static bool isUhs(int version)
+{
+	return version == SRANDOM_VERSION_UHS_ARRAY_BUG || version == SRANDOM_VERSION_UHS;
+}
+
+CloneStream::CloneStream(SrandomSim &sim, size_t readSize, ThreadPool *pool) : m_sim(sim)
+{
+	m_pool                = pool;
+	m_readSize            = readSize;
+	m_blocksPerRead       = readSize / 512 + 1;
+	m_reads               = 0;
+	m_xorshft64Start      = 0;
+	m_xorshft128Start[0]  = 0;
+	m_xorshft128Start[1]  = 0;
+	m_checkpointEvery     = 0;
+	m_checkpointReads     = 0;
+}
+
+void CloneStream::setCheckpoint(const char *fileName, uint64_t everyReads)
+{
+	m_checkpointName  = fileName != NULL ? fileName : "";
+	m_checkpointEvery = fileName != NULL ? everyReads : 0;
+	m_checkpointReads = m_reads;
+}
+
+int CloneStream::resume(const char *fileName)
+{
+	if (checkpoint_load(fileName, m_sim, &m_reads))
+	{
+		return 1;
+	}
+	m_checkpointReads = m_reads;
+	return 0;
+}
+
+// Same as nextbuffer() for every read but the arrays are left alone, the index array is
+// updated with the generators jumped to where they'd be
+void CloneStream::schedule(size_t reads)
+{
+	const int      numArrays     = m_sim.numPrngArrays();
+	const uint64_t steps64       = isUhs(m_sim.version()) ? UHS_XORSHFT64_STEPS : NORM_XORSHFT64_STEPS;
+	const uint64_t steps128      = isUhs(m_sim.version()) ? 0 : NORM_XORSHFT128_STEPS;
+	uint64_t      *indexArray    = m_sim.prngArray(numArrays);
+	int           &position      = m_sim.arraysBufferPosition();
+	uint64_t       xorshft64Steps  = 0;
+	uint64_t       xorshft128Steps = 0;
+
+	m_xorshft64Start     = m_sim.xorshft64State();
+	m_xorshft128Start[0] = m_sim.xorshft128State()[0];
+	m_xorshft128Start[1] = m_sim.xorshft128State()[1];
+	m_schedule.resize(reads);
+	m_arrayReads.resize(numArrays);
+	for (int i = 0; i < numArrays; i++)
+	{
+		m_arrayReads[i].clear();
+	}
+
+	for (size_t i = 0; i < reads; i++)
+	{
+		int arrayIndex = (int) ((indexArray[position / 16] >> (position % 16 * 4)) & (numArrays - 1));
+
+		position++;
+		if (position >= 1021)
+		{
+			uint64_t xorshft64_state     = m_xorshft64Start;
+			uint64_t xorshft128_state[2] = {m_xorshft128Start[0], m_xorshft128Start[1]};
+
+			xorshft64_skip(xorshft64_state, (int64_t) xorshft64Steps);
+			xorshft128_jump(xorshft128_state, (int64_t) xorshft128Steps);
+			update_sarray(indexArray, xorshft64_state, xorshft128_state);
+			position         = 0;
+			xorshft64Steps  += NORM_XORSHFT64_STEPS;
+			xorshft128Steps += NORM_XORSHFT128_STEPS;
+		}
+
+		m_schedule[i].xorshft64Steps  = xorshft64Steps;
+		m_schedule[i].xorshft128Steps = xorshft128Steps;
+		m_arrayReads[arrayIndex].push_back(i);
+		xorshft64Steps  += m_blocksPerRead * steps64;
+		xorshft128Steps += m_blocksPerRead * steps128;
+	}
+
+	// Where the device ends up
+	xorshft64_skip(m_sim.xorshft64State(), (int64_t) xorshft64Steps);
+	xorshft128_jump(m_sim.xorshft128State(), (int64_t) xorshft128Steps);
+}
+
+// Like srandom_read() for each of the array's reads, jumping the generators between them
+void CloneStream::generateArray(uint8_t *out, int arrayIndex)
+{
+	const std::vector<size_t> &reads = m_arrayReads[arrayIndex];
+	const bool                 uhs   = isUhs(m_sim.version());
+	uint64_t                  *prngArray           = m_sim.prngArray(arrayIndex);
+	uint64_t                   xorshft64_state     = m_xorshft64Start;
+	uint64_t                   xorshft128_state[2] = {m_xorshft128Start[0], m_xorshft128Start[1]};
+	uint64_t                   xorshft64Steps      = 0;
+	uint64_t                   xorshft128Steps     = 0;
+
+	for (size_t i = 0; i < reads.size(); i++)
+	{
+		const ScheduledRead &read   = m_schedule[reads[i]];
+		uint8_t             *buffer = out + reads[i] * m_readSize;
+
+		xorshft64_skip(xorshft64_state, (int64_t) (read.xorshft64Steps - xorshft64Steps));
+		if (!uhs)
+		{
+			xorshft128_jump(xorshft128_state, (int64_t) (read.xorshft128Steps - xorshft128Steps));
+		}
+		for (size_t offset = 0; offset <= m_readSize; offset += 512)
+		{
+			size_t size = m_readSize - offset;
+
+			if (size > 512)
+			{
+				size = 512;
+			}
+			memcpy(buffer + offset, prngArray, size);
+			if (uhs)
+			{
+				update_sarray_uhs(prngArray, xorshft64_state);
+			}
+			else
+			{
+				update_sarray(prngArray, xorshft64_state, xorshft128_state);
+			}
+		}
+		xorshft64Steps  = read.xorshft64Steps  + m_blocksPerRead * (uhs ? UHS_XORSHFT64_STEPS : NORM_XORSHFT64_STEPS);
+		xorshft128Steps = read.xorshft128Steps + m_blocksPerRead * (uhs ? 0 : NORM_XORSHFT128_STEPS);
+	}
+}
+
+void CloneStream::generate(void *out, size_t reads)
+{
+	uint8_t *buffer = (uint8_t*) out;
+
+	if (!parallel())
+	{
+		for (size_t i = 0; i < reads; i++)
+		{
+			m_sim.read(buffer + i * m_readSize, m_readSize);
+		}
+		m_reads += reads;
+		return;
+	}
+
+	schedule(reads);
+	if (m_pool != NULL)
+	{
+		m_pool->run(m_arrayReads.size(), [&](size_t arrayIndex, int)
+		{
+			generateArray(buffer, (int) arrayIndex);
+		});
+	}
+	else
+	{
+		for (size_t i = 0; i < m_arrayReads.size(); i++)
+		{
+			generateArray(buffer, (int) i);
+		}
+	}
+	m_reads += reads;
+}
+
+int CloneStream::write(FILE *fout, uint64_t bytes, size_t windowSize)
+{
+	size_t               windowReads = windowSize / m_readSize > 0 ? windowSize / m_readSize : 1;
+	uint64_t             reads       = (bytes + m_readSize - 1) / m_readSize;
+	std::vector<uint8_t> window(windowReads * m_readSize);
+
+	while (reads > 0)
+	{
+		size_t count = reads < windowReads ? (size_t) reads : windowReads;
+
+		generate(window.data(), count);
+		if (fwrite(window.data(), m_readSize, count, fout) != count)
+		{
+			perror("fwrite");
+			return 1;
+		}
+		reads -= count;
+
+		// Only after the window is written, so a resume never skips output that wasn't
+		if (m_checkpointEvery != 0 && m_reads - m_checkpointReads >= m_checkpointEvery)
+		{
+			if (fflush(fout) != 0)
+			{
+				perror("fflush");
+				return 1;
+			}
+			if (checkpoint_save(m_checkpointName.c_str(), m_sim, m_reads))
+			{
+				return 1;
+			}
+			m_checkpointReads = m_reads;
+		}
+	}
+	if (fflush(fout) != 0)
+	{
+		perror("fflush");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "srandom.h"
+#include "threadpool.h"
+
+// Predicts a device's output far ahead for reads of one size, the same bytes as calling
+// sim.read(readSize) over and over. Each window of reads is done in two passes. The schedule
+// walks nextbuffer() to find the array every read uses and how far both generators will have
+// stepped when it starts (nothing but the index array is generated). Then each array's reads
+// are generated on their own, on the pool if given, jumping the generators to where each read
+// starts. Arrays only overlap with the array bug, so the bug versions skip all this and do one
+// read at a time. Which of them is done follows sim's version at each call, so sim can be
+// replaced (e.g. by a recovered state) after the stream is made. The device is left as if it
+// had done the reads itself.
+class CloneStream
+{
+public:
+	CloneStream(SrandomSim &sim, size_t readSize = 64 * 1024, ThreadPool *pool = NULL);
+
+	// Next reads * readSize() bytes of the stream
+	void     generate(void *out, size_t reads);
+
+	// Next bytes of the stream (rounded up to whole reads) to fout, windowSize at a time.
+	// Returns 0 on success, otherwise 1.
+	int      write(FILE *fout, uint64_t bytes, size_t windowSize = 64 * 1024 * 1024);
+
+	// write() saves the state to fileName (see checkpoint.h) at the end of a window once
+	// everyReads more reads have been made, 0 turns it off
+	void     setCheckpoint(const char *fileName, uint64_t everyReads);
+
+	// Carries on from a checkpoint saved by write(), replacing the device's state. reads() picks
+	// up from where it was. Returns 0 on success, otherwise 1.
+	int      resume(const char *fileName);
+
+	size_t   readSize() const { return m_readSize; }
+	uint64_t reads()    const { return m_reads; } // Generated so far
+	bool     parallel() const { return m_sim.version() == SRANDOM_VERSION_NORM || m_sim.version() == SRANDOM_VERSION_UHS; }
+
+private:
+	struct ScheduledRead
+	{
+		uint64_t xorshft64Steps;  // From the start of the window
+		uint64_t xorshft128Steps;
+	};
+
+	void schedule(size_t reads);
+	void generateArray(uint8_t *out, int arrayIndex);
+
+	SrandomSim                       &m_sim;
+	ThreadPool                       *m_pool;
+	size_t                            m_readSize;
+	uint64_t                          m_blocksPerRead;
+	uint64_t                          m_reads;
+
+	// Current window
+	uint64_t                          m_xorshft64Start;
+	uint64_t                          m_xorshft128Start[2];
+	std::vector<ScheduledRead>        m_schedule;
+	std::vector<std::vector<size_t> > m_arrayReads; // Reads of each array in order
+
+	std::string                       m_checkpointName;
+	uint64_t                          m_checkpointEvery;
+	uint64_t                          m_checkpointReads; // reads() at the last save
+};
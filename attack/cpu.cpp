@@ -0,0 +1,139 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#if defined(CPU_X86) && defined(_MSC_VER)
+	#include <intrin.h>
+#elif defined(CPU_X86)
+	#include <cpuid.h>
+#endif
+
+static const char *LEVEL_NAMES[] = {"scalar", "sse4.2", "avx2", "avx512"};
+
+#ifdef CPU_X86
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*) regs, (int) leaf, (int) subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Which register states the OS saves on a context switch
+static uint64_t xgetbv0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+
+	__asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	return ((uint64_t) edx << 32) | eax;
+#endif
+}
+
+#endif
+
+int cpu_detectLevel()
+{
+	int level = CPU_LEVEL_SCALAR;
+
+#ifdef CPU_X86
+	uint32_t leaf0[4];
+	uint32_t leaf1[4];
+	uint32_t leaf7[4] = {0, 0, 0, 0};
+	uint64_t xcr0     = 0;
+
+	cpuid(0, 0, leaf0);
+	if (leaf0[0] < 1)
+	{
+		return level;
+	}
+	cpuid(1, 0, leaf1);
+	if (leaf0[0] >= 7)
+	{
+		cpuid(7, 0, leaf7);
+	}
+	if ((leaf1[2] >> 27) & 1) // OSXSAVE
+	{
+		xcr0 = xgetbv0();
+	}
+
+	if ((leaf1[2] >> 20) & 1) // SSE4.2
+	{
+		level = CPU_LEVEL_SSE42;
+	}
+	if (level == CPU_LEVEL_SSE42 && (leaf1[2] >> 28) & 1 && (leaf7[1] >> 5) & 1 && // AVX, AVX2
+		(xcr0 & 0x06) == 0x06) // XMM and YMM
+	{
+		level = CPU_LEVEL_AVX2;
+	}
+	if (level == CPU_LEVEL_AVX2 && (leaf7[1] >> 16) & 1 && (leaf7[1] >> 17) & 1 && (leaf7[1] >> 30) & 1 && // F, DQ, BW
+		(xcr0 & 0xe6) == 0xe6) // and opmask, ZMM0-15 high halves, ZMM16-31
+	{
+		level = CPU_LEVEL_AVX512;
+	}
+#endif
+
+	return level;
+}
+
+static int getLevel()
+{
+	int         level = cpu_detectLevel();
+	const char *env   = getenv("SRANDOM_ATTACK_CPU");
+
+	if (env != NULL && env[0] != 0)
+	{
+		int forced = -1;
+
+		for (int i = 0; i < (int) (sizeof(LEVEL_NAMES) / sizeof(*LEVEL_NAMES)); i++)
+		{
+			if (strcmp(env, LEVEL_NAMES[i]) == 0)
+			{
+				forced = i;
+			}
+		}
+		if (forced < 0)
+		{
+			fprintf(stderr, "Unknown SRANDOM_ATTACK_CPU \"%s\" (scalar, sse4.2, avx2 or avx512), ignoring it\n", env);
+		}
+		else if (forced > level)
+		{
+			fprintf(stderr, "SRANDOM_ATTACK_CPU=%s but this CPU only has %s\n", env, LEVEL_NAMES[level]);
+		}
+		else
+		{
+			level = forced;
+		}
+	}
+
+	return level;
+}
+
+int cpu_level()
+{
+	static const int level = getLevel();
+
+	return level;
+}
+
+const char *cpu_levelName(int level)
+{
+	if (level < 0 || level >= (int) (sizeof(LEVEL_NAMES) / sizeof(*LEVEL_NAMES)))
+	{
+		return "unknown";
+	}
+	return LEVEL_NAMES[level];
+}
+
+void cpu_checkFailed(const char *kernel, int level)
+{
+	fprintf(stderr, "Error %s's %s version doesn't match the scalar version\n", kernel, cpu_levelName(level));
+	exit(1);
+}
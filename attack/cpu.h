@@ -0,0 +1,33 @@
+#pragma once
+
+// Runtime CPU dispatch. Kernels with SIMD versions compile every version into the same binary,
+// each marked with CPU_TARGET() so the compiler will emit its instructions without -m flags,
+// and pick one the first time they're called from cpu_level(). Setting the environment
+// variable SRANDOM_ATTACK_CPU to scalar, sse4.2, avx2 or avx512 caps the level, for testing
+// the slower versions on a fast machine. Debug builds (NDEBUG not defined) check every
+// version the CPU can run against the scalar one when it's picked.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define CPU_X86
+	#include <immintrin.h>
+#endif
+
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+	#define CPU_TARGET(t) __attribute__((target(t)))
+#else
+	#define CPU_TARGET(t)
+#endif
+
+// AVX-512 here means F, DQ and BW, which is every CPU with AVX-512 so far except Knights
+// Landing/Mill
+const int CPU_LEVEL_SCALAR = 0;
+const int CPU_LEVEL_SSE42  = 1;
+const int CPU_LEVEL_AVX2   = 2;
+const int CPU_LEVEL_AVX512 = 3;
+
+int         cpu_detectLevel(); // What the CPU and OS support
+int         cpu_level();       // cpu_detectLevel() capped by SRANDOM_ATTACK_CPU
+const char *cpu_levelName(int level);
+
+// Debug builds: reports a version that doesn't match the scalar one and exits
+void        cpu_checkFailed(const char *kernel, int level);
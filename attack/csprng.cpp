@@ -1,70 +1,155 @@
+#define _CRT_SECURE_NO_WARNINGS
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "csprng.h"
-
 #ifdef _WIN32
-	HCRYPTPROV Csprng::m_hCryptProv = 0;
+	#include <windows.h>
+	#include <bcrypt.h>
+	#ifdef _MSC_VER
+		#pragma comment(lib, "bcrypt.lib")
+	#endif
 #else
-	FILE *Csprng::m_fin = NULL;
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#ifdef __linux__
+		#include <sys/syscall.h>
+	#endif
 #endif
-int Csprng::m_init = Csprng::init();
 
-#ifdef _WIN32
+// Zero initialized so there's no dynamic init. The unused bytes are the last left of data.
+struct CsprngPool
+{
+	size_t  left;
+	uint8_t data[Csprng::POOL_SIZE];
+};
+
+static thread_local CsprngPool g_pool;
 
 void Csprng::get(void *buffer, size_t size)
 {
-	if (size > 0)
+	uint8_t *out = (uint8_t*) buffer;
+
+	// Big requests skip the pool
+	if (size >= POOL_SIZE / 2)
 	{
-		if (!CryptGenRandom(m_hCryptProv, (DWORD) size, (BYTE*) buffer))
+		if (fill(out, size))
 		{
-			fprintf(stderr, "Error CryptGenRandom\n");
 			exit(1);
 		}
+		return;
+	}
+
+	while (size > 0)
+	{
+		size_t count;
+
+		if (g_pool.left == 0)
+		{
+			if (fill(g_pool.data, POOL_SIZE))
+			{
+				exit(1);
+			}
+			g_pool.left = POOL_SIZE;
+		}
+		count = g_pool.left < size ? g_pool.left : size;
+		memcpy(out, g_pool.data + POOL_SIZE - g_pool.left, count);
+		g_pool.left -= count;
+		out         += count;
+		size        -= count;
 	}
 }
 
-int Csprng::init()
+#ifdef _WIN32
+
+int Csprng::fill(void *buffer, size_t size)
 {
-	static bool first = true;
+	uint8_t *out = (uint8_t*) buffer;
 
-	if (first)
+	while (size > 0)
 	{
-		first = false;
-		if (!CryptAcquireContext(&m_hCryptProv, NULL, NULL, PROV_RSA_FULL, 0))
+		ULONG chunk = size > 0x40000000 ? 0x40000000 : (ULONG) size;
+
+		if (!BCRYPT_SUCCESS(BCryptGenRandom(NULL, out, chunk, BCRYPT_USE_SYSTEM_PREFERRED_RNG)))
 		{
-			fprintf(stderr, "Error CryptAcquireContext\n");
-			exit(1);
+			fprintf(stderr, "Error BCryptGenRandom\n");
+			return 1;
 		}
+		out  += chunk;
+		size -= chunk;
 	}
 	return 0;
 }
 
 #else
 
-void Csprng::get(void *buffer, size_t size)
+static int fillUrandom(uint8_t *out, size_t size)
 {
-	if (size <= 0 || fread(buffer, size, 1, m_fin) != 1)
+	int fd;
+
+	do
+	{
+		fd = open("/dev/urandom", O_RDONLY);
+	} while (fd < 0 && errno == EINTR);
+	if (fd < 0)
 	{
-		fprintf(stderr, "fread \"/dev/urandom\"\n");
-		exit(1);
+		perror("open \"/dev/urandom\"");
+		return 1;
+	}
+	while (size > 0)
+	{
+		ssize_t ret = read(fd, out, size);
+
+		if (ret <= 0)
+		{
+			if (ret < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			perror("read \"/dev/urandom\"");
+			close(fd);
+			return 1;
+		}
+		out  += ret;
+		size -= (size_t) ret;
 	}
+	close(fd);
+	return 0;
 }
 
-int Csprng::init()
+int Csprng::fill(void *buffer, size_t size)
 {
-	static bool first = true;
+	uint8_t *out = (uint8_t*) buffer;
 
-	if (first)
+#if defined(__linux__) && defined(SYS_getrandom)
+	// Called through syscall() so it doesn't need glibc 2.25. Reads over 256 bytes can come
+	// back short if a signal lands.
+	while (size > 0)
 	{
-		first = false;
-		m_fin = fopen("/dev/urandom", "rb");
-		if (m_fin == NULL)
+		long ret = syscall(SYS_getrandom, out, size, 0);
+
+		if (ret <= 0)
 		{
-			perror("fopen \"/dev/urandom\"");
-			exit(1);
+			if (ret < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (ret < 0 && errno == ENOSYS) // Older than Linux 3.17
+			{
+				return fillUrandom(out, size);
+			}
+			perror("getrandom");
+			return 1;
 		}
+		out  += ret;
+		size -= (size_t) ret;
 	}
 	return 0;
+#else
+	return fillUrandom(out, size);
+#endif
 }
 
 #endif
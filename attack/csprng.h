@@ -1,25 +1,19 @@
 #pragma once
 
-#include <type_traits>
-#ifdef _WIN32
-	#include <windows.h>
-#else
-	#include <stdio.h>
-#endif
+#include <stddef.h>
 #include <stdint.h>
 
+// Random bytes from the OS. Each thread has its own pool that's refilled in POOL_SIZE
+// chunks (getrandom() on Linux, BCryptGenRandom() on Windows, /dev/urandom otherwise), so
+// small requests are a memcpy with no locking. The pool is plain thread_local data with no
+// constructor so this works during static init too. Exits if the OS can't give any.
 class Csprng
 {
 public:
 	static void get(void *buffer, size_t size);
 
-private:
-	static int init();
+	static const size_t POOL_SIZE = 16 * 1024;
 
-#ifdef _WIN32
-	static HCRYPTPROV  m_hCryptProv;
-#else
-	static FILE       *m_fin;
-#endif
-	static int         m_init;
+private:
+	static int fill(void *buffer, size_t size);
 };
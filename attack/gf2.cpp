@@ -0,0 +1,320 @@
+#include <string.h>
+#include <stdlib.h>
+#include "gf2.h"
+#include "cpu.h"
+
+// Columns done per Four Russians table. 2**8 rows in the table is about the sweet spot for
+// matrices of a few hundred columns.
+#define GF2_M4RI_K 8
+
+Gf2Matrix::Gf2Matrix(size_t rows, size_t cols)
+{
+	m_rows  = rows;
+	m_cols  = cols;
+	m_words = (cols + 63) / 64;
+	m_data.resize(rows * m_words);
+}
+
+void Gf2Matrix::set(size_t r, size_t c, int value)
+{
+	uint64_t &word = row(r)[c / 64];
+
+	word &= ~(UINT64_C(1)          << (c % 64));
+	word |= ((uint64_t) value & 1) << (c % 64);
+}
+
+void Gf2Matrix::swapRows(size_t r0, size_t r1)
+{
+	uint64_t *a = row(r0);
+	uint64_t *b = row(r1);
+
+	for (size_t i = 0; i < m_words; i++)
+	{
+		uint64_t tmp = a[i];
+
+		a[i] = b[i];
+		b[i] = tmp;
+	}
+}
+
+// ## gf2_xorRow() versions ##
+
+typedef void (*XorRowFunc)(uint64_t *dst, const uint64_t *src, size_t count);
+
+static void xorRowScalar(uint64_t *dst, const uint64_t *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		dst[i] ^= src[i];
+	}
+}
+
+#ifdef CPU_X86
+
+CPU_TARGET("sse4.2")
+static void xorRowSse42(uint64_t *dst, const uint64_t *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 2 <= count; i += 2)
+	{
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*) (dst + i)), _mm_loadu_si128((const __m128i*) (src + i))));
+	}
+	xorRowScalar(dst + i, src + i, count - i);
+}
+
+CPU_TARGET("avx2")
+static void xorRowAvx2(uint64_t *dst, const uint64_t *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm256_storeu_si256((__m256i*) (dst + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (dst + i)), _mm256_loadu_si256((const __m256i*) (src + i))));
+	}
+	xorRowScalar(dst + i, src + i, count - i);
+}
+
+CPU_TARGET("avx512f")
+static void xorRowAvx512(uint64_t *dst, const uint64_t *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm512_storeu_si512((void*) (dst + i), _mm512_xor_si512(_mm512_loadu_si512((const void*) (dst + i)), _mm512_loadu_si512((const void*) (src + i))));
+	}
+	xorRowScalar(dst + i, src + i, count - i);
+}
+
+#endif
+
+static const XorRowFunc XOR_ROW[] =
+{
+	xorRowScalar,
+#ifdef CPU_X86
+	xorRowSse42,
+	xorRowAvx2,
+	xorRowAvx512,
+#endif
+};
+
+static XorRowFunc selectXorRow()
+{
+	int level = cpu_level();
+
+	if (level >= (int) (sizeof(XOR_ROW) / sizeof(*XOR_ROW)))
+	{
+		level = (int) (sizeof(XOR_ROW) / sizeof(*XOR_ROW)) - 1;
+	}
+
+#ifndef NDEBUG
+	// Odd sizes so every tail gets used
+	for (int i = 1; i <= level; i++)
+	{
+		for (size_t count = 0; count < 40; count++)
+		{
+			uint64_t a[40], b[40], c[40];
+
+			for (size_t j = 0; j < 40; j++)
+			{
+				a[j] = c[j] = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+				b[j] = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+			}
+			xorRowScalar(a, b, count);
+			XOR_ROW[i](c, b, count);
+			if (memcmp(a, c, sizeof(a)) != 0)
+			{
+				cpu_checkFailed("gf2_xorRow", i);
+			}
+		}
+	}
+#endif
+
+	return XOR_ROW[level];
+}
+
+void gf2_xorRow(uint64_t *dst, const uint64_t *src, size_t count)
+{
+	static const XorRowFunc xorRow = selectXorRow();
+
+	xorRow(dst, src, count);
+}
+
+// The GF2_M4RI_K bit window of a row starting at column col
+static inline unsigned window(const uint64_t *row, size_t col, size_t words)
+{
+	uint64_t bits = row[col / 64] >> (col % 64);
+
+	if (col % 64 > 64 - GF2_M4RI_K && col / 64 + 1 < words)
+	{
+		bits |= row[col / 64 + 1] << (64 - col % 64);
+	}
+	return (unsigned) (bits & ((1 << GF2_M4RI_K) - 1));
+}
+
+size_t gf2_rref(Gf2Matrix &matrix, size_t pivotCols, std::vector<size_t> &pivotColumns)
+{
+	const size_t          words = matrix.words();
+	std::vector<uint64_t> table(((size_t) 1 << GF2_M4RI_K) * words);
+	size_t                rank  = 0;
+
+	pivotColumns.clear();
+	for (size_t col = 0; col < pivotCols && rank < matrix.rows(); col += GF2_M4RI_K)
+	{
+		size_t   blockCols = pivotCols - col < GF2_M4RI_K ? pivotCols - col : GF2_M4RI_K;
+		size_t   firstWord = col / 64;
+		size_t   pivots    = 0;
+		size_t   blockPivotCols[GF2_M4RI_K];
+		unsigned tableIndex[1 << GF2_M4RI_K];
+
+		// Find up to GF2_M4RI_K pivots with plain elimination, only touching the rows looked at
+		for (size_t c = 0; c < blockCols && rank + pivots < matrix.rows(); c++)
+		{
+			size_t r;
+
+			for (r = rank + pivots; r < matrix.rows(); r++)
+			{
+				uint64_t *row = matrix.row(r);
+
+				for (size_t i = 0; i < pivots; i++)
+				{
+					if ((row[blockPivotCols[i] / 64] >> (blockPivotCols[i] % 64)) & 1)
+					{
+						gf2_xorRow(row + firstWord, matrix.row(rank + i) + firstWord, words - firstWord);
+					}
+				}
+				if (matrix.get(r, col + c))
+				{
+					break;
+				}
+			}
+			if (r == matrix.rows())
+			{
+				continue;
+			}
+			matrix.swapRows(rank + pivots, r);
+			blockPivotCols[pivots++] = col + c;
+		}
+		if (pivots == 0)
+		{
+			continue;
+		}
+
+		// Reduce the pivot rows against each other so each has a single pivot bit
+		for (size_t i = pivots; i-- > 0;)
+		{
+			for (size_t j = 0; j < pivots; j++)
+			{
+				if (j != i && matrix.get(rank + j, blockPivotCols[i]))
+				{
+					gf2_xorRow(matrix.row(rank + j) + firstWord, matrix.row(rank + i) + firstWord, words - firstWord);
+				}
+			}
+		}
+
+		// Table of every xor of the pivot rows and a map from a row's window to its entry
+		memset(table.data(), 0, words * sizeof(uint64_t));
+		for (size_t i = 1; i < ((size_t) 1 << pivots); i++)
+		{
+			size_t low = 0;
+
+			while (((i >> low) & 1) == 0)
+			{
+				low++;
+			}
+			memcpy(table.data() + i * words, table.data() + (i & (i - 1)) * words, words * sizeof(uint64_t));
+			gf2_xorRow(table.data() + i * words + firstWord, matrix.row(rank + low) + firstWord, words - firstWord);
+		}
+		for (unsigned w = 0; w < (1u << GF2_M4RI_K); w++)
+		{
+			tableIndex[w] = 0;
+			for (size_t i = 0; i < pivots; i++)
+			{
+				tableIndex[w] |= ((w >> (blockPivotCols[i] - col)) & 1) << i;
+			}
+		}
+
+		// Clear the pivot columns from every other row
+		for (size_t r = 0; r < matrix.rows(); r++)
+		{
+			unsigned index;
+
+			if (r == rank)
+			{
+				r += pivots - 1;
+				continue;
+			}
+			index = tableIndex[window(matrix.row(r), col, words)];
+			if (index != 0)
+			{
+				gf2_xorRow(matrix.row(r) + firstWord, table.data() + index * words + firstWord, words - firstWord);
+			}
+		}
+
+		for (size_t i = 0; i < pivots; i++)
+		{
+			pivotColumns.push_back(blockPivotCols[i]);
+		}
+		rank += pivots;
+	}
+
+	return rank;
+}
+
+int gf2_solve(const Gf2Matrix &a, const uint64_t *b, Gf2Solution &solution)
+{
+	Gf2Matrix           augmented(a.rows(), a.cols() + 1);
+	std::vector<size_t> pivotColumns;
+	std::vector<bool>   isPivot(a.cols(), false);
+	size_t              words = (a.cols() + 63) / 64;
+
+	// [a | b]
+	for (size_t r = 0; r < a.rows(); r++)
+	{
+		memcpy(augmented.row(r), a.row(r), a.words() * sizeof(uint64_t));
+		augmented.set(r, a.cols(), (int) ((b[r / 64] >> (r % 64)) & 1));
+	}
+
+	solution.rank       = gf2_rref(augmented, a.cols(), pivotColumns);
+	solution.consistent = true;
+	solution.solution.assign(words, 0);
+	solution.nullspace.clear();
+
+	// Rows past the rank are all 0 = b, anything else means the equations disagree
+	for (size_t r = solution.rank; r < a.rows(); r++)
+	{
+		if (augmented.get(r, a.cols()))
+		{
+			solution.consistent = false;
+		}
+	}
+
+	for (size_t i = 0; i < solution.rank; i++)
+	{
+		size_t col = pivotColumns[i];
+
+		isPivot[col] = true;
+		solution.solution[col / 64] |= (uint64_t) augmented.get(i, a.cols()) << (col % 64);
+	}
+
+	// Each free variable set alone, with the pivot variables it forces
+	for (size_t col = 0; col < a.cols(); col++)
+	{
+		if (isPivot[col])
+		{
+			continue;
+		}
+
+		std::vector<uint64_t> basis(words, 0);
+
+		basis[col / 64] |= UINT64_C(1) << (col % 64);
+		for (size_t i = 0; i < solution.rank; i++)
+		{
+			basis[pivotColumns[i] / 64] |= (uint64_t) augmented.get(i, col) << (pivotColumns[i] % 64);
+		}
+		solution.nullspace.push_back(basis);
+	}
+
+	return solution.consistent ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Bit packed matrix over GF(2). Each row is words() uint64_t, bit c of a row is bit c % 64 of
+// word c / 64.
+class Gf2Matrix
+{
+public:
+	Gf2Matrix(size_t rows = 0, size_t cols = 0);
+
+	size_t          rows()  const { return m_rows; }
+	size_t          cols()  const { return m_cols; }
+	size_t          words() const { return m_words; }
+	uint64_t       *row(size_t r)       { return m_data.data() + r * m_words; }
+	const uint64_t *row(size_t r) const { return m_data.data() + r * m_words; }
+
+	int             get(size_t r, size_t c) const { return (int) ((row(r)[c / 64] >> (c % 64)) & 1); }
+	void            set(size_t r, size_t c, int value);
+
+	void            swapRows(size_t r0, size_t r1);
+
+private:
+	size_t                m_rows;
+	size_t                m_cols;
+	size_t                m_words;
+	std::vector<uint64_t> m_data;
+};
+
+struct Gf2Solution
+{
+	size_t                             rank;
+	bool                               consistent;
+	std::vector<uint64_t>              solution;  // One solution (free variables are 0), packed like a row
+	std::vector<std::vector<uint64_t>> nullspace; // Basis, any xor of these can be added to solution
+};
+
+// Solves a * x = b. a can have any number of rows (equations) and columns (unknowns), b is one
+// bit per row packed like a row. Extra equations are checked against the others (consistent is
+// false if they disagree) and when the rank is short the nullspace gives every other solution.
+// Returns 0 if consistent, otherwise 1.
+int  gf2_solve(const Gf2Matrix &a, const uint64_t *b, Gf2Solution &solution);
+
+// Reduced row echelon form in place, using the Method of Four Russians. Only columns
+// [0, pivotCols) are used as pivots. Returns the rank and sets pivotColumns[i] to the column of
+// row i's pivot.
+size_t gf2_rref(Gf2Matrix &matrix, size_t pivotCols, std::vector<size_t> &pivotColumns);
+
+// dst ^= src for count words
+void gf2_xorRow(uint64_t *dst, const uint64_t *src, size_t count);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// Counts of the work done on this thread: srandom reads (by a simulated device, e.g. a target)
+// and calls of update_sarray() and update_sarray_uhs() (the device's and the attack's own). Off
+// unless built with -DSRANDOM_INSTRUMENT. Then INSTRUMENT_ADD() is nothing, instrument_get()
+// is all zeros and instrument_cpuSeconds() is 0, so the hot paths are untouched. Counters are
+// thread_local, so batch trials on different threads don't mix. Recovery snapshots them at each
+// phase change (see RecoveryStats).
+struct InstrumentCounters
+{
+	uint64_t srandomReads;
+	uint64_t srandomBytes;
+	uint64_t updateSarray;
+};
+
+#ifdef SRANDOM_INSTRUMENT
+	#define INSTRUMENT_ENABLED 1
+
+	extern thread_local InstrumentCounters g_instrument;
+
+	#define INSTRUMENT_ADD(counter, count) (g_instrument.counter += (count))
+
+	inline InstrumentCounters instrument_get() { return g_instrument; }
+
+	// CPU time this thread has used
+	double instrument_cpuSeconds();
+#else
+	#define INSTRUMENT_ENABLED 0
+
+	#define INSTRUMENT_ADD(counter, count) ((void) 0)
+
+	inline InstrumentCounters instrument_get()        { InstrumentCounters zero = {0, 0, 0}; return zero; }
+	inline double             instrument_cpuSeconds() { return 0.0; }
+#endif
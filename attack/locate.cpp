@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "locate.h"
+#include "srandom.h"
+#include "cpu.h"
+#include "xorshft.h"
+
+// Block starts tried per job
+#define LOCATE_CHUNK (1 << 14)
+
+// Words in a block and words needed from a start to check a pair
+#define BLOCK_WORDS 64
+#define PAIR_WORDS  (2 * BLOCK_WORDS)
+
+// w is the first block, n the one after it. For both versions w[4k+a] ^ n[4k+a-1] ^ n[4k+3]
+// is the same for all 16 k, a = 1 when z1 is even and 2 when odd. For NORM it's z3 or z1,
+// for UHS it's z1.
+static int checkPair(const uint64_t *w, int version, int z1Odd, uint64_t &xorshft64_state)
+{
+	const uint64_t *n = w + BLOCK_WORDS;
+	const int       a = z1Odd ? 2 : 1;
+	const uint64_t  z = w[a] ^ n[a - 1] ^ n[3];
+	uint64_t        state;
+
+	for (int k = 1; k < BLOCK_WORDS / 4; k++)
+	{
+		if ((w[4 * k + a] ^ n[4 * k + a - 1] ^ n[4 * k + 3]) != z)
+		{
+			return 1;
+		}
+	}
+
+	if (version >= SRANDOM_VERSION_UHS_ARRAY_BUG)
+	{
+		// n[4k+a-1] ^ w[4k+a] is the k'th x after z1
+		if ((z & 1) != (uint64_t) z1Odd)
+		{
+			return 1;
+		}
+		state = xorshft64_getState(z);
+		for (int k = 0; k < 2; k++)
+		{
+			if (xorshft64(state) != (n[4 * k + a - 1] ^ w[4 * k + a]))
+			{
+				return 1;
+			}
+		}
+		xorshft64_skip(state, BLOCK_WORDS / 4 - 2);
+	}
+	else if (!z1Odd)
+	{
+		uint64_t z1, z2, x, y;
+
+		state = xorshft64_getState(z); // z3
+		xorshft64_skip(state, -3);
+		z1 = xorshft64(state);
+		z2 = xorshft64(state);
+		xorshft64_skip(state, 1);
+		x = w[3] ^ n[2] ^ z2;
+		y = w[2] ^ n[1] ^ z1;
+		if ((z1 & 1) != 0 || n[3] != (x ^ y ^ z))
+		{
+			return 1;
+		}
+	}
+	else
+	{
+		uint64_t z2, z3, x, y;
+
+		state = xorshft64_getState(z); // z1
+		z2 = xorshft64(state);
+		z3 = xorshft64(state);
+		x = w[1] ^ n[0] ^ z2;
+		y = w[3] ^ n[2] ^ z3;
+		if ((z & 1) == 0 || n[3] != (x ^ y ^ z))
+		{
+			return 1;
+		}
+	}
+
+	xorshft64_state = state;
+	return 0;
+}
+
+static void checkStart(const uint64_t *w, int version, uint64_t offset, std::vector<BlockPair> &pairs)
+{
+	for (int z1Odd = 0; z1Odd < 2; z1Odd++)
+	{
+		BlockPair pair;
+
+		if (checkPair(w, version, z1Odd, pair.xorshft64_state) == 0)
+		{
+			pair.offset = offset;
+			pair.z1Odd  = z1Odd;
+			pairs.push_back(pair);
+		}
+	}
+}
+
+// ## Cheap check ##
+// k = 0 and 1 of both branches, about 1 in 2**64 wrong offsets get past it. Each version
+// writes the starts in [0, count) that pass to hits and returns how many there are.
+
+typedef size_t (*FilterFunc)(const uint64_t *w, size_t count, uint32_t *hits);
+
+static inline int passes(const uint64_t *p)
+{
+	return (p[1] ^ p[BLOCK_WORDS + 0] ^ p[BLOCK_WORDS + 3]) == (p[5] ^ p[BLOCK_WORDS + 4] ^ p[BLOCK_WORDS + 7]) ||
+	       (p[2] ^ p[BLOCK_WORDS + 1] ^ p[BLOCK_WORDS + 3]) == (p[6] ^ p[BLOCK_WORDS + 5] ^ p[BLOCK_WORDS + 7]);
+}
+
+static size_t filterScalarFrom(const uint64_t *w, size_t begin, size_t count, uint32_t *hits)
+{
+	size_t numHits = 0;
+
+	for (size_t s = begin; s < count; s++)
+	{
+		if (passes(w + s))
+		{
+			hits[numHits++] = (uint32_t) s;
+		}
+	}
+	return numHits;
+}
+
+static size_t filterScalar(const uint64_t *w, size_t count, uint32_t *hits)
+{
+	return filterScalarFrom(w, 0, count, hits);
+}
+
+#ifdef CPU_X86
+
+// A vector of starts at a time, when any lane passes they're all redone with passes()
+
+CPU_TARGET("sse4.2")
+static size_t filterSse42(const uint64_t *w, size_t count, uint32_t *hits)
+{
+	size_t numHits = 0;
+	size_t s       = 0;
+
+	for (; s + 2 <= count; s += 2)
+	{
+		const uint64_t *p     = w + s;
+		__m128i         even0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (p + 1)), _mm_xor_si128(_mm_loadu_si128((const __m128i*) (p + BLOCK_WORDS + 0)), _mm_loadu_si128((const __m128i*) (p + BLOCK_WORDS + 3))));
+		__m128i         even1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (p + 5)), _mm_xor_si128(_mm_loadu_si128((const __m128i*) (p + BLOCK_WORDS + 4)), _mm_loadu_si128((const __m128i*) (p + BLOCK_WORDS + 7))));
+		__m128i         odd0  = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (p + 2)), _mm_xor_si128(_mm_loadu_si128((const __m128i*) (p + BLOCK_WORDS + 1)), _mm_loadu_si128((const __m128i*) (p + BLOCK_WORDS + 3))));
+		__m128i         odd1  = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (p + 6)), _mm_xor_si128(_mm_loadu_si128((const __m128i*) (p + BLOCK_WORDS + 5)), _mm_loadu_si128((const __m128i*) (p + BLOCK_WORDS + 7))));
+
+		if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi64(even0, even1), _mm_cmpeq_epi64(odd0, odd1))) != 0)
+		{
+			numHits += filterScalarFrom(w, s, s + 2, hits + numHits);
+		}
+	}
+	return numHits + filterScalarFrom(w, s, count, hits + numHits);
+}
+
+CPU_TARGET("avx2")
+static size_t filterAvx2(const uint64_t *w, size_t count, uint32_t *hits)
+{
+	size_t numHits = 0;
+	size_t s       = 0;
+
+	for (; s + 4 <= count; s += 4)
+	{
+		const uint64_t *p     = w + s;
+		__m256i         even0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (p + 1)), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (p + BLOCK_WORDS + 0)), _mm256_loadu_si256((const __m256i*) (p + BLOCK_WORDS + 3))));
+		__m256i         even1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (p + 5)), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (p + BLOCK_WORDS + 4)), _mm256_loadu_si256((const __m256i*) (p + BLOCK_WORDS + 7))));
+		__m256i         odd0  = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (p + 2)), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (p + BLOCK_WORDS + 1)), _mm256_loadu_si256((const __m256i*) (p + BLOCK_WORDS + 3))));
+		__m256i         odd1  = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (p + 6)), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (p + BLOCK_WORDS + 5)), _mm256_loadu_si256((const __m256i*) (p + BLOCK_WORDS + 7))));
+
+		if (!_mm256_testz_si256(_mm256_or_si256(_mm256_cmpeq_epi64(even0, even1), _mm256_cmpeq_epi64(odd0, odd1)), _mm256_set1_epi64x(-1)))
+		{
+			numHits += filterScalarFrom(w, s, s + 4, hits + numHits);
+		}
+	}
+	return numHits + filterScalarFrom(w, s, count, hits + numHits);
+}
+
+CPU_TARGET("avx512f")
+static size_t filterAvx512(const uint64_t *w, size_t count, uint32_t *hits)
+{
+	size_t numHits = 0;
+	size_t s       = 0;
+
+	for (; s + 8 <= count; s += 8)
+	{
+		const uint64_t *p     = w + s;
+		__m512i         even0 = _mm512_ternarylogic_epi64(_mm512_loadu_si512(p + 1), _mm512_loadu_si512(p + BLOCK_WORDS + 0), _mm512_loadu_si512(p + BLOCK_WORDS + 3), 0x96);
+		__m512i         even1 = _mm512_ternarylogic_epi64(_mm512_loadu_si512(p + 5), _mm512_loadu_si512(p + BLOCK_WORDS + 4), _mm512_loadu_si512(p + BLOCK_WORDS + 7), 0x96);
+		__m512i         odd0  = _mm512_ternarylogic_epi64(_mm512_loadu_si512(p + 2), _mm512_loadu_si512(p + BLOCK_WORDS + 1), _mm512_loadu_si512(p + BLOCK_WORDS + 3), 0x96);
+		__m512i         odd1  = _mm512_ternarylogic_epi64(_mm512_loadu_si512(p + 6), _mm512_loadu_si512(p + BLOCK_WORDS + 5), _mm512_loadu_si512(p + BLOCK_WORDS + 7), 0x96);
+
+		if ((_mm512_cmpeq_epi64_mask(even0, even1) | _mm512_cmpeq_epi64_mask(odd0, odd1)) != 0)
+		{
+			numHits += filterScalarFrom(w, s, s + 8, hits + numHits);
+		}
+	}
+	return numHits + filterScalarFrom(w, s, count, hits + numHits);
+}
+
+#endif
+
+static const FilterFunc FILTER[] =
+{
+	filterScalar,
+#ifdef CPU_X86
+	filterSse42,
+	filterAvx2,
+	filterAvx512,
+#endif
+};
+
+static FilterFunc selectFilter()
+{
+	int level = cpu_level();
+
+	if (level >= (int) (sizeof(FILTER) / sizeof(*FILTER)))
+	{
+		level = (int) (sizeof(FILTER) / sizeof(*FILTER)) - 1;
+	}
+
+#ifndef NDEBUG
+	// Random words with both branches' patterns planted here and there
+	const size_t COUNT = 61;
+	uint64_t     w[COUNT + PAIR_WORDS];
+	uint32_t     hits[2][COUNT];
+	size_t       numHits[2];
+
+	for (size_t i = 0; i < COUNT + PAIR_WORDS; i++)
+	{
+		w[i] = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+	}
+	for (size_t s = 0; s < COUNT; s += 7)
+	{
+		w[s + BLOCK_WORDS + 3] = w[s + 1] ^ w[s + BLOCK_WORDS + 0] ^ w[s + 5] ^ w[s + BLOCK_WORDS + 4] ^ w[s + BLOCK_WORDS + 7];
+		if (s % 2)
+		{
+			w[s + BLOCK_WORDS + 3] = w[s + 2] ^ w[s + BLOCK_WORDS + 1] ^ w[s + 6] ^ w[s + BLOCK_WORDS + 5] ^ w[s + BLOCK_WORDS + 7];
+		}
+	}
+	for (int i = 1; i <= level; i++)
+	{
+		numHits[0] = filterScalar(w, COUNT, hits[0]);
+		numHits[1] = FILTER[i]   (w, COUNT, hits[1]);
+		if (numHits[0] != numHits[1] || memcmp(hits[0], hits[1], numHits[0] * sizeof(uint32_t)) != 0)
+		{
+			cpu_checkFailed("locateBlockPairs", i);
+		}
+	}
+#endif
+
+	return FILTER[level];
+}
+
+// Block starts [begin, end) of the words at byte offset phase, phase + 8, ...
+static void locateChunk(const uint8_t *data, size_t size, int version, size_t phase, size_t begin, size_t end, std::vector<BlockPair> &pairs)
+{
+	static const FilterFunc filter = selectFilter();
+
+	const size_t          words = std::min((size - phase) / 8, end + PAIR_WORDS - 1) - begin;
+	const size_t          count = end - begin;
+	std::vector<uint64_t> w(words);
+	std::vector<uint32_t> hits(count);
+	size_t                numHits;
+
+	// Unaligned loads done once here so the filter works on whole words
+	memcpy(w.data(), data + phase + 8 * begin, words * sizeof(uint64_t));
+
+	numHits = filter(w.data(), count, hits.data());
+	for (size_t i = 0; i < numHits; i++)
+	{
+		checkStart(w.data() + hits[i], version, phase + 8 * (begin + hits[i]), pairs);
+	}
+}
+
+int locateBlockPairs(const uint8_t *data, size_t size, int version, std::vector<BlockPair> &pairs, ThreadPool *pool)
+{
+	const size_t                        starts    = size >= 8 * PAIR_WORDS ? (size - 8 * PAIR_WORDS) / 8 + 1 : 0;
+	const size_t                        chunks    = (starts + LOCATE_CHUNK - 1) / LOCATE_CHUNK;
+	std::vector<std::vector<BlockPair>> found(pool != NULL ? pool->threads() : 1);
+
+	// Job i is chunk i / 8 of byte phase i % 8
+	std::function<void(size_t, int)> job = [&](size_t index, int thread)
+	{
+		size_t phase = index % 8;
+		size_t begin = (index / 8) * LOCATE_CHUNK;
+		size_t end   = std::min(begin + LOCATE_CHUNK, size >= phase + 8 * PAIR_WORDS ? (size - phase - 8 * PAIR_WORDS) / 8 + 1 : 0);
+
+		if (begin < end)
+		{
+			locateChunk(data, size, version, phase, begin, end, found[thread]);
+		}
+	};
+
+	if (pool != NULL)
+	{
+		pool->run(8 * chunks, job);
+	}
+	else
+	{
+		for (size_t i = 0; i < 8 * chunks; i++)
+		{
+			job(i, 0);
+		}
+	}
+
+	pairs.clear();
+	for (size_t i = 0; i < found.size(); i++)
+	{
+		pairs.insert(pairs.end(), found[i].begin(), found[i].end());
+	}
+	std::sort(pairs.begin(), pairs.end(), [](const BlockPair &a, const BlockPair &b) { return a.offset < b.offset; });
+
+	return pairs.empty() ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "threadpool.h"
+
+// Two 512 byte blocks in a row from the same read, so the second is the first after one
+// update_sarray() (or update_sarray_uhs()).
+struct BlockPair
+{
+	uint64_t offset;          // Byte offset of the first block in the data
+	int      z1Odd;           // Which of update_sarray()'s two branches was taken
+	uint64_t xorshft64_state; // xorshft64() state right after the update
+};
+
+// Finds every block pair in data without knowing where blocks or reads start. Every byte
+// offset is tried. Each update leaves one xorshft64() output xored into 16 evenly spaced
+// words, so a cheap check of 2 of them throws out nearly every wrong offset and the rest
+// are checked in full and have the xorshft64() state recovered. The data needs a read of at
+// least 1024 bytes to have a pair. Spread over pool's threads if given. Pairs are sorted by
+// offset. Returns 0 if any were found, otherwise 1.
+int locateBlockPairs(const uint8_t *data, size_t size, int version, std::vector<BlockPair> &pairs, ThreadPool *pool = NULL);
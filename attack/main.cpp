@@ -2,9 +2,28 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
 #include "srandom.h"
+#include "srandomsimd.h"
+#include "recover.h"
+#include "threadpool.h"
+#include "capture.h"
+#include "checkpoint.h"
+#include "clone.h"
+#include "locate.h"
+#include "modinit.h"
+#include "resync.h"
+#include "tracker.h"
+#include "gf2.h"
 #include "xorshft.h"
+#include "xorshftmatrix.h"
+#include "xorshftbatch.h"
 #include "csprng.h"
+#include "instrument.h"
 
 uint64_t inverseMod2Pow64(uint64_t x)
 {
@@ -45,6 +64,60 @@ void show_xorshft64_getState()
 	printf("Recovered state: 0x%016" PRIx64 "\n\n", recoveredState);
 }
 
+void show_xorshft64_batch()
+{
+	const size_t COUNT  = 1 << 16;
+	const int    ROUNDS = 256;
+
+	std::vector<uint64_t> outputs(COUNT);
+	std::vector<uint64_t> expected(COUNT);
+	std::vector<size_t>   matches(COUNT);
+	std::vector<size_t>   scalarMatches;
+	size_t                numMatches = 0;
+	clock_t               start;
+	double                scalarRate;
+	double                batchRate;
+
+	// Random candidates with every 1000th one followed by its real next output
+	Csprng::get(outputs.data(),  COUNT * sizeof(uint64_t));
+	Csprng::get(expected.data(), COUNT * sizeof(uint64_t));
+	for (size_t i = 0; i < COUNT; i += 1000)
+	{
+		uint64_t state = xorshft64_getState(outputs[i]);
+
+		expected[i] = xorshft64(state);
+	}
+
+	printf("Batch xorshft64() inversion (%s), %zu candidates:\n", xorshft64_batchIsa(), COUNT);
+	start = clock();
+	for (int round = 0; round < ROUNDS; round++)
+	{
+		scalarMatches.clear();
+		for (size_t i = 0; i < COUNT; i++)
+		{
+			uint64_t state = xorshft64_getState(outputs[i]);
+
+			if (xorshft64(state) == expected[i])
+			{
+				scalarMatches.push_back(i);
+			}
+		}
+	}
+	scalarRate = (double) COUNT * ROUNDS / ((double) (clock() - start) / CLOCKS_PER_SEC);
+
+	start = clock();
+	for (int round = 0; round < ROUNDS; round++)
+	{
+		numMatches = xorshft64_verify(outputs.data(), expected.data(), COUNT, 1, matches.data());
+	}
+	batchRate = (double) COUNT * ROUNDS / ((double) (clock() - start) / CLOCKS_PER_SEC);
+
+	printf("Matches: %zu (scalar %zu, %s)\n", numMatches, scalarMatches.size(),
+		numMatches == scalarMatches.size() && memcmp(matches.data(), scalarMatches.data(), numMatches * sizeof(size_t)) == 0 ? "same" : "different");
+	printf("Scalar: %12.0f candidates/sec\n", scalarRate);
+	printf("Batch:  %12.0f candidates/sec (x%.1f)\n\n", batchRate, batchRate / scalarRate);
+}
+
 void show_xorshft128_getState()
 {
 	uint64_t originalState[2];
@@ -69,33 +142,169 @@ void show_xorshft128_getState()
 	xorshft128_getState(recoveredState, data, 1);
 
 	printf("Incrementing recovered state\n");
-	for (int i = 0; i < 128; i++)
+	xorshft128_jump(recoveredState, 128);
+
+	printf("Original state:  0x%016" PRIx64 ", 0x%016" PRIx64 "\n",   originalState[0],  originalState[1]);
+	printf("Recovered state: 0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", recoveredState[0], recoveredState[1]);
+}
+
+template <class Xorshft>
+void show_xorshftPlus_getState(const char *name)
+{
+	uint64_t originalState[2];
+	uint64_t state[2];
+	uint64_t recoveredState[2];
+	uint64_t data[Xorshft::WORDS] = {0};
+
+	Csprng::get(originalState, sizeof(originalState));
+	originalState[0] &= Xorshft::MASK;
+	originalState[1] &= Xorshft::MASK;
+
+	state[0] = originalState[0];
+	state[1] = originalState[1];
+	for (int i = 0; i < Xorshft::STATE_BITS; i++)
 	{
-		xorshft128(recoveredState);
+		data[i / 64] |= (Xorshft::step(state) & 1) << (i % 64);
 	}
 
-	printf("Original state:  0x%016" PRIx64 ", 0x%016" PRIx64 "\n",   originalState[0],  originalState[1]);
+	printf("%s:\n", name);
+	printf("Original state:  0x%016" PRIx64 ", 0x%016" PRIx64 "\n", originalState[0], originalState[1]);
+	if (xorshftPlus_getState<Xorshft>(recoveredState, data))
+	{
+		printf("Output doesn't determine the state\n\n");
+		return;
+	}
 	printf("Recovered state: 0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", recoveredState[0], recoveredState[1]);
 }
 
-#define PRNG_ARRAY_SIZE_UHS         65
-#define PRNG_ARRAY_SIZE_NORM        67
-#define NUMBER_OF_PRNG_ARRAYS_UHS   32
-#define NUMBER_OF_PRNG_ARRAYS_NORM  16
+void show_xorshft128_jump()
+{
+	const int64_t STEPS      = INT64_C(100000000);
+	const int64_t BIG_STEPS  = INT64_C(1000000000000);
+	const int     JUMPS      = 10000;
+
+	uint64_t originalState[2];
+	uint64_t steppedState[2];
+	uint64_t jumpedState[2];
+	clock_t  start;
+	double   stepTime;
+	double   jumpTime;
+
+	Csprng::get(originalState, sizeof(originalState));
+	printf("Original state: 0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", originalState[0], originalState[1]);
+
+	printf("Stepping %" PRId64 " times...\n", STEPS);
+	steppedState[0] = originalState[0];
+	steppedState[1] = originalState[1];
+	start = clock();
+	for (int64_t i = 0; i < STEPS; i++)
+	{
+		xorshft128(steppedState);
+	}
+	stepTime = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	jumpedState[0] = originalState[0];
+	jumpedState[1] = originalState[1];
+	xorshft128_jump(jumpedState, STEPS);
+	printf("Stepped state: 0x%016" PRIx64 ", 0x%016" PRIx64 "\n",   steppedState[0], steppedState[1]);
+	printf("Jumped state:  0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", jumpedState[0],  jumpedState[1]);
+
+	printf("Jumping back %" PRId64 " times...\n", STEPS);
+	xorshft128_jump(jumpedState, -STEPS);
+	printf("Jumped state:  0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", jumpedState[0], jumpedState[1]);
+
+	start = clock();
+	for (int i = 0; i < JUMPS; i++)
+	{
+		xorshft128_jump(jumpedState,  BIG_STEPS);
+		xorshft128_jump(jumpedState, -BIG_STEPS);
+	}
+	jumpTime = (double) (clock() - start) / CLOCKS_PER_SEC / (2 * JUMPS);
+	printf("Jump by +-%" PRId64 " and back %d times\n", BIG_STEPS, JUMPS);
+	printf("Jumped state:  0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", jumpedState[0], jumpedState[1]);
+
+	printf("Step loop:   %8.3f ns/step, %" PRId64 " steps would take %.0f s\n", 1e9 * stepTime / STEPS, BIG_STEPS, stepTime / STEPS * BIG_STEPS);
+	printf("Jump:        %8.3f us/jump of %" PRId64 " steps\n\n", 1e6 * jumpTime, BIG_STEPS);
+}
+
+// Row i is the least significant bit of xorshft128() output i in terms of the state bits
+void xorshft128ObservationMatrix(Gf2Matrix &matrix)
+{
+	for (size_t bit = 0; bit < 128; bit++)
+	{
+		uint64_t state[2] = {0, 0};
+
+		state[bit / 64] = UINT64_C(1) << (bit % 64);
+		for (size_t i = 0; i < matrix.rows(); i++)
+		{
+			matrix.set(i, bit, (int) (xorshft128(state) & 1));
+		}
+	}
+}
+
+void show_gf2_solve()
+{
+	const size_t OBSERVATIONS = 192;
+
+	Gf2Matrix   matrix(OBSERVATIONS, 128);
+	Gf2Matrix   partial(100, 128);
+	Gf2Solution solution;
+	uint64_t    originalState[2];
+	uint64_t    state[2];
+	uint64_t    data[(OBSERVATIONS + 63) / 64] = {0};
+
+	Csprng::get(originalState, sizeof(originalState));
+	printf("Original state: 0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", originalState[0], originalState[1]);
+
+	state[0] = originalState[0];
+	state[1] = originalState[1];
+	for (size_t i = 0; i < OBSERVATIONS; i++)
+	{
+		data[i / 64] |= (xorshft128(state) & 1) << (i % 64);
+	}
+	xorshft128ObservationMatrix(matrix);
+	xorshft128ObservationMatrix(partial);
+
+	printf("%zu equations, 128 unknowns:\n", matrix.rows());
+	gf2_solve(matrix, data, solution);
+	printf("Rank %zu, %s, %zu free variables\n", solution.rank, solution.consistent ? "consistent" : "inconsistent", solution.nullspace.size());
+	printf("Recovered state: 0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", solution.solution[0], solution.solution[1]);
+
+	printf("Same with output bit 150 flipped:\n");
+	data[150 / 64] ^= UINT64_C(1) << (150 % 64);
+	gf2_solve(matrix, data, solution);
+	printf("Rank %zu, %s\n\n", solution.rank, solution.consistent ? "consistent" : "inconsistent");
+	data[150 / 64] ^= UINT64_C(1) << (150 % 64);
+
+	printf("Only the first %zu outputs:\n", partial.rows());
+	gf2_solve(partial, data, solution);
+	printf("Rank %zu, %s, %zu free variables (2**%zu candidate states)\n\n", solution.rank, solution.consistent ? "consistent" : "inconsistent", solution.nullspace.size(), solution.nullspace.size());
+}
 
-int reset(int version)
+// With seed the state is SrandomSim::reset(*seed, stream)'s, so the run can be repeated
+int reset(SrandomSim &target, int print = 1, const uint64_t *seed = NULL, uint64_t stream = 0)
 {
 	uint64_t num;
 
-	printf("Reseting srandom state to unknown\n");
-	srandom_reset();
-	if (srandom_read(&num, sizeof(uint64_t), version) != sizeof(uint64_t))
+	if (print)
+	{
+		printf("Reseting srandom state to unknown\n");
+	}
+	if (seed != NULL)
+	{
+		target.reset(*seed, stream);
+	}
+	else
+	{
+		target.reset();
+	}
+	if (target.read(&num, sizeof(uint64_t)) != sizeof(uint64_t))
 	{
 		return 1;
 	}
 	for (int i = 0, rounds = num % 1021; i < rounds; i++)
 	{
-		if (srandom_read(&num, 1, version) != 1)
+		if (target.read(&num, 1) != 1)
 		{
 			return 1;
 		}
@@ -104,465 +313,1133 @@ int reset(int version)
 	return 0;
 }
 
-int getXorshft64State(int version, uint64_t &xorshft64_state, uint64_t &z1, int print = 0)
+// What each phase of one recovery cost. Built with SRANDOM_INSTRUMENT it also shows CPU time,
+// srandom_read() calls and update_sarray() calls.
+void print_recovery_stats(const RecoveryStats &stats)
 {
-	uint64_t buffer[64+4];
-	uint64_t x, y, z2, z3;
-
-	if (print)
+	printf("%-12s %10s %10s %10s", "Phase", "ms", "reads", "bytes");
+	if (INSTRUMENT_ENABLED)
 	{
-		printf("Get xorshft64() state\n");
+		printf(" %10s %12s %13s", "cpu ms", "srandom_read", "update_sarray");
 	}
-
-	if (srandom_read(buffer, sizeof(buffer), version) != sizeof(buffer))
+	printf("\n");
+	for (int phase = 0; phase < RECOVERY_PHASES; phase++)
 	{
-		return 1;
+		printf("%-12s %10.3f %10" PRIu64 " %10" PRIu64, recoveryPhaseName(phase), stats.phaseSeconds[phase] * 1000.0, stats.phaseReads[phase], stats.phaseBytes[phase]);
+		if (INSTRUMENT_ENABLED)
+		{
+			printf(" %10.3f %12" PRIu64 " %13" PRIu64, stats.phaseCpuSeconds[phase] * 1000.0, stats.phaseSrandomReads[phase], stats.phaseUpdates[phase]);
+		}
+		printf("\n");
 	}
+}
 
-	if (version == SRANDOM_VERSION_NORM_ARRAY_BUG || version == SRANDOM_VERSION_NORM)
-	{
-		z3 = buffer[1] ^ buffer[64 + 0] ^ buffer[64 + 3];
-		xorshft64_state = xorshft64_getState(z3);
-		xorshft64_skip(xorshft64_state, -3);
-		z1 = xorshft64(xorshft64_state);
-		z2 = xorshft64(xorshft64_state);
-		xorshft64_skip(xorshft64_state, 1);
-		x = buffer[3] ^ buffer[64 + 2] ^ z2;
-		y = buffer[2] ^ buffer[64 + 1] ^ z1;
-		if ((z1 & 1) != 0 || buffer[64 + 3] != (x ^ y ^ z3))
-		{
-			z1 = buffer[2] ^ buffer[64 + 1] ^ buffer[64 + 3];
-			xorshft64_state = xorshft64_getState(z1);
-			z2 = xorshft64(xorshft64_state);
-			z3 = xorshft64(xorshft64_state);
-			x = buffer[1] ^ buffer[64 + 0] ^ z2;
-			y = buffer[3] ^ buffer[64 + 2] ^ z3;
-			if ((z1 & 1) == 0 || buffer[64 + 3] != (x ^ y ^ z1))
-			{
-				return 1; // error
-			}
+int show_srandom(int version)
+{
+	SrandomSim target(version);
+	SrandomSim recovered(version);
+	SimTarget     simTarget(target);
+	RecoveryStats stats;
+	uint64_t      buffer;
+
+	// Make state unknown
+	if (reset(target)) return 1;
+
+	if (recoverSrandom(simTarget, recovered, &stats, 1)) return 1;
+	printf("\n");
+	print_recovery_stats(stats);
+
+	printf("\nFull state of srandom recovered:\n");
+	printf("srandom:\n");
+	for (int i = 0; i < 4; i++)
+	{
+		printf("   ");
+		for (int j = 0; j < 4; j++)
+		{
+			if (target.read(&buffer, sizeof(buffer)) != sizeof(buffer)) return 1;
+			printf(" %016" PRIx64, buffer);
 		}
-		xorshft64_skip(xorshft64_state, 3);
+		printf("\n");
 	}
-	else
+	printf("\n");
+	printf("srandom recovered:\n");
+	for (int i = 0; i < 4; i++)
 	{
-		x  = buffer[64 + 0] ^ buffer[1];
-		z1 = buffer[64 + 3] ^ x;
-		xorshft64_state = xorshft64_getState(z1);
-		if ((z1 & 1) != 0 || x != xorshft64(xorshft64_state))
+		printf("   ");
+		for (int j = 0; j < 4; j++)
 		{
-			x  = buffer[64 + 1] ^ buffer[2];
-			z1 = buffer[64 + 3] ^ x;
-			xorshft64_state = xorshft64_getState(z1);
-			if ((z1 & 1) == 0 || x != xorshft64(xorshft64_state))
+			if (recovered.read(&buffer, sizeof(buffer)) != sizeof(buffer)) return 1;
+			printf(" %016" PRIx64, buffer);
+		}
+		printf("\n");
+	}
+	printf("\n");
+
+	return 0;
+}
+
+int show_srandom_normArrayBug()
+{
+	return show_srandom(SRANDOM_VERSION_NORM_ARRAY_BUG);
+}
+
+int show_srandom_norm()
+{
+	return show_srandom(SRANDOM_VERSION_NORM);
+}
+
+// not done
+int show_srandom_uhsArrayBug()
+{
+	return 0;
+}
+
+// not done
+int show_srandom_uhs()
+{
+	return 0;
+}
+
+int show_srandom_simd()
+{
+	const size_t COUNT = 4 * SrandomSimd::LANES + 3;
+	const size_t READS = 1 << 17; // A multiple of the instances in the speed test
+
+	size_t sizes[] = {8, 1, 512, 100, 1000, 8, 4};
+
+	printf("Checking SrandomSimd (%s, %d lanes) against SrandomSim...\n", SrandomSimd::isa(), SrandomSimd::LANES);
+	for (int version = SRANDOM_VERSION_NORM_ARRAY_BUG; version <= SRANDOM_VERSION_UHS; version++)
+	{
+		SrandomSimd             simd(version, COUNT);
+		std::vector<SrandomSim> sims(COUNT, SrandomSim(version));
+		std::vector<uint8_t>    simdOut(COUNT * 1000);
+		std::vector<uint8_t>    simOut(1000);
+
+		simd.reset();
+		for (size_t i = 0; i < COUNT; i++)
+		{
+			if (simd.getInstance(i, sims[i])) return 1;
+		}
+		for (int i = 0; i < 3000; i++)
+		{
+			size_t size = sizes[i % (sizeof(sizes) / sizeof(*sizes))];
+
+			simd.read(simdOut.data(), size);
+			for (size_t j = 0; j < COUNT; j++)
 			{
-				return 1; // error
+				sims[j].read(simOut.data(), size);
+				if (memcmp(simOut.data(), simdOut.data() + j * size, size) != 0)
+				{
+					printf("Version %d: instance %zu read %d doesn't match\n", version, j, i);
+					return 1;
+				}
 			}
 		}
-		xorshft64_skip(xorshft64_state, 32);
+		printf("Version %d: %zu instances match\n", version, COUNT);
 	}
-	if (print)
+
+	printf("\nMB/s in 4 KiB reads per instance (SRANDOM_VERSION_NORM):\n");
 	{
-		printf("xorshft64_state = 0x%016" PRIx64 "\n", xorshft64_state);
+		const size_t                      READ_SIZE = 4096;
+		SrandomSimT<SRANDOM_VERSION_NORM> sim;
+		SrandomSimd                       simd(SRANDOM_VERSION_NORM, 64 * SrandomSimd::LANES);
+		std::vector<uint8_t>              out(simd.count() * READ_SIZE);
+		clock_t                           start;
+		double                            scalarRate;
+		double                            simdRate;
+
+		sim.reset();
+		simd.reset();
+
+		start = clock();
+		for (size_t i = 0; i < READS; i++)
+		{
+			sim.read(out.data(), READ_SIZE);
+		}
+		scalarRate = READS * READ_SIZE / ((double) (clock() - start) / CLOCKS_PER_SEC) / 1000000;
+
+		start = clock();
+		for (size_t i = 0; i < READS / simd.count(); i++)
+		{
+			simd.read(out.data(), READ_SIZE);
+		}
+		simdRate = READS * READ_SIZE / ((double) (clock() - start) / CLOCKS_PER_SEC) / 1000000;
+
+		printf("SrandomSimT: %10.0f\n", scalarRate);
+		printf("SrandomSimd: %10.0f (x%.1f)\n", simdRate, simdRate / scalarRate);
 	}
 
 	return 0;
 }
 
-int getXorshft128StateNorm(int version, int &arraysBufferPosition, uint64_t &xorshft64_state, uint64_t xorshft128_state[2])
+// Simulated device with work_thread() waking up every interval bytes
+class WorkThreadTarget : public SrandomTarget
 {
-	uint64_t buffer[256+64];
-	uint64_t xorshft128_output[2] = {0};
-	
-	printf("\nGet xorshft128() state\n");
-	printf("Getting xorshft128() output...\n");
-	arraysBufferPosition++;
-	if (srandom_read(buffer, sizeof(buffer), version) != sizeof(buffer))
+public:
+	WorkThreadTarget(SrandomSim &sim, uint64_t interval) : m_sim(sim), m_interval(interval), m_bytes(0), m_steps(0) {}
+
+	size_t read(void *buffer, size_t bufferSize)
 	{
-		return 1;
+		m_bytes += bufferSize;
+		while (m_bytes >= m_interval)
+		{
+			uint64_t nsec;
+
+			Csprng::get(&nsec, sizeof(nsec));
+			m_sim.workThreadStep(nsec % 1000000000);
+			m_bytes -= m_interval;
+			m_steps++;
+		}
+		return m_sim.read(buffer, bufferSize);
 	}
-	for (int i = 64, shift = 0; i < 256 + 64; i += 64)
+	int      version() const { return m_sim.version(); }
+	uint64_t steps()   const { return m_steps; }
+
+private:
+	SrandomSim &m_sim;
+	uint64_t    m_interval;
+	uint64_t    m_bytes;
+	uint64_t    m_steps;
+};
+
+int show_srandom_tracker()
+{
+	const uint64_t TOTAL    = UINT64_C(1) << 30;
+	const uint64_t INTERVAL = UINT64_C(1) << 24;
+
+	ThreadPool pool;
+
+	// Every second run has the kthread part way through, the recovery can't know that so the
+	// tracker's first guess of which array was updated is usually wrong and has to be retried
+	for (int run = 0; run < 4; run++)
 	{
-		uint64_t x, y, z1, z2, z3;
+		int              version   = SRANDOM_VERSION_NORM_ARRAY_BUG + run / 2;
+		int              iteration = (run & 1) * 7;
+		SrandomSim       target(version);
+		WorkThreadTarget source(target, INTERVAL);
+		SrandomTracker   tracker(source, 64 * 1024, 16, &pool);
+		std::chrono::steady_clock::time_point start;
+		double           seconds;
+
+		if (reset(target, 0)) return 1;
+		target.workThreadIteration() = iteration;
+
+		printf("Version %d: tracking %" PRIu64 " MiB in %zu KiB reads, work_thread() every %" PRIu64 " MiB from iteration %d...\n", version, TOTAL >> 20, tracker.readSize() >> 10, INTERVAL >> 20, iteration);
+		start = std::chrono::steady_clock::now();
+		while (tracker.stats().bytes < TOTAL)
+		{
+			if (tracker.step())
+			{
+				printf("Lost sync\n");
+				return 1;
+			}
+		}
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		const TrackerStats &stats = tracker.stats();
+		printf("Verified %" PRIu64 " bytes in %" PRIu64 " reads, %.0f MB/s (simulated source included)\n", stats.bytes, stats.reads, stats.bytes / seconds / 1e6);
+		printf("work_thread() steps %" PRIu64 ", mismatches %" PRIu64 ", fast resyncs %" PRIu64 " in %.3f s, resyncs %" PRIu64 " (%" PRIu64 " failed), %" PRIu64 " bytes and %.3f s spent recovering\n",
+			source.steps(), stats.mismatches, stats.fastResyncs, stats.fastResyncSeconds, stats.resyncs, stats.failedResyncs, stats.recoveryBytes, stats.recoverySeconds);
+		printf("Guessed the updated array %" PRIu64 " times, %" PRIu64 " wrong guesses retried\n\n", stats.guesses, stats.guessRetries);
+		if (stats.resyncs != 1)
+		{
+			printf("Fast resync missed a work_thread() step\n");
+			return 1;
+		}
+	}
 
-		z1 = xorshft64(xorshft64_state);
-		z2 = xorshft64(xorshft64_state);
-		z3 = xorshft64(xorshft64_state);
+	return 0;
+}
+
+// Each work_thread() iteration once, found from the state before it and the next read
+int show_resync()
+{
+	const size_t READ_SIZE = 64 * 1024;
+
+	ThreadPool pool;
 
-		if ((z1 & 1) == 0)
+	for (int version = SRANDOM_VERSION_NORM_ARRAY_BUG; version <= SRANDOM_VERSION_NORM; version++)
+	{
+		SrandomSim           device(version);
+		std::vector<uint8_t> buffer(READ_SIZE);
+		std::vector<uint8_t> check(READ_SIZE);
+		double               updateSeconds = 0.0;
+
+		if (reset(device, 0)) return 1;
+
+		printf("Version %d: resyncing after each work_thread() iteration, %s on %d threads\n", version, resyncSrandomIsa(), pool.threads());
+		for (int iteration = 0; iteration < NUMBER_OF_PRNG_ARRAYS_NORM + 4; iteration++)
 		{
-			for (size_t j = 0; j < PRNG_ARRAY_SIZE_NORM - 4; j += 4)
+			static const char *SEEDS[] = {"s0", "s1", "x"};
+
+			SrandomSim   known(device);
+			ResyncResult result;
+			uint64_t     nsec;
+
+			Csprng::get(&nsec, sizeof(nsec));
+			nsec %= 1000000000;
+			device.workThreadStep(nsec);
+			device.read(buffer.data(), buffer.size());
+			if (resyncSrandom(known, buffer.data(), buffer.size(), &pool, &result) || result.iteration != iteration)
 			{
-				x = buffer[i + j + 2] ^ buffer[i + j + 3 - 64] ^ z2;
-				y = buffer[i + j + 1] ^ buffer[i + j + 2 - 64] ^ z1;
-				if (shift < 64)
-				{
-					xorshft128_output[0] |= (x & 1) << (shift++);
-					xorshft128_output[0] |= (y & 1) << (shift++);
-				}
-				else
+				printf("Iteration %d not found\n", iteration);
+				return 1;
+			}
+			device.read(buffer.data(), buffer.size());
+			known.read(check.data(), check.size());
+			if (memcmp(buffer.data(), check.data(), buffer.size()) != 0 || (iteration > NUMBER_OF_PRNG_ARRAYS_NORM && result.nsec != nsec))
+			{
+				printf("Iteration %d resynced wrong\n", iteration);
+				return 1;
+			}
+
+			if (iteration <= NUMBER_OF_PRNG_ARRAYS_NORM)
+			{
+				updateSeconds = std::max(updateSeconds, result.seconds);
+			}
+			else
+			{
+				printf("seed_PRND_%s(): nsec %9" PRIu64 " in %7.3f ms", SEEDS[iteration - NUMBER_OF_PRNG_ARRAYS_NORM - 1], result.nsec, 1000.0 * result.seconds);
+				if (result.candidates > 0)
 				{
-					xorshft128_output[1] |= (x & 1) << (shift++ - 64);
-					xorshft128_output[1] |= (y & 1) << (shift++ - 64);
+					printf(", %" PRIu64 " candidates, %.3g/s", result.candidates, result.candidates / result.seconds);
 				}
+				printf("\n");
 			}
 		}
-		else
+		printf("update_sarray(): at most %.3f ms\n\n", 1000.0 * updateSeconds);
+	}
+
+	return 0;
+}
+
+// A tracker saving checkpoints is stopped between checkpoints, the device is read a few more
+// times, then a new tracker resumes without recovering
+int show_checkpoint()
+{
+	const char    *FILE_NAME = "srandom-checkpoint.tmp";
+	const uint64_t EVERY     = 64;
+	const size_t   STEPS     = 1000;
+
+	for (int version = SRANDOM_VERSION_NORM_ARRAY_BUG; version <= SRANDOM_VERSION_NORM; version++)
+	{
+		SrandomSim           target(version);
+		SimTarget            source(target);
+		std::vector<uint8_t> buffer(64 * 1024);
+		uint64_t             position;
+
+		if (reset(target, 0)) return 1;
 		{
-			for (size_t j = 0; j < PRNG_ARRAY_SIZE_NORM - 4; j += 4)
+			SrandomTracker tracker(source);
+
+			tracker.setCheckpoint(FILE_NAME, EVERY);
+			for (size_t i = 0; i < STEPS; i++)
 			{
-				x = buffer[i + j    ] ^ buffer[i + j + 1 - 64] ^ z2;
-				y = buffer[i + j + 2] ^ buffer[i + j + 3 - 64] ^ z3;
-				if (shift < 64)
-				{
-					xorshft128_output[0] |= (x & 1) << (shift++);
-					xorshft128_output[0] |= (y & 1) << (shift++);
-				}
-				else
+				if (tracker.step())
 				{
-					xorshft128_output[1] |= (x & 1) << (shift++ - 64);
-					xorshft128_output[1] |= (y & 1) << (shift++ - 64);
+					printf("Lost sync\n");
+					remove(FILE_NAME);
+					return 1;
 				}
 			}
+			printf("Version %d: first tracker recovered from %" PRIu64 " bytes, verified %" PRIu64 " reads\n", version, tracker.stats().recoveryBytes, tracker.stats().reads);
 		}
-	}
-	xorshft64_skip(xorshft64_state, 6);
 
-	printf("Recovering state...\n");
-	if (xorshft128_getState(xorshft128_state, xorshft128_output))
-	{
-		return 1;
-	}
-	printf("xorshft128_state = 0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", xorshft128_state[0], xorshft128_state[1]);
+		// More reads the restarted tracker doesn't see, on top of the first tracker's since its
+		// last checkpoint
+		for (uint64_t i = 0; i < STEPS % EVERY; i++)
+		{
+			source.read(buffer.data(), buffer.size());
+		}
 
-	// Incrementing xorshft128_state
-	printf("Incrementing recovered state...\n");
-	for (int i = 0; i < (256+64+64)/2; i++)
-	{
-		xorshft128(xorshft128_state);
+		SrandomTracker tracker(source);
+		SrandomSim     saved(version);
+
+		if (checkpoint_load(FILE_NAME, saved, &position) || tracker.resume(FILE_NAME, 2 * EVERY))
+		{
+			remove(FILE_NAME);
+			return 1;
+		}
+		for (size_t i = 0; i < STEPS; i++)
+		{
+			if (tracker.step())
+			{
+				printf("Lost sync\n");
+				remove(FILE_NAME);
+				return 1;
+			}
+		}
+		remove(FILE_NAME);
+		printf("Resumed from the checkpoint at read %" PRIu64 ", %" PRIu64 " reads verified, %" PRIu64 " resyncs, %" PRIu64 " bytes spent recovering\n\n",
+			position, tracker.stats().reads, tracker.stats().resyncs, tracker.stats().recoveryBytes);
 	}
-	printf("xorshft128_state = 0x%016" PRIx64 ", 0x%016" PRIx64 "\n", xorshft128_state[0], xorshft128_state[1]);
 
 	return 0;
 }
 
-int getXorshft128StateUhs(uint64_t z1s[5], uint64_t z2s[5], uint64_t z3s[5], uint64_t buffer[256+64], uint64_t xorshft128_state[2])
+int show_locateBlockPairs()
 {
-	uint64_t xorshft128_output[2] = {0};
+	const size_t SLICE  = 4096;
+	const size_t STREAM = 64 * 1024 * 1024;
 
-	printf("\nGet xorshft128() state\n");
-	printf("Using output...\n");
-	for (int i = 64, shift = 0; i < 256 + 64; i += 64)
-	{
-		uint64_t x, y, z1, z2, z3;
-
-		z1 = z1s[i / 64];
-		z2 = z2s[i / 64];
-		z3 = z3s[i / 64];
+	ThreadPool pool;
 
-		if ((z1 & 1) == 0)
+	for (int version = SRANDOM_VERSION_NORM_ARRAY_BUG; version <= SRANDOM_VERSION_UHS; version++)
+	{
+		SrandomSim             sim(version);
+		std::vector<uint8_t>   stream(STREAM);
+		std::vector<BlockPair> pairs;
+		const uint64_t         goldenInverse = inverseMod2Pow64(UINT64_C(0x9E3779B97F4A7C15));
+		uint64_t               start;
+		uint64_t               steps;
+		uint64_t               sliceOffset;
+		size_t                 bad = 0;
+		std::chrono::steady_clock::time_point timer;
+		double                 seconds;
+
+		// Reads of random sizes, so blocks start anywhere
+		sim.reset();
+		start = sim.xorshft64State();
+		for (size_t offset = 0; offset < STREAM;)
 		{
-			for (size_t j = 0; j < PRNG_ARRAY_SIZE_NORM - 4; j += 4)
+			uint16_t size;
+
+			Csprng::get(&size, sizeof(size));
+			size = size % 8192 + 1;
+			if (size > STREAM - offset)
 			{
-				x = buffer[i + j + 2] ^ buffer[i + j + 3 - 64] ^ z2;
-				y = buffer[i + j + 1] ^ buffer[i + j + 2 - 64] ^ z1;
-				if (shift < 64)
-				{
-					xorshft128_output[0] |= (x & 1) << (shift++);
-					xorshft128_output[0] |= (y & 1) << (shift++);
-				}
-				else
-				{
-					xorshft128_output[1] |= (x & 1) << (shift++ - 64);
-					xorshft128_output[1] |= (y & 1) << (shift++ - 64);
-				}
+				size = (uint16_t) (STREAM - offset);
 			}
+			sim.read(stream.data() + offset, size);
+			offset += size;
 		}
-		else
+		steps = (sim.xorshft64State() - start) * goldenInverse;
+
+		// A random slice at any byte offset
+		Csprng::get(&sliceOffset, sizeof(sliceOffset));
+		sliceOffset %= STREAM - SLICE;
+		locateBlockPairs(stream.data() + sliceOffset, SLICE, version, pairs, &pool);
+		printf("Version %d, %zu bytes at offset %" PRIu64 ": %zu block pairs", version, SLICE, sliceOffset, pairs.size());
+		if (!pairs.empty())
+		{
+			printf(", first at %" PRIu64 " (block %s), xorshft64_state = 0x%016" PRIx64, pairs[0].offset, pairs[0].z1Odd ? "z1 odd" : "z1 even", pairs[0].xorshft64_state);
+		}
+		printf("\n");
+
+		timer = std::chrono::steady_clock::now();
+		locateBlockPairs(stream.data(), STREAM, version, pairs, &pool);
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - timer).count();
+		for (size_t i = 0; i < pairs.size(); i++)
 		{
-			for (size_t j = 0; j < PRNG_ARRAY_SIZE_NORM - 4; j += 4)
+			// Every state found has to be one the device went through
+			if ((pairs[i].xorshft64_state - start) * goldenInverse > steps)
 			{
-				x = buffer[i + j    ] ^ buffer[i + j + 1 - 64] ^ z2;
-				y = buffer[i + j + 2] ^ buffer[i + j + 3 - 64] ^ z3;
-				if (shift < 64)
-				{
-					xorshft128_output[0] |= (x & 1) << (shift++);
-					xorshft128_output[0] |= (y & 1) << (shift++);
-				}
-				else
-				{
-					xorshft128_output[1] |= (x & 1) << (shift++ - 64);
-					xorshft128_output[1] |= (y & 1) << (shift++ - 64);
-				}
+				bad++;
 			}
 		}
+		printf("Whole %zu MiB: %zu block pairs (%zu bad) at %.0f MB/s on %d threads\n\n", STREAM >> 20, pairs.size(), bad, STREAM / seconds / 1e6, pool.threads());
 	}
 
-	printf("Recovering state...\n");
-	if (xorshft128_getState(xorshft128_state, xorshft128_output))
+	return 0;
+}
+
+// ## Captures ##
+
+// Records what a recovery reads from a fresh simulated device, then extraMiB more in 64 KiB reads
+int capture_record(const char *fileName, int version, uint64_t extraMiB)
+{
+	const size_t          READ_SIZE = 64 * 1024;
+	SrandomSim            target(version);
+	SrandomSim            scratch(version);
+	SimTarget             simTarget(target);
+	CaptureRecorder       recorder;
+	RecordingTarget       recording(simTarget, recorder);
+	std::vector<uint8_t>  buffer(READ_SIZE);
+
+	if (reset(target, 0)) return 1;
+	if (recorder.open(fileName, version)) return 1;
+	if (recoverSrandom(recording, scratch) || recording.error())
 	{
+		recorder.close();
 		return 1;
 	}
-	printf("xorshft128_state = 0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", xorshft128_state[0], xorshft128_state[1]);
-
-	// Incrementing xorshft128_state
-	printf("Incrementing recovered state...\n");
-	for (int i = 0; i < (256+64+64)/2; i++)
+	for (uint64_t i = 0; i < extraMiB * (1024 * 1024 / READ_SIZE); i++)
 	{
-		xorshft128(xorshft128_state);
+		if (recording.read(buffer.data(), READ_SIZE) != READ_SIZE || recording.error())
+		{
+			recorder.close();
+			return 1;
+		}
 	}
-	printf("xorshft128_state = 0x%016" PRIx64 ", 0x%016" PRIx64 "\n", xorshft128_state[0], xorshft128_state[1]);
-
-	return 0;
+	return recorder.close();
 }
 
-int makeArraysBufferPositionZero(int version, int &arraysBufferPosition, uint64_t &xorshft64_state)
+// Recovers the state from the start of a capture and checks the rest of it against the
+// prediction, straight out of the mapped file. The state after the capture goes in end if given.
+int capture_recover(const char *fileName, int print = 1, SrandomSim *end = NULL)
 {
-	printf("Make arraysBufferPosition = 0\n");
+	CaptureFile          capture;
+	RecoveryStats        stats;
+	std::vector<uint8_t> predicted;
+	uint64_t             bytes = 0;
+	uint64_t             reads = 0;
+	std::chrono::steady_clock::time_point start;
+	double               seconds;
 
-	for (int i = 0; i < 1021; i++)
+	if (capture.open(fileName)) return 1;
+
+	CaptureTarget target(capture);
+	SrandomSim    recovered(target.version());
+
+	if (print)
 	{
-		uint64_t z1_ = xorshft64(xorshft64_state);
-		uint64_t z1;
+		printf("%s: version %d, %" PRIu64 " bytes in %" PRIu64 " reads\n", fileName, target.version(), capture.header().dataSize, capture.readCount());
+	}
+	if (recoverSrandom(target, recovered, &stats))
+	{
+		printf("Recovery failed\n");
+		return 1;
+	}
+	if (print)
+	{
+		printf("Recovered from the first %" PRIu64 " bytes in %" PRIu64 " reads\n", stats.bytes, stats.reads);
+		print_recovery_stats(stats);
+	}
 
-		if (getXorshft64State(version, xorshft64_state, z1)) return 1;
+	start = std::chrono::steady_clock::now();
+	for (uint64_t i = target.position(); i < capture.readCount(); i++)
+	{
+		CaptureSpan span = capture.readSpan(i);
 
-		if (z1 != z1_)
+		if (predicted.size() < span.size)
 		{
-			arraysBufferPosition = 0;
-			break;
+			predicted.resize(span.size);
 		}
+		recovered.read(predicted.data(), span.size);
+		if (memcmp(predicted.data(), span.data, span.size) != 0)
+		{
+			printf("Read %" PRIu64 " doesn't match the prediction\n", i);
+			return 1;
+		}
+		bytes += span.size;
+		reads++;
+	}
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (print)
+	{
+		printf("Predicted the other %" PRIu64 " bytes in %" PRIu64 " reads, %.0f MB/s\n", bytes, reads, seconds > 0 ? bytes / seconds / 1e6 : 0.0);
 	}
-	if (arraysBufferPosition != 0)
+	if (end != NULL)
 	{
-		return 1; // error
+		*end = recovered;
 	}
+
 	return 0;
 }
 
-int show_srandom_normArrayBug()
+// Also clones the stream after each capture the way clone() does, with the CloneStream made
+// before the recovered state (and its version) replaces the default one
+int show_srandom_capture()
 {
-	const int VERSION = SRANDOM_VERSION_NORM_ARRAY_BUG;
-	const size_t PRNG_ARRAYS_SIZE_NORM = (NUMBER_OF_PRNG_ARRAYS_NORM + 1) * PRNG_ARRAY_SIZE_NORM;
+	const char  *FILE_NAME = "srandom-capture.tmp";
+	const size_t READ_SIZE = 64 * 1024;
+	const size_t READS     = 256;
 
-	uint64_t (*prngArrays)[NUMBER_OF_PRNG_ARRAYS_NORM + 1] = (uint64_t (*)[NUMBER_OF_PRNG_ARRAYS_NORM + 1]) new uint64_t[PRNG_ARRAYS_SIZE_NORM];
-	uint64_t xorshft64_state = 0;
-	uint64_t xorshft128_state[2] = {0};
-	int      arraysBufferPosition = -1;
-	uint64_t x, y, z1, z2, z3;
-	uint64_t buffer;
+	ThreadPool           pool;
+	std::vector<uint8_t> expected(READ_SIZE * READS);
+	std::vector<uint8_t> cloned(READ_SIZE * READS);
 
-	// Make state unknown
-	if (reset(VERSION)) return 1;
+	for (int version = SRANDOM_VERSION_NORM_ARRAY_BUG; version <= SRANDOM_VERSION_NORM; version++)
+	{
+		SrandomSim  state;
+		SrandomSim  device;
+		CloneStream stream(state, READ_SIZE, &pool);
+		int         ret;
+
+		printf("Version %d: recording a capture...\n", version);
+		if (capture_record(FILE_NAME, version, 64))
+		{
+			remove(FILE_NAME);
+			return 1;
+		}
+		ret = capture_recover(FILE_NAME, 1, &state);
+		remove(FILE_NAME);
+		if (ret) return 1;
+
+		device = state;
+		for (size_t i = 0; i < READS; i++)
+		{
+			device.read(expected.data() + i * READ_SIZE, READ_SIZE);
+		}
+		stream.generate(cloned.data(), READS);
+		printf("Cloned the next %zu MiB in %zu KiB reads %s (%s)\n", cloned.size() >> 20, READ_SIZE >> 10,
+			memcmp(expected.data(), cloned.data(), cloned.size()) == 0 ? "match" : "DON'T MATCH", stream.parallel() ? "arrays" : "one read at a time");
+		if (memcmp(expected.data(), cloned.data(), cloned.size()) != 0) return 1;
+		printf("\n");
+	}
+
+	return 0;
+}
 
-	// Get xorshft64() state
-	if (getXorshft64State(VERSION, xorshft64_state, z1, 1)) return 1;
+// ## Clone stream ##
 
-	// Make arraysBufferPosition = 0
-	if (makeArraysBufferPositionZero(VERSION, arraysBufferPosition, xorshft64_state)) return 1;
+// Checks CloneStream against one srandom_read() at a time and compares their speed
+int show_clone_stream()
+{
+	const size_t READ_SIZE = 64 * 1024;
+	const size_t READS     = 1024;
 
-	// Get xorshft128() state
-	if (getXorshft128StateNorm(VERSION, arraysBufferPosition, xorshft64_state, xorshft128_state)) return 1;
+	ThreadPool           pool;
+	std::vector<uint8_t> expected(READ_SIZE * READS);
+	std::vector<uint8_t> cloned(READ_SIZE * READS);
 
-	// Reset prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM]
-	printf("Reseting prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM]...\n");
-	for (int i = 0; i < 4; i++)
+	for (int version = SRANDOM_VERSION_NORM_ARRAY_BUG; version <= SRANDOM_VERSION_UHS; version++)
 	{
-		while (++arraysBufferPosition < 1021)
+		SrandomSim  device(version);
+		SrandomSim  clone(version);
+		CloneStream stream(clone, READ_SIZE, &pool);
+		std::chrono::steady_clock::time_point start;
+		double      readSeconds;
+		double      cloneSeconds;
+
+		device.reset(version);
+		clone.reset(version);
+
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < READS; i++)
 		{
-			if (srandom_read(&buffer, 1, VERSION) != 1) return 1;
-			update_sarray(prngArrays[0], xorshft64_state, xorshft128_state);
+			device.read(expected.data() + i * READ_SIZE, READ_SIZE);
 		}
+		readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-		if (srandom_read(&buffer, 1, VERSION) != 1) return 1;
-		arraysBufferPosition = 0;
-		update_sarray(prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM], xorshft64_state, xorshft128_state);
-		update_sarray(prngArrays[0], xorshft64_state, xorshft128_state);
+		start = std::chrono::steady_clock::now();
+		stream.generate(cloned.data(), READS);
+		cloneSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("Version %d: %zu MiB in %zu KiB reads %s, srandom_read() %.0f MB/s, CloneStream %.0f MB/s (%s on %d threads)\n",
+			version, expected.size() >> 20, READ_SIZE >> 10, memcmp(expected.data(), cloned.data(), expected.size()) == 0 ? "match" : "DON'T MATCH",
+			expected.size() / readSeconds / 1e6, cloned.size() / cloneSeconds / 1e6, stream.parallel() ? "arrays" : "one read at a time", pool.threads());
 	}
 
-	// Get state
-	printf("Get prngArrays...\n(I didn't keep track of them so just get them now)\n");
+	return 0;
+}
+
+// Recovers the state from a capture and writes what the device gives next to stdout. With a
+// checkpoint file it's saved after every window and, if it's there at the start, used instead
+// of the capture.
+int clone(int argc, char *argv[])
+{
+	const size_t WINDOW_SIZE = 64 * 1024 * 1024;
+
+	size_t      readSize   = 64 * 1024;
+	uint64_t    mib        = 1024;
+	int         threads    = 0;
+	const char *checkpoint = NULL;
+	FILE       *fin;
+	SrandomSim  state;
 
-	// ############################################
-	// #### Start of overlap array bug changes ####
-	// ############################################
-	// Just advance nextbuffer() to known output
-	//
-	// Technically this can fail but because this gives the next loop 269 tries to fill all of the arrays.
-	// But if array indexes 13, 14, 15 then it gets 208, 480, infinite more tries respectively.
-	// fuckit: added a reset
-fuckit:
-	while (arraysBufferPosition++ < 16 * (64 - (NUMBER_OF_PRNG_ARRAYS_NORM + 1)))
+	if (argc < 3)
 	{
-		if (srandom_read(&buffer, 1, VERSION) != 1) return 1;
-		update_sarray(prngArrays[0], xorshft64_state, xorshft128_state);
+		fprintf(stderr, "Usage: %s clone <capture file> [-r read size] [-m MiB] [-t threads] [-c checkpoint file]\n", argv[0]);
+		return 1;
 	}
-	arraysBufferPosition--;
-	// ##########################################
-	// #### End of overlap array bug changes ####
-	// ##########################################
-
-	int filledArrays = 0;
-	while (filledArrays != 0xffff)
+	for (int i = 3; i + 1 < argc; i += 2)
 	{
-		int index = nextbuffer(prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM], NUMBER_OF_PRNG_ARRAYS_NORM, xorshft64_state, xorshft128_state, arraysBufferPosition);
-		filledArrays |= 1 << index;
+		if (strcmp(argv[i], "-r") == 0)
+		{
+			readSize = strtoul(argv[i + 1], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-m") == 0)
+		{
+			mib = strtoull(argv[i + 1], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-t") == 0)
+		{
+			threads = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "-c") == 0)
+		{
+			checkpoint = argv[i + 1];
+		}
+	}
+	if (readSize == 0)
+	{
+		fprintf(stderr, "Error read size can't be 0\n");
+		return 1;
+	}
 
-		if (srandom_read(prngArrays[index], 512, VERSION) != 512) return 1;
-		update_sarray(prngArrays[index], xorshft64_state, xorshft128_state);
-		update_sarray(prngArrays[index], xorshft64_state, xorshft128_state);
+	ThreadPool  pool(threads);
+	CloneStream stream(state, readSize, &pool);
 
-		// ############################################
-		// #### Start of overlap array bug changes ####
-		// ############################################
-		if (arraysBufferPosition == 0 && (filledArrays & 0x8000) == 0)
+	fin = checkpoint != NULL ? fopen(checkpoint, "rb") : NULL;
+	if (fin != NULL)
+	{
+		fclose(fin);
+		if (stream.resume(checkpoint))
 		{
-			goto fuckit; // 1 in 34,651,867 chance
+			return 1;
 		}
-		// ##########################################
-		// #### End of overlap array bug changes ####
-		// ##########################################
+		fprintf(stderr, "Resuming from read %" PRIu64 " in \"%s\"\n", stream.reads(), checkpoint);
+	}
+	else if (capture_recover(argv[2], 0, &state))
+	{
+		return 1;
+	}
+	if (checkpoint != NULL)
+	{
+		stream.setCheckpoint(checkpoint, WINDOW_SIZE / readSize > 0 ? WINDOW_SIZE / readSize : 1);
 	}
 
-	printf("\nFull state of srandom recovered:\n");
-	printf("srandom:\n");
-	for (int i = 0; i < 4; i++)
+	return stream.write(stdout, mib << 20, WINDOW_SIZE);
+}
+
+int capture(int argc, char *argv[])
+{
+	int      version  = SRANDOM_VERSION_NORM;
+	uint64_t extraMiB = 64;
+
+	if (argc >= 4 && strcmp(argv[2], "record") == 0)
 	{
-		printf("   ");
-		for (int j = 0; j < 4; j++)
+		for (int i = 4; i + 1 < argc; i += 2)
 		{
-			if (srandom_read(&buffer, sizeof(buffer), VERSION) != sizeof(buffer)) return 1;
-			printf(" %016" PRIx64, buffer);
+			if (strcmp(argv[i], "-v") == 0)
+			{
+				version = atoi(argv[i + 1]);
+			}
+			else if (strcmp(argv[i], "-m") == 0)
+			{
+				extraMiB = strtoull(argv[i + 1], NULL, 10);
+			}
 		}
-		printf("\n");
+		return capture_record(argv[3], version, extraMiB);
 	}
-	printf("\n");
-	printf("srandom recovered:\n");
-	for (int i = 0; i < 4; i++)
+	if (argc == 4 && strcmp(argv[2], "recover") == 0)
 	{
-		printf("   ");
-		for (int j = 0; j < 4; j++)
+		return capture_recover(argv[3]);
+	}
+
+	fprintf(stderr, "Usage: %s capture record <file> [-v version] [-m extra MiB]\n", argv[0]);
+	fprintf(stderr, "       %s capture recover <file>\n", argv[0]);
+	return 1;
+}
+
+// ## Module init ##
+
+static void print_modinit_results(const ModInitSearch &search)
+{
+	for (size_t i = 0; i < search.results().size(); i++)
+	{
+		const ModInitResult &result = search.results()[i];
+
+		printf("Found nsec %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 "%s\n",
+			result.nsec[0], result.nsec[1], result.nsec[2], result.nsec[3], result.kthreadFirst ? " (kthread updated array 0 first)" : "");
+	}
+}
+
+// Loads a simulated module at known nanoseconds and finds them from its first read, stopping
+// half way and resuming from a checkpoint. Then what the measured rate means for a real search.
+int show_modinit()
+{
+	const char    *FILE_NAME  = "srandom-modinit.tmp";
+	const uint64_t NSEC0_SPAN = 16;
+	const uint64_t DELAY1     = 1024;
+	const uint64_t DELAY2     = 64;
+
+	ThreadPool pool;
+
+	for (int version = SRANDOM_VERSION_NORM_ARRAY_BUG; version <= SRANDOM_VERSION_NORM; version++)
+	{
+		SrandomSim device(version);
+		uint8_t    firstRead[4096];
+		uint64_t   random[4];
+		uint64_t   nsec[4];
+		int        kthreadFirst;
+
+		Csprng::get(random, sizeof(random));
+		nsec[0]      = random[0] % 999000000;
+		nsec[1]      = nsec[0] + 200 + random[1] % (DELAY1 - 200);
+		nsec[2]      = nsec[1] + random[2] % DELAY2;
+		nsec[3]      = nsec[2] + 30 + random[3] % 100;
+		kthreadFirst = (int) (random[3] >> 63);
+		device.modInit(nsec);
+		if (kthreadFirst)
 		{
-			if (srandom_read(&buffer, sizeof(buffer), (uint64_t*) prngArrays, xorshft64_state, xorshft128_state, arraysBufferPosition, VERSION) != sizeof(buffer)) return 1;
-			printf(" %016" PRIx64, buffer);
+			device.workThreadStep(0);
 		}
-		printf("\n");
+		device.read(firstRead, sizeof(firstRead));
+		printf("Version %d: module loaded at nsec %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 "%s\n",
+			version, nsec[0], nsec[1], nsec[2], nsec[3], kthreadFirst ? " (kthread updated array 0 first)" : "");
+
+		ModInitSearch first(version, firstRead, sizeof(firstRead));
+		ModInitSearch second(version, firstRead, sizeof(firstRead));
+
+		first.setRange(nsec[0] - NSEC0_SPAN / 2, nsec[0] + NSEC0_SPAN / 2, DELAY1, DELAY2);
+		first.setCheckpoint(FILE_NAME, 1e-9);
+		if (first.run(pool, 0, NSEC0_SPAN * DELAY1 / 64 / 2))
+		{
+			remove(FILE_NAME);
+			return 1;
+		}
+		second.setRange(nsec[0] - NSEC0_SPAN / 2, nsec[0] + NSEC0_SPAN / 2, DELAY1, DELAY2);
+		second.setCheckpoint(FILE_NAME, 1e-9);
+		if (second.resume(FILE_NAME) || second.run(pool))
+		{
+			remove(FILE_NAME);
+			return 1;
+		}
+		remove(FILE_NAME);
+		printf("Searched %" PRIu64 " candidates (stopped and resumed at %" PRIu64 ") in %.3f s, %.3g candidates/s with %s on %d threads\n",
+			second.candidatesDone(), first.candidatesDone(), second.seconds(), second.candidatesDone() / second.seconds(), ModInitSearch::isa(), pool.threads());
+		print_modinit_results(second);
+		if (second.results().empty())
+		{
+			printf("Not found\n");
+			return 1;
+		}
+
+		// nsec0 known to a millisecond or not at all, nsec1 within about a millisecond
+		// of it and nsec2 within 256 ns of that
+		double rate = second.candidatesDone() / second.seconds();
+
+		printf("At this rate: load time known to 1 ms %.3g days, unknown %.3g days\n\n",
+			1e6 * (1 << 20) * 256.0 / rate / 86400.0, 1e9 * (1 << 20) * 256.0 / rate / 86400.0);
 	}
-	printf("\n");
 
-	delete [] prngArrays;
 	return 0;
 }
 
-int show_srandom_norm()
+// Finds the nanoseconds a module was loaded at from the first read in a capture
+int modinit(int argc, char *argv[])
 {
-	const int VERSION = SRANDOM_VERSION_NORM;
-	const size_t PRNG_ARRAYS_SIZE_NORM = (NUMBER_OF_PRNG_ARRAYS_NORM + 1) * PRNG_ARRAY_SIZE_NORM;
+	uint64_t    nsec0Begin = 0;
+	uint64_t    nsec0End   = 1000000000;
+	uint64_t    delay1     = 1 << 20;
+	uint64_t    delay2     = 256;
+	int         threads    = 0;
+	const char *checkpoint = NULL;
+	FILE       *fin;
+	CaptureFile capture;
+
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s modinit <capture file> [-b nsec0 begin] [-e nsec0 end] [-1 nsec1 delay] [-2 nsec2 delay] [-t threads] [-c checkpoint file]\n", argv[0]);
+		return 1;
+	}
+	for (int i = 3; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "-b") == 0)
+		{
+			nsec0Begin = strtoull(argv[i + 1], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-e") == 0)
+		{
+			nsec0End = strtoull(argv[i + 1], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-1") == 0)
+		{
+			delay1 = strtoull(argv[i + 1], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-2") == 0)
+		{
+			delay2 = strtoull(argv[i + 1], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-t") == 0)
+		{
+			threads = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "-c") == 0)
+		{
+			checkpoint = argv[i + 1];
+		}
+	}
+	if (capture.open(argv[2])) return 1;
+	if (capture.readCount() == 0)
+	{
+		fprintf(stderr, "Error \"%s\" has no reads\n", argv[2]);
+		return 1;
+	}
 
-	uint64_t (*prngArrays)[PRNG_ARRAY_SIZE_NORM] = (uint64_t (*)[PRNG_ARRAY_SIZE_NORM]) new uint64_t[PRNG_ARRAYS_SIZE_NORM];
-	uint64_t xorshft64_state = 0;
-	uint64_t xorshft128_state[2] = {0};
-	int      arraysBufferPosition = -1;
-	uint64_t x, y, z1, z2, z3;
-	uint64_t buffer;
+	CaptureSpan   span = capture.readSpan(0);
+	ThreadPool    pool(threads);
+	ModInitSearch search((int) capture.header().srandomVersion, span.data, span.size);
 
-	// Make state unknown
-	if (reset(VERSION)) return 1;
+	search.setRange(nsec0Begin, nsec0End, delay1, delay2);
+	fin = checkpoint != NULL ? fopen(checkpoint, "rb") : NULL;
+	if (fin != NULL)
+	{
+		fclose(fin);
+		if (search.resume(checkpoint))
+		{
+			return 1;
+		}
+		fprintf(stderr, "Resuming at %" PRIu64 " of %" PRIu64 " candidates from \"%s\"\n", search.candidatesDone(), search.candidates(), checkpoint);
+	}
+	if (checkpoint != NULL)
+	{
+		search.setCheckpoint(checkpoint, 60.0);
+	}
+	fprintf(stderr, "Searching %" PRIu64 " candidates with %s on %d threads\n", search.candidates(), ModInitSearch::isa(), pool.threads());
+	if (search.run(pool, 1))
+	{
+		return 1;
+	}
+	print_modinit_results(search);
 
-	// Get xorshft64() state
-	if (getXorshft64State(VERSION, xorshft64_state, z1, 1)) return 1;
+	return search.results().empty() ? 1 : 0;
+}
 
-	// Make arraysBufferPosition = 0
-	if (makeArraysBufferPositionZero(VERSION, arraysBufferPosition, xorshft64_state)) return 1;
+// ## Batch trials ##
 
-	// Get xorshft128() state
-	if (getXorshft128StateNorm(VERSION, arraysBufferPosition, xorshft64_state, xorshft128_state)) return 1;
+static double percentile(std::vector<double> &sorted, int p)
+{
+	if (sorted.empty())
+	{
+		return 0.0;
+	}
+	return sorted[(sorted.size() - 1) * p / 100];
+}
 
-	// Reset prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM]
-	printf("Reseting prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM]...\n");
-	for (int i = 0; i < 4; i++)
+// Runs trials independent recoveries, each on its own simulated device, and prints how often
+// they work, what they cost the target and how long each phase takes. With seed trial i's
+// device is seeded from stream i, so everything but the times is the same every run.
+int batch_srandom(int version, size_t trials, ThreadPool &pool, const uint64_t *seed = NULL, RecoveryMode mode = RECOVERY_MODE_STANDARD)
+{
+	const size_t VERIFY_SIZE = 4096;
+
+	std::vector<RecoveryStats> stats(trials);
+	std::vector<char>          success(trials, 0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	double                     seconds;
+	size_t                     successes  = 0;
+	uint64_t                   bytes      = 0;
+	uint64_t                   reads      = 0;
+	uint64_t                   retries    = 0;
+	uint64_t                   hypotheses = 0;
+
+	pool.run(trials, [&](size_t index, int)
 	{
-		while (++arraysBufferPosition < 1021)
+		SrandomSim           target(version);
+		SrandomSim           recovered(version);
+		SimTarget            simTarget(target);
+		std::vector<uint8_t> targetOut(VERIFY_SIZE);
+		std::vector<uint8_t> recoveredOut(VERIFY_SIZE);
+
+		if (reset(target, 0, seed, index) || recoverSrandom(simTarget, recovered, &stats[index], 0, mode))
 		{
-			if (srandom_read(&buffer, 1, VERSION) != 1) return 1;
-			update_sarray(prngArrays[0], xorshft64_state, xorshft128_state);
+			return;
 		}
+		target.read(targetOut.data(), VERIFY_SIZE);
+		recovered.read(recoveredOut.data(), VERIFY_SIZE);
+		success[index] = memcmp(targetOut.data(), recoveredOut.data(), VERIFY_SIZE) == 0;
+	});
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-		if (srandom_read(&buffer, 1, VERSION) != 1) return 1;
-		arraysBufferPosition = 0;
-		update_sarray(prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM], xorshft64_state, xorshft128_state);
-		update_sarray(prngArrays[0], xorshft64_state, xorshft128_state);
+	for (size_t i = 0; i < trials; i++)
+	{
+		if (success[i])
+		{
+			successes++;
+			bytes   += stats[i].bytes;
+			reads   += stats[i].reads;
+			retries += stats[i].fuckitRetries;
+			hypotheses = std::max(hypotheses, stats[i].maxHypotheses);
+		}
 	}
 
-	// Get state
-	printf("Get prngArrays...\n(I didn't keep track of them so just get them now)\n");
-	int filledArrays = 0;
-	while (filledArrays != 0xffff)
+	printf("Version %d: %zu trials, %d threads, %.2f s (%.1f trials/sec)\n", version, trials, pool.threads(), seconds, trials / seconds);
+	if (seed != NULL)
 	{
-		int index = nextbuffer(prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM], NUMBER_OF_PRNG_ARRAYS_NORM, xorshft64_state, xorshft128_state, arraysBufferPosition);
-		filledArrays |= 1 << index;
-
-		if (srandom_read(prngArrays[index], 512, VERSION) != 512) return 1;
-		update_sarray(prngArrays[index], xorshft64_state, xorshft128_state);
-		update_sarray(prngArrays[index], xorshft64_state, xorshft128_state);
+		printf("Seed:              %" PRIu64 "\n", *seed);
 	}
-
-	printf("\nFull state of srandom recovered:\n");
-	printf("srandom:\n");
-	for (int i = 0; i < 4; i++)
+	printf("Mode:              %s\n", mode == RECOVERY_MODE_MIN_READS && version == SRANDOM_VERSION_NORM ? "minreads" : "standard");
+	printf("Success:           %zu/%zu (%.2f%%)\n", successes, trials, trials ? 100.0 * successes / trials : 0.0);
+	if (successes == 0)
 	{
-		printf("   ");
-		for (int j = 0; j < 4; j++)
+		printf("\n");
+		return 1;
+	}
+	printf("Read from target:  %.1f bytes in %.1f reads (average)\n", (double) bytes / successes, (double) reads / successes);
+	printf("Array bug retries: %" PRIu64 " (%.3g per trial)\n", retries, (double) retries / successes);
+	if (mode == RECOVERY_MODE_MIN_READS && version == SRANDOM_VERSION_NORM)
+	{
+		printf("Max hypotheses:    %" PRIu64 "\n", hypotheses);
+	}
+	printf("%-12s %10s %10s %10s %10s %10s %10s\n", "Phase (ms)", "p50", "p90", "p99", "max", "reads", "bytes");
+	for (int phase = 0; phase < RECOVERY_PHASES; phase++)
+	{
+		std::vector<double> times;
+		uint64_t            phaseReads = 0;
+		uint64_t            phaseBytes = 0;
+
+		for (size_t i = 0; i < trials; i++)
 		{
-			if (srandom_read(&buffer, sizeof(buffer), VERSION) != sizeof(buffer)) return 1;
-			printf(" %016" PRIx64, buffer);
+			if (success[i])
+			{
+				times.push_back(stats[i].phaseSeconds[phase] * 1000.0);
+				phaseReads += stats[i].phaseReads[phase];
+				phaseBytes += stats[i].phaseBytes[phase];
+			}
 		}
-		printf("\n");
+		std::sort(times.begin(), times.end());
+		printf("%-12s %10.3f %10.3f %10.3f %10.3f %10.1f %10.1f\n", recoveryPhaseName(phase), percentile(times, 50), percentile(times, 90), percentile(times, 99), times.back(),
+			(double) phaseReads / successes, (double) phaseBytes / successes);
 	}
-	printf("\n");
-	printf("srandom recovered:\n");
-	for (int i = 0; i < 4; i++)
+	if (INSTRUMENT_ENABLED)
 	{
-		printf("   ");
-		for (int j = 0; j < 4; j++)
+		printf("%-12s %10s %12s %12s %13s\n", "Phase (avg)", "cpu ms", "srandom_read", "bytes", "update_sarray");
+		for (int phase = 0; phase < RECOVERY_PHASES; phase++)
 		{
-			if (srandom_read(&buffer, sizeof(buffer), (uint64_t*) prngArrays, xorshft64_state, xorshft128_state, arraysBufferPosition, VERSION) != sizeof(buffer)) return 1;
-			printf(" %016" PRIx64, buffer);
+			double   cpuSeconds = 0.0;
+			uint64_t calls      = 0;
+			uint64_t callBytes  = 0;
+			uint64_t updates    = 0;
+
+			for (size_t i = 0; i < trials; i++)
+			{
+				if (success[i])
+				{
+					cpuSeconds += stats[i].phaseCpuSeconds[phase];
+					calls      += stats[i].phaseSrandomReads[phase];
+					callBytes  += stats[i].phaseSrandomBytes[phase];
+					updates    += stats[i].phaseUpdates[phase];
+				}
+			}
+			printf("%-12s %10.3f %12.1f %12.1f %13.1f\n", recoveryPhaseName(phase), cpuSeconds * 1000.0 / successes,
+				(double) calls / successes, (double) callBytes / successes, (double) updates / successes);
 		}
-		printf("\n");
 	}
 	printf("\n");
 
-	delete [] prngArrays;
-	return 0;
+	return successes == trials ? 0 : 1;
 }
 
-// not done
-int show_srandom_uhsArrayBug()
+int batch(int argc, char *argv[])
 {
-	return 0;
-}
+	size_t       trials  = 1000;
+	int          threads = 0;
+	int          version = -1;
+	uint64_t     seed    = 0;
+	int          seeded  = 0;
+	RecoveryMode mode    = RECOVERY_MODE_STANDARD;
+
+	for (int i = 2; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+		{
+			trials = strtoul(argv[++i], NULL, 10);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-t") == 0)
+		{
+			threads = atoi(argv[++i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-v") == 0)
+		{
+			version = atoi(argv[++i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+		{
+			seed   = strtoull(argv[++i], NULL, 0);
+			seeded = 1;
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-m") == 0 && (strcmp(argv[i + 1], "standard") == 0 || strcmp(argv[i + 1], "minreads") == 0))
+		{
+			mode = strcmp(argv[++i], "minreads") == 0 ? RECOVERY_MODE_MIN_READS : RECOVERY_MODE_STANDARD;
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s batch [-n trials] [-t threads] [-v version] [-s seed] [-m standard|minreads]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (version != -1 && version != SRANDOM_VERSION_NORM_ARRAY_BUG && version != SRANDOM_VERSION_NORM)
+	{
+		fprintf(stderr, "Error version %d isn't done\n", version);
+		return 1;
+	}
 
-// not done
-int show_srandom_uhs()
-{
-	return 0;
+	ThreadPool pool(threads);
+	int        ret = 0;
+
+	for (int v = SRANDOM_VERSION_NORM_ARRAY_BUG; v <= SRANDOM_VERSION_NORM; v++)
+	{
+		if (version == -1 || version == v)
+		{
+			ret |= batch_srandom(v, trials, pool, seeded ? &seed : NULL, mode);
+		}
+	}
+
+	return ret;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+	if (argc > 1 && strcmp(argv[1], "batch") == 0)
+	{
+		return batch(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "capture") == 0)
+	{
+		return capture(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "clone") == 0)
+	{
+		return clone(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "modinit") == 0)
+	{
+		return modinit(argc, argv);
+	}
+
 	show_xorshft64_getState();
 	printf("--------------------------------------\n");
 
+	show_xorshft64_batch();
+	printf("--------------------------------------\n");
+
 	show_xorshft128_getState();
 	printf("--------------------------------------\n");
 
+	show_xorshftPlus_getState<XorshftPlus<64, 23, 17, 26> >("xorshift128+ (23, 17, 26), srandom");
+	show_xorshftPlus_getState<XorshftPlus<64, 23, 18,  5> >("xorshift128+ (23, 18, 5)");
+	show_xorshftPlus_getState<XorshftPlus<32, 17, 14, 12> >("xorshift64+ (17, 14, 12)");
+	printf("--------------------------------------\n");
+
+	show_xorshft128_jump();
+	printf("--------------------------------------\n");
+
+	show_gf2_solve();
+	printf("--------------------------------------\n");
+
 	show_srandom_normArrayBug();
 	printf("--------------------------------------\n");
 
 	show_srandom_norm();
 	printf("--------------------------------------\n");
 
+	show_srandom_simd();
+	printf("--------------------------------------\n");
+
+	show_srandom_tracker();
+	printf("--------------------------------------\n");
+
+	show_resync();
+	printf("--------------------------------------\n");
+
+	show_srandom_capture();
+	printf("--------------------------------------\n");
+
+	show_clone_stream();
+	printf("--------------------------------------\n");
+
+	show_locateBlockPairs();
+	printf("--------------------------------------\n");
+
+	show_checkpoint();
+	printf("--------------------------------------\n");
+
+	show_modinit();
+	printf("--------------------------------------\n");
+
 	//todo: show_srandom_uhsArrayBug();
 	//todo: show_srandom_uhs();
 
@@ -0,0 +1,780 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "modinit.h"
+#include "checkpoint.h"
+#include "cpu.h"
+#include "xorshft.h"
+
+#define NSEC_PER_SEC UINT64_C(1000000000)
+#define GOLDEN       UINT64_C(0x9E3779B97F4A7C15)
+
+// What's checked, each an array's update_sarray() and 2 words of the first read: 0-15 are
+// arrays 0-15 after their update in mod_init(), 16 is array 0 after the kthread's first update.
+// With the array bug that update also writes over the start of arrays 1-3, so if the read was
+// of one of those after it 17-19 check the words the read has from array 4 instead. Padded to
+// a whole number of AVX-512 vectors.
+#define SLOTS          20
+#define SLOT_LANES     24
+#define KTHREAD_SLOT   16
+#define ARRAY_BUG_SLOT 17
+
+// Delays of nsec1 searched by each partition
+#define DELAY1_PER_PARTITION 64
+
+// Checkpoint file, all little endian:
+//   ModInitCheckpointHeader
+//   results, header.resultCount ModInitResult
+//
+// The range, version and a hash of the first read are kept so a checkpoint can't be resumed
+// into a different search. The checksum is over both with checksum 0.
+static const char     MODINIT_MAGIC[8]          = {'S', 'R', 'N', 'D', 'M', 'O', 'D', 0};
+static const uint32_t MODINIT_FORMAT_VERSION    = 1;
+
+struct ModInitCheckpointHeader
+{
+	char     magic[8];
+	uint32_t formatVersion;
+	uint32_t srandomVersion;
+	uint64_t nsec0Begin;
+	uint64_t nsec0End;
+	uint64_t delay1;
+	uint64_t delay2;
+	uint64_t firstReadSize;
+	uint64_t firstReadHash;
+	uint64_t nextPartition;
+	uint64_t candidatesDone;
+	double   seconds;
+	uint64_t resultCount;
+	uint64_t checksum;
+};
+
+// xorshft128 state[0] and state[1] of each slot
+struct SlotStates
+{
+	uint64_t s[2][SLOT_LANES];
+};
+
+// xorshft128() outputs before each slot's update_sarray(). Every array is filled with
+// PRNG_ARRAY_SIZE_NORM + 1 outputs then updated with 32 more.
+static int64_t slotStep(int slot)
+{
+	const int64_t perArray = PRNG_ARRAY_SIZE_NORM + 1 + 32;
+
+	if (slot >= ARRAY_BUG_SLOT)
+	{
+		return slotStep(4);
+	}
+	if (slot == KTHREAD_SLOT)
+	{
+		return (NUMBER_OF_PRNG_ARRAYS_NORM + 1) * perArray;
+	}
+	return slot * perArray + PRNG_ARRAY_SIZE_NORM + 1;
+}
+
+// xorshft64() outputs since seed_PRND_x() when the slot's update_sarray() takes its z1
+static int64_t slotZ1(int slot)
+{
+	if (slot >= ARRAY_BUG_SLOT)
+	{
+		return slotZ1(4);
+	}
+	if (slot == KTHREAD_SLOT)
+	{
+		return 3 * (NUMBER_OF_PRNG_ARRAYS_NORM + 1) + 1;
+	}
+	return 3 * slot + 1;
+}
+
+// The first of the 2 words, the other is 4 after it. Both are an xorshft128() output xored with
+// z3 (or z1), array 4's words 3 and 7 are 71 and 75 words from the start of array 0.
+static int slotWord(int slot)
+{
+	if (slot >= ARRAY_BUG_SLOT)
+	{
+		return 71 - 17 * (slot - ARRAY_BUG_SLOT + 1);
+	}
+	return 3;
+}
+
+// Images of the seeded state's bits at every slot, xorshft128() being linear
+struct ModInitTables
+{
+	SlotStates bits[128];   // state[0] bits then state[1] bits
+	SlotStates carries[30]; // state[1] ^= 2^(t+1) - 1, nsec2 to nsec2 + 1 when it has t trailing ones
+
+	ModInitTables()
+	{
+		memset(this, 0, sizeof(*this));
+		for (int bit = 0; bit < 128; bit++)
+		{
+			for (int slot = 0; slot < SLOTS; slot++)
+			{
+				uint64_t state[2] = {0, 0};
+
+				state[bit / 64] = UINT64_C(1) << (bit % 64);
+				xorshft128_jump(state, slotStep(slot));
+				bits[bit].s[0][slot] = state[0];
+				bits[bit].s[1][slot] = state[1];
+			}
+		}
+		for (int t = 0; t < 30; t++)
+		{
+			for (int bit = 0; bit <= t; bit++)
+			{
+				for (int slot = 0; slot < SLOTS; slot++)
+				{
+					carries[t].s[0][slot] ^= bits[64 + bit].s[0][slot];
+					carries[t].s[1][slot] ^= bits[64 + bit].s[1][slot];
+				}
+			}
+		}
+	}
+};
+
+static const ModInitTables &tables()
+{
+	static const ModInitTables tables;
+
+	return tables;
+}
+
+static void xorImage(SlotStates &states, uint64_t state0, uint64_t state1)
+{
+	const ModInitTables &t = tables();
+
+	for (int bit = 0; bit < 128; bit++)
+	{
+		if (((bit < 64 ? state0 : state1) >> (bit % 64)) & 1)
+		{
+			for (int slot = 0; slot < SLOTS; slot++)
+			{
+				states.s[0][slot] ^= t.bits[bit].s[0][slot];
+				states.s[1][slot] ^= t.bits[bit].s[1][slot];
+			}
+		}
+	}
+}
+
+static int trailingOnes(uint64_t x)
+{
+	int count = 0;
+
+	while (x & 1)
+	{
+		x >>= 1;
+		count++;
+	}
+	return count;
+}
+
+// Tries count nsec2 from nsec2 up, stopping after one that hits. A slot in mask hits when its
+// check is its target. slots gets the slots that hit, state and nsec2 are left at the next one.
+// Returns how many were tried. nsec2 + count has to be at most 10^9.
+typedef uint64_t (*ScanFunc)(SlotStates &state, uint64_t &nsec2, uint64_t count, const uint64_t targets[SLOT_LANES], uint32_t mask, uint32_t &slots);
+
+// ## Scalar ##
+
+// Word 3 ^ word 7 of the array updated from this state, without the xorshft64() output that's
+// in both
+static inline uint64_t slotCheck(uint64_t state0, uint64_t state1)
+{
+	uint64_t sum = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		uint64_t       s1 = state0;
+		const uint64_t s0 = state1;
+
+		state0 = s0;
+		s1    ^= s1 << 23;
+		state1 = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+		sum   ^= state1 + s0;
+	}
+	return sum;
+}
+
+static uint64_t scanScalar(SlotStates &state, uint64_t &nsec2, uint64_t count, const uint64_t targets[SLOT_LANES], uint32_t mask, uint32_t &slots)
+{
+	const ModInitTables &t = tables();
+	uint64_t             i = 0;
+
+	slots = 0;
+	while (i < count && slots == 0)
+	{
+		const SlotStates &carry = t.carries[trailingOnes(nsec2)];
+
+		for (int slot = 0; slot < SLOTS; slot++)
+		{
+			if (slotCheck(state.s[0][slot], state.s[1][slot]) == targets[slot])
+			{
+				slots |= 1u << slot;
+			}
+			state.s[0][slot] ^= carry.s[0][slot];
+			state.s[1][slot] ^= carry.s[1][slot];
+		}
+		slots &= mask;
+		nsec2++;
+		i++;
+	}
+	return i;
+}
+
+#ifdef CPU_X86
+
+// ## AVX2 ##
+
+CPU_TARGET("avx2")
+static inline __m256i slotCheckAvx2(__m256i state0, __m256i state1)
+{
+	__m256i sum = _mm256_setzero_si256();
+
+	for (int i = 0; i < 4; i++)
+	{
+		__m256i s1 = state0;
+		__m256i s0 = state1;
+
+		state0 = s0;
+		s1     = _mm256_xor_si256(s1, _mm256_slli_epi64(s1, 23));
+		state1 = _mm256_xor_si256(_mm256_xor_si256(s1, s0), _mm256_xor_si256(_mm256_srli_epi64(s1, 17), _mm256_srli_epi64(s0, 26)));
+		sum    = _mm256_xor_si256(sum, _mm256_add_epi64(state1, s0));
+	}
+	return sum;
+}
+
+CPU_TARGET("avx2")
+static uint64_t scanAvx2(SlotStates &state, uint64_t &nsec2, uint64_t count, const uint64_t targets[SLOT_LANES], uint32_t mask, uint32_t &slots)
+{
+	const int            VECTORS = SLOT_LANES / 4;
+	const ModInitTables &t       = tables();
+	__m256i              goal[VECTORS];
+	__m256i              s0[VECTORS];
+	__m256i              s1[VECTORS];
+	uint64_t             i       = 0;
+
+	for (int v = 0; v < VECTORS; v++)
+	{
+		goal[v] = _mm256_loadu_si256((const __m256i*) (targets + 4 * v));
+		s0[v] = _mm256_loadu_si256((const __m256i*) (state.s[0] + 4 * v));
+		s1[v] = _mm256_loadu_si256((const __m256i*) (state.s[1] + 4 * v));
+	}
+	slots = 0;
+	while (i < count && slots == 0)
+	{
+		const SlotStates &carry = t.carries[trailingOnes(nsec2)];
+
+		for (int v = 0; v < VECTORS; v++)
+		{
+			__m256i hit = _mm256_cmpeq_epi64(slotCheckAvx2(s0[v], s1[v]), goal[v]);
+
+			slots |= (uint32_t) _mm256_movemask_pd(_mm256_castsi256_pd(hit)) << (4 * v);
+			s0[v]  = _mm256_xor_si256(s0[v], _mm256_loadu_si256((const __m256i*) (carry.s[0] + 4 * v)));
+			s1[v]  = _mm256_xor_si256(s1[v], _mm256_loadu_si256((const __m256i*) (carry.s[1] + 4 * v)));
+		}
+		slots &= mask;
+		nsec2++;
+		i++;
+	}
+	for (int v = 0; v < VECTORS; v++)
+	{
+		_mm256_storeu_si256((__m256i*) (state.s[0] + 4 * v), s0[v]);
+		_mm256_storeu_si256((__m256i*) (state.s[1] + 4 * v), s1[v]);
+	}
+	return i;
+}
+
+// ## AVX-512 ##
+
+// Same as _mm512_srli_epi64(), which GCC warns about when inlined into a target() function
+// because of the undefined value it uses as the unused mask source
+CPU_TARGET("avx512f")
+static inline __m512i srliAvx512(__m512i a, unsigned int shift)
+{
+	return _mm512_maskz_srli_epi64((__mmask8) 0xff, a, shift);
+}
+
+CPU_TARGET("avx512f")
+static inline __m512i slotCheckAvx512(__m512i state0, __m512i state1)
+{
+	__m512i sum = _mm512_setzero_si512();
+
+	for (int i = 0; i < 4; i++)
+	{
+		__m512i s1 = state0;
+		__m512i s0 = state1;
+
+		state0 = s0;
+		s1     = _mm512_xor_si512(s1, _mm512_maskz_slli_epi64((__mmask8) 0xff, s1, 23));
+		state1 = _mm512_ternarylogic_epi64(s1, s0, _mm512_xor_si512(srliAvx512(s1, 17), srliAvx512(s0, 26)), 0x96);
+		sum    = _mm512_xor_si512(sum, _mm512_add_epi64(state1, s0));
+	}
+	return sum;
+}
+
+CPU_TARGET("avx512f")
+static uint64_t scanAvx512(SlotStates &state, uint64_t &nsec2, uint64_t count, const uint64_t targets[SLOT_LANES], uint32_t mask, uint32_t &slots)
+{
+	const int            VECTORS = SLOT_LANES / 8;
+	const ModInitTables &t       = tables();
+	__m512i              goal[VECTORS];
+	__m512i              s0[VECTORS];
+	__m512i              s1[VECTORS];
+	uint64_t             i       = 0;
+
+	for (int v = 0; v < VECTORS; v++)
+	{
+		goal[v] = _mm512_loadu_si512(targets + 8 * v);
+		s0[v] = _mm512_loadu_si512(state.s[0] + 8 * v);
+		s1[v] = _mm512_loadu_si512(state.s[1] + 8 * v);
+	}
+	slots = 0;
+	while (i < count && slots == 0)
+	{
+		const SlotStates &carry = t.carries[trailingOnes(nsec2)];
+
+		for (int v = 0; v < VECTORS; v++)
+		{
+			slots |= (uint32_t) _mm512_cmpeq_epi64_mask(slotCheckAvx512(s0[v], s1[v]), goal[v]) << (8 * v);
+			s0[v]  = _mm512_xor_si512(s0[v], _mm512_loadu_si512(carry.s[0] + 8 * v));
+			s1[v]  = _mm512_xor_si512(s1[v], _mm512_loadu_si512(carry.s[1] + 8 * v));
+		}
+		slots &= mask;
+		nsec2++;
+		i++;
+	}
+	for (int v = 0; v < VECTORS; v++)
+	{
+		_mm512_storeu_si512(state.s[0] + 8 * v, s0[v]);
+		_mm512_storeu_si512(state.s[1] + 8 * v, s1[v]);
+	}
+	return i;
+}
+
+#endif
+
+// ## Dispatch ##
+// No SSE4.2 version, two lanes isn't faster than scalar
+
+static const ScanFunc SCAN[] =
+{
+	scanScalar,
+#ifdef CPU_X86
+	NULL,
+	scanAvx2,
+	scanAvx512,
+#endif
+};
+
+static int selectLevel()
+{
+	int level = cpu_level();
+
+	if (level >= (int) (sizeof(SCAN) / sizeof(*SCAN)))
+	{
+		level = (int) (sizeof(SCAN) / sizeof(*SCAN)) - 1;
+	}
+	if (level == CPU_LEVEL_SSE42)
+	{
+		level = CPU_LEVEL_SCALAR;
+	}
+
+#ifndef NDEBUG
+	// Random states with a hit planted part way in
+	const uint64_t COUNT = 29;
+	SlotStates     start;
+	SlotStates     state[2];
+	uint64_t       nsec2[2];
+	uint64_t       done[2];
+	uint32_t       slots[2];
+	uint64_t       targets[SLOT_LANES] = {0};
+
+	memset(&start, 0, sizeof(start));
+	for (int slot = 0; slot < SLOTS; slot++)
+	{
+		start.s[0][slot] = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+		start.s[1][slot] = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+	}
+	state[0] = start;
+	nsec2[0] = 1000;
+	scanScalar(state[0], nsec2[0], 17, targets, 0, slots[0]);
+	targets[5]  = slotCheck(state[0].s[0][5],  state[0].s[1][5]);
+	targets[18] = slotCheck(state[0].s[0][18], state[0].s[1][18]);
+	for (int i = CPU_LEVEL_AVX2; i <= level; i++)
+	{
+		for (int j = 0; j < 2; j++)
+		{
+			state[j] = start;
+			nsec2[j] = 1000;
+			done[j]  = (j == 0 ? scanScalar : SCAN[i])(state[j], nsec2[j], COUNT, targets, (1u << SLOTS) - 1, slots[j]);
+		}
+		if (done[0] != done[1] || nsec2[0] != nsec2[1] || slots[0] != slots[1] || memcmp(&state[0], &state[1], sizeof(state[0])) != 0)
+		{
+			cpu_checkFailed("modInitScan", i);
+		}
+	}
+#endif
+
+	return level;
+}
+
+static int scanLevel()
+{
+	static const int level = selectLevel();
+
+	return level;
+}
+
+const char *ModInitSearch::isa()
+{
+	return cpu_levelName(scanLevel());
+}
+
+// ## Search ##
+
+ModInitSearch::ModInitSearch(int version, const void *firstRead, size_t size) :
+	m_firstRead((const uint8_t*) firstRead, (const uint8_t*) firstRead + size)
+{
+	std::vector<uint64_t> words(size / sizeof(uint64_t));
+
+	memcpy(words.data(), firstRead, words.size() * sizeof(uint64_t));
+	memset(m_targets, 0, sizeof(m_targets));
+	m_version         = version;
+	m_slotMask        = 0;
+	m_checkpointEvery = 0;
+	for (int slot = 0; slot < SLOTS; slot++)
+	{
+		if ((slot < ARRAY_BUG_SLOT || version == SRANDOM_VERSION_NORM_ARRAY_BUG) && (size_t) slotWord(slot) + 4 < words.size())
+		{
+			m_targets[slot] = words[slotWord(slot)] ^ words[slotWord(slot) + 4];
+			m_slotMask     |= 1u << slot;
+		}
+	}
+	setRange(0, NSEC_PER_SEC, 1 << 20, 256);
+}
+
+void ModInitSearch::setRange(uint64_t nsec0Begin, uint64_t nsec0End, uint64_t delay1, uint64_t delay2)
+{
+	m_nsec0Begin     = std::min(nsec0Begin, NSEC_PER_SEC);
+	m_nsec0End       = std::max(m_nsec0Begin, std::min(nsec0End, NSEC_PER_SEC));
+	m_delay1         = delay1;
+	m_delay2         = delay2;
+	m_nextPartition  = 0;
+	m_candidatesDone = 0;
+	m_seconds        = 0.0;
+	m_results.clear();
+}
+
+void ModInitSearch::setCheckpoint(const char *fileName, double everySeconds)
+{
+	m_checkpointName  = fileName != NULL ? fileName : "";
+	m_checkpointEvery = fileName != NULL ? everySeconds : 0.0;
+}
+
+uint64_t ModInitSearch::candidates() const
+{
+	return (m_nsec0End - m_nsec0Begin) * m_delay1 * m_delay2;
+}
+
+uint64_t ModInitSearch::partitions() const
+{
+	return (m_nsec0End - m_nsec0Begin) * ((m_delay1 + DELAY1_PER_PARTITION - 1) / DELAY1_PER_PARTITION);
+}
+
+// One nsec0 and DELAY1_PER_PARTITION nsec1
+void ModInitSearch::searchPartition(uint64_t partition, uint64_t &candidates)
+{
+	static const ScanFunc scan = SCAN[scanLevel()];
+
+	const uint64_t chunks      = (m_delay1 + DELAY1_PER_PARTITION - 1) / DELAY1_PER_PARTITION;
+	const uint64_t nsec0       = m_nsec0Begin + partition / chunks;
+	const uint64_t delay1Begin = partition % chunks * DELAY1_PER_PARTITION;
+	const uint64_t delay1End   = std::min(delay1Begin + DELAY1_PER_PARTITION, m_delay1);
+	uint64_t       x           = nsec0;
+	uint64_t       s0          = xorshft64(x);
+	uint64_t       s1          = xorshft64(x);
+	SlotStates     seeded;
+
+	memset(&seeded, 0, sizeof(seeded));
+	xorImage(seeded, s0 << 31, s1 << 24);
+	for (uint64_t delay1 = delay1Begin; delay1 < delay1End; delay1++)
+	{
+		const uint64_t nsec1 = (nsec0 + delay1) % NSEC_PER_SEC;
+		SlotStates     withNsec1 = seeded;
+
+		xorImage(withNsec1, nsec1, 0);
+		for (uint64_t delay2 = 0; delay2 < m_delay2;)
+		{
+			uint64_t   nsec2 = (nsec1 + delay2) % NSEC_PER_SEC;
+			uint64_t   run   = std::min(m_delay2 - delay2, NSEC_PER_SEC - nsec2);
+			SlotStates state = withNsec1;
+
+			// tv_nsec wraps at 10^9, not a power of 2, so the images start over there
+			xorImage(state, 0, nsec2);
+			while (run > 0)
+			{
+				uint32_t slots;
+				uint64_t tried = scan(state, nsec2, run, m_targets, m_slotMask, slots);
+
+				run        -= tried;
+				delay2     += tried;
+				candidates += tried;
+				if (slots != 0)
+				{
+					checkHit(nsec0, nsec1, nsec2 - 1, slots);
+				}
+			}
+		}
+	}
+}
+
+// Undoes the xorshft64() output in word 3 to x for both cases of z1's low bit. x has to be
+// nsec0's x shifted up with nsec3 in the bottom. Then the whole read is checked.
+void ModInitSearch::checkHit(uint64_t nsec0, uint64_t nsec1, uint64_t nsec2, uint32_t slots)
+{
+	uint64_t x  = nsec0;
+	uint64_t s0 = xorshft64(x);
+	uint64_t s1 = xorshft64(x);
+
+	for (int slot = 0; slot < SLOTS; slot++)
+	{
+		uint64_t state[2] = {(s0 << 31) ^ nsec1, (s1 << 24) ^ nsec2};
+		uint64_t z;
+
+		memcpy(&z, m_firstRead.data() + slotWord(slot) * sizeof(uint64_t), sizeof(z));
+		if (((slots >> slot) & 1) == 0)
+		{
+			continue;
+		}
+		xorshft128_jump(state, slotStep(slot));
+		z ^= xorshft128(state);
+		z ^= xorshft128(state);
+		for (int z1Odd = 0; z1Odd < 2; z1Odd++)
+		{
+			uint64_t xorshft64_state = xorshft64_getState(z);
+			uint64_t nsec[4]         = {nsec0, nsec1, nsec2, 0};
+
+			// The word has z3 when z1 is even, otherwise z1
+			xorshft64_skip(xorshft64_state, -(slotZ1(slot) + (z1Odd ? 0 : 2)));
+			if ((xorshft64_state >> 32) != ((nsec0 + 2 * GOLDEN) & 0xffffffff) || (xorshft64_state & 0xffffffff) >= NSEC_PER_SEC)
+			{
+				continue;
+			}
+			nsec[3] = xorshft64_state & 0xffffffff;
+
+			// Array 0 could have had the kthread's update or not, the others can't tell in their
+			// first block
+			for (int kthreadFirst = 0; kthreadFirst < 2; kthreadFirst++)
+			{
+				SrandomSim           sim(m_version);
+				std::vector<uint8_t> out(m_firstRead.size());
+				ModInitResult        result;
+
+				if ((slot == 0 && kthreadFirst) || (slot >= KTHREAD_SLOT && !kthreadFirst))
+				{
+					continue;
+				}
+				sim.modInit(nsec);
+				if (kthreadFirst)
+				{
+					sim.workThreadStep(0);
+				}
+				sim.read(out.data(), out.size());
+				if (memcmp(out.data(), m_firstRead.data(), out.size()) != 0)
+				{
+					continue;
+				}
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				memcpy(result.nsec, nsec, sizeof(nsec));
+				result.kthreadFirst = kthreadFirst;
+				result.padding      = 0;
+				m_results.push_back(result);
+			}
+		}
+	}
+}
+
+static void printEta(double seconds)
+{
+	if (seconds < 120.0)
+	{
+		fprintf(stderr, "%.0f s", seconds);
+	}
+	else if (seconds < 2 * 3600.0)
+	{
+		fprintf(stderr, "%.1f minutes", seconds / 60.0);
+	}
+	else if (seconds < 2 * 86400.0)
+	{
+		fprintf(stderr, "%.1f hours", seconds / 3600.0);
+	}
+	else
+	{
+		fprintf(stderr, "%.3g days", seconds / 86400.0);
+	}
+}
+
+// Partitions are done in rounds of about a second, so progress and checkpoints only ever have
+// to remember where the next round starts
+int ModInitSearch::run(ThreadPool &pool, int print, uint64_t maxPartitions)
+{
+	const uint64_t total     = partitions();
+	uint64_t       roundSize = (uint64_t) pool.threads() * 4;
+	uint64_t       left      = maxPartitions != 0 ? maxPartitions : total;
+	std::chrono::steady_clock::time_point lastSave = std::chrono::steady_clock::now();
+
+	if (m_version != SRANDOM_VERSION_NORM_ARRAY_BUG && m_version != SRANDOM_VERSION_NORM)
+	{
+		fprintf(stderr, "Error version %d isn't done\n", m_version);
+		return 1;
+	}
+	if ((m_slotMask & 1) == 0)
+	{
+		fprintf(stderr, "Error need at least 64 bytes of the first read, got %zu\n", m_firstRead.size());
+		return 1;
+	}
+
+	while (m_nextPartition < total && left > 0)
+	{
+		const uint64_t        count = std::min(std::min(roundSize, total - m_nextPartition), left);
+		const uint64_t        first = m_nextPartition;
+		std::vector<uint64_t> tried(pool.threads(), 0);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		double                seconds;
+
+		pool.run((size_t) count, [&](size_t index, int thread)
+		{
+			searchPartition(first + index, tried[thread]);
+		});
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		for (size_t i = 0; i < tried.size(); i++)
+		{
+			m_candidatesDone += tried[i];
+		}
+		m_nextPartition += count;
+		m_seconds       += seconds;
+		left            -= count;
+
+		// Aim for a second a round, growing at most 4 times each time
+		roundSize = std::max<uint64_t>(1, std::min<uint64_t>(count * 4, (uint64_t) (count / std::max(seconds, 1e-3))));
+
+		if (print)
+		{
+			double rate = m_candidatesDone / std::max(m_seconds, 1e-9);
+
+			fprintf(stderr, "\r%6.2f%%, %.3g candidates/s, %zu found, ETA ", 100.0 * m_nextPartition / total, rate, m_results.size());
+			printEta((candidates() - m_candidatesDone) / rate);
+			fprintf(stderr, "   ");
+		}
+		if (m_checkpointEvery > 0.0 &&
+			(std::chrono::duration<double>(std::chrono::steady_clock::now() - lastSave).count() >= m_checkpointEvery || m_nextPartition >= total || left == 0))
+		{
+			if (save())
+			{
+				return 1;
+			}
+			lastSave = std::chrono::steady_clock::now();
+		}
+	}
+	if (print)
+	{
+		fprintf(stderr, "\n");
+	}
+
+	return 0;
+}
+
+// ## Checkpoints ##
+
+static void fillHeader(ModInitCheckpointHeader &header, int version, const std::vector<uint8_t> &firstRead, uint64_t nsec0Begin, uint64_t nsec0End, uint64_t delay1, uint64_t delay2)
+{
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MODINIT_MAGIC, sizeof(MODINIT_MAGIC));
+	header.formatVersion  = MODINIT_FORMAT_VERSION;
+	header.srandomVersion = (uint32_t) version;
+	header.nsec0Begin     = nsec0Begin;
+	header.nsec0End       = nsec0End;
+	header.delay1         = delay1;
+	header.delay2         = delay2;
+	header.firstReadSize  = firstRead.size();
+	header.firstReadHash  = checkpoint_fnv1a(firstRead.data(), firstRead.size());
+}
+
+int ModInitSearch::save()
+{
+	ModInitCheckpointHeader header;
+	std::vector<uint8_t>    file(sizeof(header) + m_results.size() * sizeof(ModInitResult));
+
+	fillHeader(header, m_version, m_firstRead, m_nsec0Begin, m_nsec0End, m_delay1, m_delay2);
+	header.nextPartition  = m_nextPartition;
+	header.candidatesDone = m_candidatesDone;
+	header.seconds        = m_seconds;
+	header.resultCount    = m_results.size();
+	memcpy(file.data(), &header, sizeof(header));
+	if (!m_results.empty())
+	{
+		memcpy(file.data() + sizeof(header), m_results.data(), m_results.size() * sizeof(ModInitResult));
+	}
+	header.checksum = checkpoint_fnv1a(file.data(), file.size());
+	memcpy(file.data(), &header, sizeof(header));
+
+	return checkpoint_writeFile(m_checkpointName.c_str(), file.data(), file.size());
+}
+
+int ModInitSearch::resume(const char *fileName)
+{
+	ModInitCheckpointHeader    header;
+	ModInitCheckpointHeader    expected;
+	std::vector<ModInitResult> results;
+	FILE                      *fin = fopen(fileName, "rb");
+	uint64_t                   checksum;
+
+	if (fin == NULL)
+	{
+		perror(fileName);
+		return 1;
+	}
+	if (fread(&header, sizeof(header), 1, fin) != 1 ||
+		memcmp(header.magic, MODINIT_MAGIC, sizeof(MODINIT_MAGIC)) != 0 ||
+		header.formatVersion != MODINIT_FORMAT_VERSION)
+	{
+		fprintf(stderr, "Error \"%s\" isn't a module init search checkpoint\n", fileName);
+		fclose(fin);
+		return 1;
+	}
+	fillHeader(expected, m_version, m_firstRead, m_nsec0Begin, m_nsec0End, m_delay1, m_delay2);
+	if (memcmp(&header, &expected, offsetof(ModInitCheckpointHeader, nextPartition)) != 0)
+	{
+		fprintf(stderr, "Error \"%s\" is from a different search\n", fileName);
+		fclose(fin);
+		return 1;
+	}
+	results.resize((size_t) header.resultCount);
+	if (!results.empty() && fread(results.data(), results.size() * sizeof(ModInitResult), 1, fin) != 1)
+	{
+		fprintf(stderr, "Error \"%s\" is truncated\n", fileName);
+		fclose(fin);
+		return 1;
+	}
+	fclose(fin);
+
+	checksum        = header.checksum;
+	header.checksum = 0;
+	if (checkpoint_fnv1a(results.data(), results.size() * sizeof(ModInitResult), checkpoint_fnv1a(&header, sizeof(header))) != checksum)
+	{
+		fprintf(stderr, "Error \"%s\" fails its checksum\n", fileName);
+		return 1;
+	}
+
+	m_nextPartition  = header.nextPartition;
+	m_candidatesDone = header.candidatesDone;
+	m_seconds        = header.seconds;
+	m_results        = results;
+	return 0;
+}
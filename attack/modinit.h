@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "srandom.h"
+#include "threadpool.h"
+
+// Recovers a freshly loaded module from the first read after mod_init(), by brute forcing the
+// tv_nsec of its four ktime reads (see SrandomSim::modInit()). nsec0 seeds x and through it
+// xorshft128's state, nsec1 and nsec2 are xored into that state a few hundred microseconds
+// later and nsec3 into x right after. Each is under 10^9.
+//
+// Candidates are (nsec0, nsec1 = nsec0 + delay1, nsec2 = nsec1 + delay2). xorshft128 is linear,
+// so its state at the start of each array's update_sarray() is the xor of precomputed images
+// of the seed's bits, and going to the next nsec2 is one xor. In update_sarray() words 3 and 7
+// are xorshft128() outputs xored with the same xorshft64() output, so word 3 ^ word 7 of the
+// first read depends only on the candidate, not x. That's checked against all 16 arrays (plus
+// array 0 after the kthread's first update, in case it got there before the read, and with the
+// array bug the arrays that update overlaps) 8 or 4 at a time with AVX-512 or AVX2 (see
+// cpu.h). A hit gives that xorshft64() output, which is undone to x, which has to be the
+// candidate's nsec0 in the top half and a valid nsec3 in the bottom.
+// Then the whole read is checked with SrandomSim.
+//
+// Only SRANDOM_VERSION_NORM_ARRAY_BUG and SRANDOM_VERSION_NORM. mod_init() uses update_sarray()
+// in UHS too, but the slots here are laid out for 16 arrays of 67 words and the kthread.
+struct ModInitResult
+{
+	uint64_t nsec[4];
+	uint32_t kthreadFirst; // The kthread updated array 0 before the read
+	uint32_t padding;
+};
+
+class ModInitSearch
+{
+public:
+	// firstRead is the output of the first read after the module loaded, at least 64 bytes
+	ModInitSearch(int version, const void *firstRead, size_t size);
+
+	// nsec0 in [nsec0Begin, nsec0End), delays in [0, delay1) and [0, delay2) (wrapping at 10^9
+	// like tv_nsec). Starts the search over.
+	void     setRange(uint64_t nsec0Begin, uint64_t nsec0End, uint64_t delay1, uint64_t delay2);
+
+	// run() saves its progress to fileName (in the style of checkpoint.h) about every
+	// everySeconds
+	void     setCheckpoint(const char *fileName, double everySeconds);
+
+	// Carries on from a checkpoint of the same search (range, version and first read). Returns
+	// 0 on success, otherwise 1.
+	int      resume(const char *fileName);
+
+	// Searches until done, or maxPartitions more partitions are done if it isn't 0. print shows
+	// the rate and ETA on stderr as it goes. Returns 0 on success, otherwise 1.
+	int      run(ThreadPool &pool, int print = 0, uint64_t maxPartitions = 0);
+
+	const std::vector<ModInitResult> &results() const { return m_results; }
+
+	uint64_t candidates()     const; // In the range
+	uint64_t candidatesDone() const { return m_candidatesDone; }
+	double   seconds()        const { return m_seconds; } // Spent in run(), across resumes
+	bool     done()           const { return m_nextPartition >= partitions(); }
+
+	// Which code path the check uses
+	static const char *isa();
+
+private:
+	uint64_t partitions() const;
+	void     searchPartition(uint64_t partition, uint64_t &candidates);
+	void     checkHit(uint64_t nsec0, uint64_t nsec1, uint64_t nsec2, uint32_t slots);
+	int      save();
+
+	int                        m_version;
+	std::vector<uint8_t>       m_firstRead;
+	uint64_t                   m_targets[24]; // Of each slot, see modinit.cpp
+	uint32_t                   m_slotMask;    // Slots checked
+	uint64_t                   m_nsec0Begin;
+	uint64_t                   m_nsec0End;
+	uint64_t                   m_delay1;
+	uint64_t                   m_delay2;
+
+	uint64_t                   m_nextPartition;
+	uint64_t                   m_candidatesDone;
+	double                     m_seconds;
+	std::vector<ModInitResult> m_results;
+	std::mutex                 m_mutex;   // m_results while searching
+
+	std::string                m_checkpointName;
+	double                     m_checkpointEvery;
+};
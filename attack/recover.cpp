@@ -0,0 +1,1115 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "recover.h"
+#include "xorshft.h"
+#include "instrument.h"
+
+const uint8_t *SrandomTarget::readSpan(size_t bufferSize)
+{
+	if (m_scratch.size() < bufferSize)
+	{
+		m_scratch.resize(bufferSize);
+	}
+	if (read(m_scratch.data(), bufferSize) != bufferSize)
+	{
+		return NULL;
+	}
+	return m_scratch.data();
+}
+
+// Counts reads and bytes on the way through
+class CountingTarget : public SrandomTarget
+{
+public:
+	CountingTarget(SrandomTarget &target) : m_target(target), m_reads(0), m_bytes(0) {}
+
+	size_t read(void *buffer, size_t bufferSize)
+	{
+		size_t ret = m_target.read(buffer, bufferSize);
+
+		m_reads++;
+		m_bytes += ret;
+		return ret;
+	}
+	const uint8_t *readSpan(size_t bufferSize)
+	{
+		const uint8_t *ret = m_target.readSpan(bufferSize);
+
+		if (ret != NULL)
+		{
+			m_reads++;
+			m_bytes += bufferSize;
+		}
+		return ret;
+	}
+	int    version() const { return m_target.version(); }
+
+	uint64_t reads() const { return m_reads; }
+	uint64_t bytes() const { return m_bytes; }
+
+private:
+	SrandomTarget &m_target;
+	uint64_t       m_reads;
+	uint64_t       m_bytes;
+};
+
+// Charges time, reads and bytes to the current phase as it changes. Phases can be gone back
+// to, they add up.
+class PhaseTimer
+{
+public:
+	PhaseTimer(RecoveryStats *stats, const CountingTarget &target) :
+		m_stats(stats), m_target(target), m_phase(0), m_reads(target.reads()), m_bytes(target.bytes()), m_start(std::chrono::steady_clock::now()),
+		m_counters(instrument_get()), m_cpuStart(instrument_cpuSeconds()) {}
+
+	void next() { to(m_phase + 1); }
+
+	void to(int phase)
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+		if (m_stats != NULL && m_phase < RECOVERY_PHASES)
+		{
+			m_stats->phaseSeconds[m_phase] += std::chrono::duration<double>(now - m_start).count();
+			m_stats->phaseReads  [m_phase] += m_target.reads() - m_reads;
+			m_stats->phaseBytes  [m_phase] += m_target.bytes() - m_bytes;
+			if (INSTRUMENT_ENABLED)
+			{
+				InstrumentCounters counters = instrument_get();
+				double             cpu      = instrument_cpuSeconds();
+
+				m_stats->phaseCpuSeconds  [m_phase] += cpu - m_cpuStart;
+				m_stats->phaseSrandomReads[m_phase] += counters.srandomReads - m_counters.srandomReads;
+				m_stats->phaseSrandomBytes[m_phase] += counters.srandomBytes - m_counters.srandomBytes;
+				m_stats->phaseUpdates     [m_phase] += counters.updateSarray - m_counters.updateSarray;
+			}
+		}
+		m_phase = phase;
+		m_reads = m_target.reads();
+		m_bytes = m_target.bytes();
+		m_start = now;
+		if (INSTRUMENT_ENABLED)
+		{
+			m_counters = instrument_get();
+			m_cpuStart = instrument_cpuSeconds();
+		}
+	}
+
+private:
+	RecoveryStats                        *m_stats;
+	const CountingTarget                 &m_target;
+	int                                   m_phase;
+	uint64_t                              m_reads;
+	uint64_t                              m_bytes;
+	std::chrono::steady_clock::time_point m_start;
+	InstrumentCounters                    m_counters;
+	double                                m_cpuStart;
+};
+
+// From the first block and the start of the second of a read, the state after both updates
+static int xorshft64StateFromBlocks(const uint64_t buffer[64+4], int version, uint64_t &xorshft64_state, uint64_t &z1)
+{
+	uint64_t x, y, z2, z3;
+
+	if (version == SRANDOM_VERSION_NORM_ARRAY_BUG || version == SRANDOM_VERSION_NORM)
+	{
+		z3 = buffer[1] ^ buffer[64 + 0] ^ buffer[64 + 3];
+		xorshft64_state = xorshft64_getState(z3);
+		xorshft64_skip(xorshft64_state, -3);
+		z1 = xorshft64(xorshft64_state);
+		z2 = xorshft64(xorshft64_state);
+		xorshft64_skip(xorshft64_state, 1);
+		x = buffer[3] ^ buffer[64 + 2] ^ z2;
+		y = buffer[2] ^ buffer[64 + 1] ^ z1;
+		if ((z1 & 1) != 0 || buffer[64 + 3] != (x ^ y ^ z3))
+		{
+			z1 = buffer[2] ^ buffer[64 + 1] ^ buffer[64 + 3];
+			xorshft64_state = xorshft64_getState(z1);
+			z2 = xorshft64(xorshft64_state);
+			z3 = xorshft64(xorshft64_state);
+			x = buffer[1] ^ buffer[64 + 0] ^ z2;
+			y = buffer[3] ^ buffer[64 + 2] ^ z3;
+			if ((z1 & 1) == 0 || buffer[64 + 3] != (x ^ y ^ z1))
+			{
+				return 1; // error
+			}
+		}
+		xorshft64_skip(xorshft64_state, 3);
+	}
+	else
+	{
+		x  = buffer[64 + 0] ^ buffer[1];
+		z1 = buffer[64 + 3] ^ x;
+		xorshft64_state = xorshft64_getState(z1);
+		if ((z1 & 1) != 0 || x != xorshft64(xorshft64_state))
+		{
+			x  = buffer[64 + 1] ^ buffer[2];
+			z1 = buffer[64 + 3] ^ x;
+			xorshft64_state = xorshft64_getState(z1);
+			if ((z1 & 1) == 0 || x != xorshft64(xorshft64_state))
+			{
+				return 1; // error
+			}
+		}
+		xorshft64_skip(xorshft64_state, 32);
+	}
+
+	return 0;
+}
+
+int getXorshft64State(SrandomTarget &target, uint64_t &xorshft64_state, uint64_t &z1, int print = 0)
+{
+	uint64_t buffer[64+4];
+
+	if (print)
+	{
+		printf("Get xorshft64() state\n");
+	}
+
+	if (target.read(buffer, sizeof(buffer)) != sizeof(buffer))
+	{
+		return 1;
+	}
+	if (xorshft64StateFromBlocks(buffer, target.version(), xorshft64_state, z1))
+	{
+		return 1;
+	}
+	if (print)
+	{
+		printf("xorshft64_state = 0x%016" PRIx64 "\n", xorshft64_state);
+	}
+
+	return 0;
+}
+
+// From the first 5 blocks of a read and the xorshft64() state before its first update, the
+// xorshft128() state before its first update
+static int xorshft128StateFromBlocks(const uint64_t buffer[256+64], uint64_t xorshft64_state, uint64_t xorshft128_state[2])
+{
+	uint64_t xorshft128_output[2] = {0};
+
+	for (int i = 64, shift = 0; i < 256 + 64; i += 64)
+	{
+		uint64_t x, y, z1, z2, z3;
+
+		z1 = xorshft64(xorshft64_state);
+		z2 = xorshft64(xorshft64_state);
+		z3 = xorshft64(xorshft64_state);
+
+		if ((z1 & 1) == 0)
+		{
+			for (size_t j = 0; j < PRNG_ARRAY_SIZE_NORM - 4; j += 4)
+			{
+				x = buffer[i + j + 2] ^ buffer[i + j + 3 - 64] ^ z2;
+				y = buffer[i + j + 1] ^ buffer[i + j + 2 - 64] ^ z1;
+				if (shift < 64)
+				{
+					xorshft128_output[0] |= (x & 1) << (shift++);
+					xorshft128_output[0] |= (y & 1) << (shift++);
+				}
+				else
+				{
+					xorshft128_output[1] |= (x & 1) << (shift++ - 64);
+					xorshft128_output[1] |= (y & 1) << (shift++ - 64);
+				}
+			}
+		}
+		else
+		{
+			for (size_t j = 0; j < PRNG_ARRAY_SIZE_NORM - 4; j += 4)
+			{
+				x = buffer[i + j    ] ^ buffer[i + j + 1 - 64] ^ z2;
+				y = buffer[i + j + 2] ^ buffer[i + j + 3 - 64] ^ z3;
+				if (shift < 64)
+				{
+					xorshft128_output[0] |= (x & 1) << (shift++);
+					xorshft128_output[0] |= (y & 1) << (shift++);
+				}
+				else
+				{
+					xorshft128_output[1] |= (x & 1) << (shift++ - 64);
+					xorshft128_output[1] |= (y & 1) << (shift++ - 64);
+				}
+			}
+		}
+	}
+
+	return xorshft128_getState(xorshft128_state, xorshft128_output);
+}
+
+int getXorshft128StateNorm(SrandomTarget &target, int &arraysBufferPosition, uint64_t &xorshft64_state, uint64_t xorshft128_state[2], int print = 0)
+{
+	uint64_t buffer[256+64];
+
+	if (print)
+	{
+		printf("\nGet xorshft128() state\n");
+		printf("Getting xorshft128() output...\n");
+	}
+	arraysBufferPosition++;
+	if (target.read(buffer, sizeof(buffer)) != sizeof(buffer))
+	{
+		return 1;
+	}
+
+	if (print)
+	{
+		printf("Recovering state...\n");
+	}
+	if (xorshft128StateFromBlocks(buffer, xorshft64_state, xorshft128_state))
+	{
+		return 1;
+	}
+	xorshft64_skip(xorshft64_state, 18);
+	if (print)
+	{
+		printf("xorshft128_state = 0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", xorshft128_state[0], xorshft128_state[1]);
+	}
+
+	// Incrementing xorshft128_state
+	if (print)
+	{
+		printf("Incrementing recovered state...\n");
+	}
+	xorshft128_jump(xorshft128_state, (256+64+64)/2);
+	if (print)
+	{
+		printf("xorshft128_state = 0x%016" PRIx64 ", 0x%016" PRIx64 "\n", xorshft128_state[0], xorshft128_state[1]);
+	}
+
+	return 0;
+}
+
+int getXorshft128StateUhs(uint64_t z1s[5], uint64_t z2s[5], uint64_t z3s[5], uint64_t buffer[256+64], uint64_t xorshft128_state[2], int print = 0)
+{
+	uint64_t xorshft128_output[2] = {0};
+
+	if (print)
+	{
+		printf("\nGet xorshft128() state\n");
+		printf("Using output...\n");
+	}
+	for (int i = 64, shift = 0; i < 256 + 64; i += 64)
+	{
+		uint64_t x, y, z1, z2, z3;
+
+		z1 = z1s[i / 64];
+		z2 = z2s[i / 64];
+		z3 = z3s[i / 64];
+
+		if ((z1 & 1) == 0)
+		{
+			for (size_t j = 0; j < PRNG_ARRAY_SIZE_NORM - 4; j += 4)
+			{
+				x = buffer[i + j + 2] ^ buffer[i + j + 3 - 64] ^ z2;
+				y = buffer[i + j + 1] ^ buffer[i + j + 2 - 64] ^ z1;
+				if (shift < 64)
+				{
+					xorshft128_output[0] |= (x & 1) << (shift++);
+					xorshft128_output[0] |= (y & 1) << (shift++);
+				}
+				else
+				{
+					xorshft128_output[1] |= (x & 1) << (shift++ - 64);
+					xorshft128_output[1] |= (y & 1) << (shift++ - 64);
+				}
+			}
+		}
+		else
+		{
+			for (size_t j = 0; j < PRNG_ARRAY_SIZE_NORM - 4; j += 4)
+			{
+				x = buffer[i + j    ] ^ buffer[i + j + 1 - 64] ^ z2;
+				y = buffer[i + j + 2] ^ buffer[i + j + 3 - 64] ^ z3;
+				if (shift < 64)
+				{
+					xorshft128_output[0] |= (x & 1) << (shift++);
+					xorshft128_output[0] |= (y & 1) << (shift++);
+				}
+				else
+				{
+					xorshft128_output[1] |= (x & 1) << (shift++ - 64);
+					xorshft128_output[1] |= (y & 1) << (shift++ - 64);
+				}
+			}
+		}
+	}
+
+	if (print)
+	{
+		printf("Recovering state...\n");
+	}
+	if (xorshft128_getState(xorshft128_state, xorshft128_output))
+	{
+		return 1;
+	}
+	if (print)
+	{
+		printf("xorshft128_state = 0x%016" PRIx64 ", 0x%016" PRIx64 "\n\n", xorshft128_state[0], xorshft128_state[1]);
+	}
+
+	// Incrementing xorshft128_state
+	if (print)
+	{
+		printf("Incrementing recovered state...\n");
+	}
+	xorshft128_jump(xorshft128_state, (256+64+64)/2);
+	if (print)
+	{
+		printf("xorshft128_state = 0x%016" PRIx64 ", 0x%016" PRIx64 "\n", xorshft128_state[0], xorshft128_state[1]);
+	}
+
+	return 0;
+}
+
+int makeArraysBufferPositionZero(SrandomTarget &target, int &arraysBufferPosition, uint64_t &xorshft64_state, int print = 0)
+{
+	if (print)
+	{
+		printf("Make arraysBufferPosition = 0\n");
+	}
+
+	for (int i = 0; i < 1021; i++)
+	{
+		uint64_t z1_ = xorshft64(xorshft64_state);
+		uint64_t z1;
+
+		if (getXorshft64State(target, xorshft64_state, z1)) return 1;
+
+		if (z1 != z1_)
+		{
+			arraysBufferPosition = 0;
+			break;
+		}
+	}
+	if (arraysBufferPosition != 0)
+	{
+		return 1; // error
+	}
+	return 0;
+}
+
+static int recoverNorm(CountingTarget &target, SrandomSim &recovered, RecoveryStats *stats, int print)
+{
+	const bool arrayBug             = target.version() == SRANDOM_VERSION_NORM_ARRAY_BUG;
+	uint64_t  &xorshft64_state      = recovered.xorshft64State();
+	uint64_t  *xorshft128_state     = recovered.xorshft128State();
+	int       &arraysBufferPosition = recovered.arraysBufferPosition();
+	PhaseTimer timer(stats, target);
+	uint64_t   z1;
+
+	arraysBufferPosition = -1;
+
+	// Get xorshft64() state
+	if (getXorshft64State(target, xorshft64_state, z1, print)) return 1;
+	timer.next();
+
+	// Make arraysBufferPosition = 0
+	if (makeArraysBufferPositionZero(target, arraysBufferPosition, xorshft64_state, print)) return 1;
+	timer.next();
+
+	// Get xorshft128() state
+	if (getXorshft128StateNorm(target, arraysBufferPosition, xorshft64_state, xorshft128_state, print)) return 1;
+	timer.next();
+
+	// Reset prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM]
+	if (print)
+	{
+		printf("Reseting prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM]...\n");
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		while (++arraysBufferPosition < 1021)
+		{
+			if (target.readSpan(1) == NULL) return 1;
+			recovered.update(0);
+		}
+
+		if (target.readSpan(1) == NULL) return 1;
+		arraysBufferPosition = 0;
+		recovered.update(NUMBER_OF_PRNG_ARRAYS_NORM);
+		recovered.update(0);
+	}
+	timer.next();
+
+	// Get state
+	if (print)
+	{
+		printf("Get prngArrays...\n(I didn't keep track of them so just get them now)\n");
+	}
+
+	// ############################################
+	// #### Start of overlap array bug changes ####
+	// ############################################
+	// Just advance nextbuffer() to known output
+	//
+	// Technically this can fail but because this gives the next loop 269 tries to fill all of the arrays.
+	// But if array indexes 13, 14, 15 then it gets 208, 480, infinite more tries respectively.
+	// fuckit: added a reset
+fuckit:
+	if (arrayBug)
+	{
+		while (arraysBufferPosition++ < 16 * (64 - (NUMBER_OF_PRNG_ARRAYS_NORM + 1)))
+		{
+			if (target.readSpan(1) == NULL) return 1;
+			recovered.update(0);
+		}
+		arraysBufferPosition--;
+	}
+	// ##########################################
+	// #### End of overlap array bug changes ####
+	// ##########################################
+
+	int filledArrays = 0;
+	while (filledArrays != 0xffff)
+	{
+		int index = recovered.nextbuffer();
+		filledArrays |= 1 << index;
+
+		if (target.read(recovered.prngArray(index), 512) != 512) return 1;
+		recovered.update(index);
+		recovered.update(index);
+
+		// ############################################
+		// #### Start of overlap array bug changes ####
+		// ############################################
+		if (arrayBug && arraysBufferPosition == 0 && (filledArrays & 0x8000) == 0)
+		{
+			if (stats != NULL)
+			{
+				stats->fuckitRetries++;
+			}
+			goto fuckit; // 1 in 34,651,867 chance
+		}
+		// ##########################################
+		// #### End of overlap array bug changes ####
+		// ##########################################
+	}
+	timer.next();
+
+	return 0;
+}
+
+// ## Minimal read recovery ##
+//
+// Until the index array is known nothing says which array a read used, so arrays are kept by
+// label (the order they were first seen in) in slots 0-15 of a scratch SrandomSim and a read's
+// array is whichever label its output matches. Labels are mapped to the real indexes at the
+// end.
+//
+// arraysBufferPosition isn't forced to 0. Instead the read where it wraps (and the index array
+// update takes 3 xorshft64() and 32 xorshft128() outputs) is found from which alignment of
+// the generators keeps every array's output matching. Once that's known every read's position
+// is, and each read says which label is at that position. Index array I(n+1) is I(n) shifted
+// down a word xored with known outputs, with every 4th word all known outputs. So each nibble of
+// the current index array is either known or a nibble of I(0) xored with something known, and
+// enough reads pin down all of them. That's reading until about 1008 positions into the index
+// array after the first wrap, since I(0)'s last 3 nibbles aren't used until then.
+
+const int NORM_POSITIONS = 1021;
+const int NORM_NIBBLES   = 64 * 16;
+
+struct IndexWrap
+{
+	uint64_t read;                            // Read that updated the index array (1 based)
+	uint64_t outputs[PRNG_ARRAY_SIZE_NORM];   // update_sarray() of all zeros, what gets xored in
+};
+
+// A nibble of an index array, I(0) nibble var xored with value. var is -1 when it's all known.
+struct IndexNibble
+{
+	int16_t var;
+	uint8_t value;
+};
+
+// One guess at where arraysBufferPosition wraps and what the reads since the guesses started saw
+struct ReadHypothesis
+{
+	SrandomSim        sim;
+	uint64_t          wrapRead;  // 0 while the wrap hasn't happened
+	IndexWrap         wrap;
+	std::vector<int>  labels;    // Of each read since these started
+};
+
+// Steps the generators through the index array update and saves what it xors in
+static void indexArrayUpdate(uint64_t &xorshft64_state, uint64_t xorshft128_state[2], uint64_t read, IndexWrap &wrap)
+{
+	memset(wrap.outputs, 0, sizeof(wrap.outputs));
+	update_sarray(wrap.outputs, xorshft64_state, xorshft128_state);
+	wrap.read = read;
+}
+
+// Whether block goes to the start of next with these generators
+static bool updateMatches(const uint64_t block[64], const uint64_t next[4], uint64_t xorshft64_state, const uint64_t xorshft128State[2])
+{
+	uint64_t array[PRNG_ARRAY_SIZE_NORM] = {0};
+	uint64_t xorshft128_state[2]         = {xorshft128State[0], xorshft128State[1]};
+
+	memcpy(array, block, 64 * sizeof(uint64_t));
+	update_sarray(array, xorshft64_state, xorshft128_state);
+	return memcmp(array, next, 4 * sizeof(uint64_t)) == 0;
+}
+
+// The labels whose arrays start with start, returns how many. Usually one, more when arrays
+// share their first 4 bytes.
+static int matchLabels(SrandomSim &sim, int numLabels, uint32_t start, int labels[NUMBER_OF_PRNG_ARRAYS_NORM])
+{
+	int count = 0;
+
+	for (int i = 0; i < numLabels; i++)
+	{
+		uint32_t arrayStart;
+
+		memcpy(&arrayStart, sim.prngArray(i), sizeof(arrayStart));
+		if (arrayStart == start)
+		{
+			labels[count++] = i;
+		}
+	}
+	return count;
+}
+
+// Steps each hypothesis past a read that started with start. One that matches no array dies.
+// One that matches several is split into one per label, only the true label survives later reads.
+static void followReadHypotheses(std::vector<ReadHypothesis> &hypotheses, int numLabels, uint32_t start)
+{
+	size_t count = hypotheses.size();
+	size_t kept  = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		int labels[NUMBER_OF_PRNG_ARRAYS_NORM];
+		int matches = matchLabels(hypotheses[i].sim, numLabels, start, labels);
+
+		for (int j = 1; j < matches; j++)
+		{
+			hypotheses.push_back(hypotheses[i]);
+			hypotheses.back().sim.update(labels[j]);
+			hypotheses.back().labels.push_back(labels[j]);
+		}
+		if (matches > 0)
+		{
+			hypotheses[i].sim.update(labels[0]);
+			hypotheses[i].labels.push_back(labels[0]);
+			if (kept != i)
+			{
+				hypotheses[kept] = hypotheses[i];
+			}
+			kept++;
+		}
+	}
+	for (size_t i = count; i < hypotheses.size(); i++)
+	{
+		hypotheses[kept++] = hypotheses[i];
+	}
+	hypotheses.erase(hypotheses.begin() + kept, hypotheses.end());
+}
+
+// Follows the index arrays symbolically and solves for them from which label each read saw
+class IndexSolver
+{
+public:
+	IndexSolver() : m_labels(1, -1), m_arrays(1), m_used(0)
+	{
+		for (int i = 0; i < NORM_NIBBLES; i++)
+		{
+			m_arrays[0].nibbles[i].var   = (int16_t) i;
+			m_arrays[0].nibbles[i].value = 0;
+			m_seen[i].label      = -1;
+			m_seen[i].value      = 0;
+		}
+		for (int i = 0; i < NUMBER_OF_PRNG_ARRAYS_NORM; i++)
+		{
+			m_indexOf[i] = -1;
+			m_labelOf[i] = -1;
+		}
+	}
+
+	// Reads are numbered from 1, label -1 for a read that didn't say
+	void addRead(int label) { m_labels.push_back(label); }
+
+	// Once the first wrap is known everything seen so far is used
+	int addWrap(const IndexWrap &wrap)
+	{
+		IndexArray next;
+
+		for (int word = 0; word < 64; word++)
+		{
+			for (int nibble = 0; nibble < 16; nibble++)
+			{
+				uint8_t     value = (uint8_t) ((wrap.outputs[word] >> (nibble * 4)) & 15);
+				IndexNibble to    = {-1, value};
+
+				if (word % 4 != 3)
+				{
+					to = m_arrays.back().nibbles[(word + 1) * 16 + nibble];
+					to.value ^= value;
+				}
+				next.nibbles[word * 16 + nibble] = to;
+			}
+		}
+		m_arrays.push_back(next);
+		m_wrapReads.push_back(wrap.read);
+		return 0;
+	}
+
+	// Uses every read not used yet, returns 1 if they contradict each other
+	int solve()
+	{
+		if (m_wrapReads.empty())
+		{
+			return 0;
+		}
+		for (; m_used + 1 < m_labels.size(); m_used++)
+		{
+			uint64_t read  = m_used + 1;
+			int      label = m_labels[read];
+			int64_t  array;
+			int64_t  position;
+
+			if (read <= m_wrapReads[0])
+			{
+				array    = 0;
+				position = NORM_POSITIONS - 1 - (int64_t) (m_wrapReads[0] - read);
+			}
+			else
+			{
+				array    = 1 + (int64_t) (read - m_wrapReads[0] - 1) / NORM_POSITIONS;
+				position = (int64_t) (read - m_wrapReads[0] - 1) % NORM_POSITIONS;
+			}
+			if (label < 0 || position < 0 || array >= (int64_t) m_arrays.size())
+			{
+				continue;
+			}
+
+			const IndexNibble &nibble = m_arrays[(size_t) array].nibbles[position];
+
+			if (nibble.var < 0)
+			{
+				if (setIndex(label, nibble.value))
+				{
+					return 1;
+				}
+			}
+			else if (m_seen[nibble.var].label < 0)
+			{
+				m_seen[nibble.var].label = label;
+				m_seen[nibble.var].value = nibble.value;
+			}
+		}
+		return 0;
+	}
+
+	// Whether every nibble of the current index array can be worked out
+	bool done()
+	{
+		int known = 0;
+
+		if (m_wrapReads.empty())
+		{
+			return false;
+		}
+		for (int i = 0; i < NUMBER_OF_PRNG_ARRAYS_NORM; i++)
+		{
+			known += m_indexOf[i] >= 0;
+		}
+		if (known == NUMBER_OF_PRNG_ARRAYS_NORM - 1)
+		{
+			// It's a permutation, the last one is whatever's left
+			int label = 0;
+			int index = 0;
+
+			while (m_indexOf[label] >= 0) label++;
+			while (m_labelOf[index] >= 0) index++;
+			setIndex(label, index);
+			known++;
+		}
+		if (known < NUMBER_OF_PRNG_ARRAYS_NORM)
+		{
+			return false;
+		}
+		for (int i = 0; i < NORM_NIBBLES; i++)
+		{
+			const IndexNibble &nibble = m_arrays.back().nibbles[i];
+
+			if (nibble.var >= 0 && m_seen[nibble.var].label < 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	int indexOf(int label) const { return m_indexOf[label]; }
+
+	// The current index array, once done()
+	void indexArray(uint64_t *words) const
+	{
+		for (int word = 0; word < 64; word++)
+		{
+			words[word] = 0;
+			for (int nibble = 0; nibble < 16; nibble++)
+			{
+				const IndexNibble &from  = m_arrays.back().nibbles[word * 16 + nibble];
+				uint64_t           value = from.value;
+
+				if (from.var >= 0)
+				{
+					value ^= (uint64_t) (m_indexOf[m_seen[from.var].label] ^ m_seen[from.var].value);
+				}
+				words[word] |= value << (nibble * 4);
+			}
+		}
+	}
+
+private:
+	struct IndexArray
+	{
+		IndexNibble nibbles[NORM_NIBBLES];
+	};
+
+	struct Seen
+	{
+		int     label;
+		uint8_t value;
+	};
+
+	int setIndex(int label, int index)
+	{
+		if (m_indexOf[label] == index && m_labelOf[index] == label)
+		{
+			return 0;
+		}
+		if (m_indexOf[label] >= 0 || m_labelOf[index] >= 0)
+		{
+			return 1;
+		}
+		m_indexOf[label] = index;
+		m_labelOf[index] = label;
+		return 0;
+	}
+
+	std::vector<int>        m_labels;
+	std::vector<IndexArray> m_arrays;   // I(0), I(1), ...
+	std::vector<uint64_t>   m_wrapReads;
+	Seen                    m_seen[NORM_NIBBLES];
+	int                     m_indexOf[NUMBER_OF_PRNG_ARRAYS_NORM]; // Of each label
+	int                     m_labelOf[NUMBER_OF_PRNG_ARRAYS_NORM];
+	size_t                  m_used;    // Reads given to solve() so far
+};
+
+// The generators and arrays with what the index arrays are solved from them, split like
+// ReadHypothesis when a read matches more than one array
+struct IndexBranch
+{
+	SrandomSim  sim;
+	IndexSolver solver;
+};
+
+static int recoverNormMinReads(CountingTarget &target, SrandomSim &recovered, RecoveryStats *stats, int print)
+{
+	SrandomSim                  scratch(SRANDOM_VERSION_NORM);
+	IndexSolver                 solver;
+	std::vector<ReadHypothesis> hypotheses;
+	PhaseTimer                  timer(stats, target);
+	uint64_t                    buffer[256+64];
+	uint64_t                    read      = 1;
+	uint64_t                    firstWrap = 0;
+	int                         numLabels = 1;
+	int                         position;
+	uint64_t                    z1;
+
+	// Both generators from the first 5 blocks of one read, and its array from the last
+	if (print)
+	{
+		printf("Get xorshft64() and xorshft128() states from one %zu byte read\n", sizeof(buffer));
+	}
+	if (target.read(buffer, sizeof(buffer)) != sizeof(buffer))
+	{
+		return 1;
+	}
+	if (xorshft64StateFromBlocks(buffer, SRANDOM_VERSION_NORM, scratch.xorshft64State(), z1))
+	{
+		return 1;
+	}
+	xorshft64_skip(scratch.xorshft64State(), -6);
+	timer.to(RECOVERY_PHASE_XORSHFT128);
+	if (xorshft128StateFromBlocks(buffer, scratch.xorshft64State(), scratch.xorshft128State()))
+	{
+		return 1;
+	}
+	xorshft64_skip(scratch.xorshft64State(), 12);
+	xorshft128_jump(scratch.xorshft128State(), 128);
+	memcpy(scratch.prngArray(0), buffer + 256, 64 * sizeof(uint64_t));
+	scratch.update(0);
+	scratch.update(0);
+	solver.addRead(0);
+	if (print)
+	{
+		printf("xorshft64_state = 0x%016" PRIx64 ", xorshft128_state = 0x%016" PRIx64 ", 0x%016" PRIx64 "\n",
+			scratch.xorshft64State(), scratch.xorshft128State()[0], scratch.xorshft128State()[1]);
+	}
+
+	// Every array from 544 byte reads. The start of the second block shows whether the index
+	// array was updated first.
+	timer.to(RECOVERY_PHASE_ARRAYS);
+	if (print)
+	{
+		printf("Get every prngArrays[i] by its content...\n");
+	}
+	while (numLabels < NUMBER_OF_PRNG_ARRAYS_NORM)
+	{
+		int label;
+
+		read++;
+		if (target.read(buffer, (64 + 4) * sizeof(uint64_t)) != (64 + 4) * sizeof(uint64_t))
+		{
+			return 1;
+		}
+		if (!updateMatches(buffer, buffer + 64, scratch.xorshft64State(), scratch.xorshft128State()))
+		{
+			IndexWrap wrap;
+
+			indexArrayUpdate(scratch.xorshft64State(), scratch.xorshft128State(), read, wrap);
+			if (firstWrap != 0 || !updateMatches(buffer, buffer + 64, scratch.xorshft64State(), scratch.xorshft128State()))
+			{
+				return 1;
+			}
+			firstWrap = read;
+			solver.addWrap(wrap);
+		}
+		for (label = 0; label < numLabels && memcmp(scratch.prngArray(label), buffer, 64 * sizeof(uint64_t)) != 0; label++);
+		if (label == numLabels)
+		{
+			memcpy(scratch.prngArray(numLabels++), buffer, 64 * sizeof(uint64_t));
+		}
+		solver.addRead(label);
+		scratch.update(label);
+		scratch.update(label);
+	}
+
+	// Where arraysBufferPosition wraps, if it hasn't yet. Each read could be it, so each gets
+	// a hypothesis with the generators stepped past the index array update. A hypothesis dies
+	// when a read matches none of its arrays, the true one never does. A read that matches
+	// more than one array splits it.
+	timer.to(RECOVERY_PHASE_POSITION);
+	if (firstWrap == 0)
+	{
+		std::vector<ReadHypothesis> noWrap(1, ReadHypothesis{scratch, 0, IndexWrap(), std::vector<int>()});
+
+		if (print)
+		{
+			printf("Find where arraysBufferPosition wraps with 4 byte reads...\n");
+		}
+		while (!noWrap.empty() || hypotheses.size() != 1)
+		{
+			uint32_t start;
+
+			read++;
+			// The wrap can be no later than this
+			for (size_t i = 0; i < noWrap.size(); i++)
+			{
+				hypotheses.push_back(noWrap[i]);
+				hypotheses.back().wrapRead = read;
+				indexArrayUpdate(hypotheses.back().sim.xorshft64State(), hypotheses.back().sim.xorshft128State(), read, hypotheses.back().wrap);
+			}
+			if (read == NORM_POSITIONS + 1)
+			{
+				noWrap.clear();
+			}
+			if (stats != NULL && hypotheses.size() + noWrap.size() > stats->maxHypotheses)
+			{
+				stats->maxHypotheses = hypotheses.size() + noWrap.size();
+			}
+
+			if (target.read(&start, sizeof(start)) != sizeof(start))
+			{
+				return 1;
+			}
+			followReadHypotheses(noWrap, numLabels, start);
+			followReadHypotheses(hypotheses, numLabels, start);
+			if (noWrap.empty() && hypotheses.empty())
+			{
+				return 1;
+			}
+		}
+
+		firstWrap = hypotheses[0].wrapRead;
+		scratch   = hypotheses[0].sim;
+		for (size_t i = 0; i < hypotheses[0].labels.size(); i++)
+		{
+			solver.addRead(hypotheses[0].labels[i]);
+		}
+		solver.addWrap(hypotheses[0].wrap);
+	}
+	if (read - firstWrap >= NORM_POSITIONS)
+	{
+		return 1;
+	}
+	position = (int) (read - firstWrap);
+	if (print)
+	{
+		printf("arraysBufferPosition wrapped on read %" PRIu64 "\n", firstWrap);
+	}
+
+	// 4 byte reads at known positions until the index array is known. A branch dies when a read
+	// matches none of its arrays or contradicts its index arrays, a read that matches more than
+	// one array splits it. Done once one branch is left and it's solved.
+	timer.to(RECOVERY_PHASE_INDEX_ARRAY);
+	if (print)
+	{
+		printf("Solve for prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM] with 4 byte reads...\n");
+	}
+	if (solver.solve())
+	{
+		return 1;
+	}
+
+	std::vector<IndexBranch> branches(1, IndexBranch{scratch, solver});
+
+	while (branches.size() != 1 || !branches[0].solver.done())
+	{
+		uint32_t start;
+		size_t   count;
+		size_t   kept = 0;
+
+		read++;
+		if (++position >= NORM_POSITIONS)
+		{
+			for (size_t i = 0; i < branches.size(); i++)
+			{
+				IndexWrap wrap;
+
+				indexArrayUpdate(branches[i].sim.xorshft64State(), branches[i].sim.xorshft128State(), read, wrap);
+				branches[i].solver.addWrap(wrap);
+			}
+			position = 0;
+		}
+		if (target.read(&start, sizeof(start)) != sizeof(start))
+		{
+			return 1;
+		}
+
+		count = branches.size();
+		for (size_t i = 0; i < count; i++)
+		{
+			int labels[NUMBER_OF_PRNG_ARRAYS_NORM];
+			int matches = matchLabels(branches[i].sim, numLabels, start, labels);
+
+			for (int j = 1; j < matches; j++)
+			{
+				branches.push_back(branches[i]);
+				branches.back().sim.update(labels[j]);
+				branches.back().solver.addRead(labels[j]);
+				if (branches.back().solver.solve())
+				{
+					branches.pop_back();
+				}
+			}
+			if (matches > 0)
+			{
+				branches[i].sim.update(labels[0]);
+				branches[i].solver.addRead(labels[0]);
+				if (branches[i].solver.solve() == 0)
+				{
+					if (kept != i)
+					{
+						branches[kept] = branches[i];
+					}
+					kept++;
+				}
+			}
+		}
+		for (size_t i = count; i < branches.size(); i++)
+		{
+			branches[kept++] = branches[i];
+		}
+		branches.erase(branches.begin() + kept, branches.end());
+		if (branches.empty())
+		{
+			return 1;
+		}
+	}
+	scratch = branches[0].sim;
+	solver  = branches[0].solver;
+	timer.to(RECOVERY_PHASES);
+
+	// Labels to indexes
+	for (int i = 0; i < NUMBER_OF_PRNG_ARRAYS_NORM; i++)
+	{
+		memcpy(recovered.prngArray(solver.indexOf(i)), scratch.prngArray(i), PRNG_ARRAY_SIZE_NORM * sizeof(uint64_t));
+	}
+	memset(recovered.prngArray(NUMBER_OF_PRNG_ARRAYS_NORM), 0, PRNG_ARRAY_SIZE_NORM * sizeof(uint64_t));
+	solver.indexArray(recovered.prngArray(NUMBER_OF_PRNG_ARRAYS_NORM));
+	recovered.xorshft64State()       = scratch.xorshft64State();
+	recovered.xorshft128State()[0]   = scratch.xorshft128State()[0];
+	recovered.xorshft128State()[1]   = scratch.xorshft128State()[1];
+	recovered.arraysBufferPosition() = position;
+	recovered.workThreadIteration()  = 0;
+	if (print)
+	{
+		printf("Done in %" PRIu64 " reads, %" PRIu64 " bytes\n", target.reads(), target.bytes());
+	}
+
+	return 0;
+}
+
+int recoverSrandom(SrandomTarget &target, SrandomSim &recovered, RecoveryStats *stats, int print, RecoveryMode mode)
+{
+	CountingTarget counted(target);
+	int            ret = 1;
+
+	if (stats != NULL)
+	{
+		*stats = RecoveryStats();
+	}
+	if (recovered.version() != target.version())
+	{
+		fprintf(stderr, "Error recovered version %d doesn't match target version %d\n", recovered.version(), target.version());
+		return 1;
+	}
+
+	switch (target.version())
+	{
+		case SRANDOM_VERSION_NORM_ARRAY_BUG:
+			ret = recoverNorm(counted, recovered, stats, print);
+			break;
+
+		case SRANDOM_VERSION_NORM:
+			if (mode == RECOVERY_MODE_MIN_READS)
+			{
+				ret = recoverNormMinReads(counted, recovered, stats, print);
+			}
+			else
+			{
+				ret = recoverNorm(counted, recovered, stats, print);
+			}
+			break;
+
+		default:
+			fprintf(stderr, "Error version %d isn't done\n", target.version());
+			break;
+	}
+
+	if (stats != NULL)
+	{
+		stats->reads = counted.reads();
+		stats->bytes = counted.bytes();
+	}
+	return ret;
+}
+
+const char *recoveryPhaseName(int phase)
+{
+	static const char *names[RECOVERY_PHASES] = {"xorshft64", "position", "xorshft128", "index array", "arrays"};
+
+	if (phase < 0 || phase >= RECOVERY_PHASES)
+	{
+		return "unknown";
+	}
+	return names[phase];
+}
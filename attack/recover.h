@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "srandom.h"
+
+// Anything that can be read like /dev/srandom
+class SrandomTarget
+{
+public:
+	virtual ~SrandomTarget() {}
+
+	virtual size_t read(void *buffer, size_t bufferSize) = 0;
+	virtual int    version() const = 0;
+
+	// Reads without a copy where the target can (e.g. a mapped capture), otherwise into a
+	// scratch buffer. The data is good until the next read. Returns NULL on error.
+	virtual const uint8_t *readSpan(size_t bufferSize);
+
+private:
+	std::vector<uint8_t> m_scratch;
+};
+
+// A simulated device as a target
+class SimTarget : public SrandomTarget
+{
+public:
+	SimTarget(SrandomSim &sim) : m_sim(sim) {}
+
+	size_t read(void *buffer, size_t bufferSize) { return m_sim.read(buffer, bufferSize); }
+	int    version() const                       { return m_sim.version(); }
+
+private:
+	SrandomSim &m_sim;
+};
+
+enum RecoveryPhase
+{
+	RECOVERY_PHASE_XORSHFT64 = 0, // xorshft64 state from the first 544 bytes
+	RECOVERY_PHASE_POSITION,      // Reading until arraysBufferPosition wraps to 0
+	RECOVERY_PHASE_XORSHFT128,    // xorshft128 state from 2560 bytes
+	RECOVERY_PHASE_INDEX_ARRAY,   // Cycling until prngArrays[NUMBER_OF_PRNG_ARRAYS_NORM] is known
+	RECOVERY_PHASE_ARRAYS,        // Reading every prngArrays[i]
+	RECOVERY_PHASES
+};
+
+enum RecoveryMode
+{
+	// Forces arraysBufferPosition to 0 with 544 byte reads, then waits out 4 index array
+	// updates with 1 byte reads
+	RECOVERY_MODE_STANDARD = 0,
+
+	// Gets both generators from one read and every array from 544 byte reads, then follows
+	// each hypothesis of where arraysBufferPosition wraps with 4 byte reads, telling arrays
+	// apart by their first 4 bytes, and solves for the index array from which array each read
+	// used. Only SRANDOM_VERSION_NORM, the array bug's arrays overlap so they can't be told
+	// apart by content and that version always uses the standard recovery.
+	RECOVERY_MODE_MIN_READS
+};
+
+struct RecoveryStats
+{
+	uint64_t reads;                         // Reads done on the target
+	uint64_t bytes;                         // Bytes read from the target
+	uint64_t fuckitRetries;                 // Array bug restarts of the arrays phase
+	uint64_t maxHypotheses;                 // Most wrap hypotheses alive at once (min reads)
+	double   phaseSeconds[RECOVERY_PHASES];
+	uint64_t phaseReads  [RECOVERY_PHASES];
+	uint64_t phaseBytes  [RECOVERY_PHASES];
+
+	// Only with SRANDOM_INSTRUMENT (see instrument.h), otherwise 0
+	double   phaseCpuSeconds  [RECOVERY_PHASES];
+	uint64_t phaseSrandomReads[RECOVERY_PHASES]; // srandom_read() calls on this thread
+	uint64_t phaseSrandomBytes[RECOVERY_PHASES];
+	uint64_t phaseUpdates     [RECOVERY_PHASES]; // update_sarray() calls, target's and attack's
+};
+
+// Recovers the full state of target into recovered, leaving both at the same point in the
+// stream. Only SRANDOM_VERSION_NORM_ARRAY_BUG and SRANDOM_VERSION_NORM are done. print shows
+// the work. Returns 0 on success, otherwise 1.
+int recoverSrandom(SrandomTarget &target, SrandomSim &recovered, RecoveryStats *stats = NULL, int print = 0, RecoveryMode mode = RECOVERY_MODE_STANDARD);
+
+const char *recoveryPhaseName(int phase);
@@ -0,0 +1,532 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include "resync.h"
+#include "cpu.h"
+#include "xorshft.h"
+
+#define NSEC_PER_SEC UINT64_C(1000000000)
+
+// work_thread() iterations, see SrandomSim::workThreadStep()
+#define ITERATION_SEED_S0 (NUMBER_OF_PRNG_ARRAYS_NORM + 1)
+#define ITERATION_SEED_S1 (NUMBER_OF_PRNG_ARRAYS_NORM + 2)
+#define ITERATION_SEED_X  (NUMBER_OF_PRNG_ARRAYS_NORM + 3)
+#define ITERATIONS        (NUMBER_OF_PRNG_ARRAYS_NORM + 4) // That do something, the next starts over
+
+// tv_nsec tried at once, lane i of group g is 32 * g + i. 2^30 > 10^9 so a tv_nsec fits in 30
+// bits and there are 2^25 groups.
+#define LANES        32
+#define LANE_BITS    5
+#define NSEC_BITS    30
+#define CHUNK_GROUPS (1 << 15) // Per job
+
+// The read's first block and the first 4 words of the second
+#define MIN_READ_SIZE (512 + 4 * sizeof(uint64_t))
+
+// The xorshft128() output in the second block's first round is a + b, a being state[1] before
+// it and b after. Both are linear in tv_nsec.
+struct ResyncImages
+{
+	uint64_t base[2];                           // tv_nsec 0
+	uint64_t bits[NSEC_BITS][2];
+	uint64_t carries[NSEC_BITS - LANE_BITS][2]; // Group g to g + 1 when it has t trailing ones
+};
+
+struct ResyncLanes
+{
+	uint64_t a[LANES];
+	uint64_t b[LANES];
+};
+
+// seed_PRND_s0() or seed_PRND_s1() from the state before the read, then steps128 outputs before
+// the second block's update_sarray()
+static void makeImages(ResyncImages &images, const uint64_t xorshft128_state[2], int word, int64_t steps128)
+{
+	uint64_t state[2] = {xorshft128_state[0], xorshft128_state[1]};
+
+	state[word] <<= word == 0 ? 31 : 24;
+	xorshft128_jump(state, steps128);
+	images.base[0] = state[1];
+	xorshft128(state);
+	images.base[1] = state[1];
+	for (int bit = 0; bit < NSEC_BITS; bit++)
+	{
+		state[0]    = 0;
+		state[1]    = 0;
+		state[word] = UINT64_C(1) << bit;
+		xorshft128_jump(state, steps128);
+		images.bits[bit][0] = state[1];
+		xorshft128(state);
+		images.bits[bit][1] = state[1];
+	}
+	for (int t = 0; t < NSEC_BITS - LANE_BITS; t++)
+	{
+		images.carries[t][0] = 0;
+		images.carries[t][1] = 0;
+		for (int bit = LANE_BITS; bit <= LANE_BITS + t; bit++)
+		{
+			images.carries[t][0] ^= images.bits[bit][0];
+			images.carries[t][1] ^= images.bits[bit][1];
+		}
+	}
+}
+
+static void startLanes(ResyncLanes &lanes, const ResyncImages &images, uint64_t group)
+{
+	for (int lane = 0; lane < LANES; lane++)
+	{
+		uint64_t nsec = group * LANES + lane;
+
+		lanes.a[lane] = images.base[0];
+		lanes.b[lane] = images.base[1];
+		for (int bit = 0; bit < NSEC_BITS; bit++)
+		{
+			if ((nsec >> bit) & 1)
+			{
+				lanes.a[lane] ^= images.bits[bit][0];
+				lanes.b[lane] ^= images.bits[bit][1];
+			}
+		}
+	}
+}
+
+static int trailingOnes(uint64_t x)
+{
+	int count = 0;
+
+	while (x & 1)
+	{
+		x >>= 1;
+		count++;
+	}
+	return count;
+}
+
+// Tries count groups from group up, stopping after one that hits. hits gets the lanes that hit,
+// lanes and group are left at the next one. Returns how many were tried.
+typedef uint64_t (*ScanFunc)(ResyncLanes &lanes, const ResyncImages &images, uint64_t &group, uint64_t count, uint64_t target, uint32_t &hits);
+
+// ## Scalar ##
+
+static uint64_t scanScalar(ResyncLanes &lanes, const ResyncImages &images, uint64_t &group, uint64_t count, uint64_t target, uint32_t &hits)
+{
+	uint64_t i = 0;
+
+	hits = 0;
+	while (i < count && hits == 0)
+	{
+		const uint64_t *carry = images.carries[trailingOnes(group)];
+
+		for (int lane = 0; lane < LANES; lane++)
+		{
+			if (lanes.a[lane] + lanes.b[lane] == target)
+			{
+				hits |= 1u << lane;
+			}
+			lanes.a[lane] ^= carry[0];
+			lanes.b[lane] ^= carry[1];
+		}
+		group++;
+		i++;
+	}
+	return i;
+}
+
+#ifdef CPU_X86
+
+// ## AVX2 ##
+
+CPU_TARGET("avx2")
+static uint64_t scanAvx2(ResyncLanes &lanes, const ResyncImages &images, uint64_t &group, uint64_t count, uint64_t target, uint32_t &hits)
+{
+	const int     VECTORS = LANES / 4;
+	const __m256i goal    = _mm256_set1_epi64x((long long) target);
+	__m256i       a[VECTORS];
+	__m256i       b[VECTORS];
+	uint64_t      i       = 0;
+
+	for (int v = 0; v < VECTORS; v++)
+	{
+		a[v] = _mm256_loadu_si256((const __m256i*) (lanes.a + 4 * v));
+		b[v] = _mm256_loadu_si256((const __m256i*) (lanes.b + 4 * v));
+	}
+	hits = 0;
+	while (i < count && hits == 0)
+	{
+		const uint64_t *carry  = images.carries[trailingOnes(group)];
+		const __m256i   carryA = _mm256_set1_epi64x((long long) carry[0]);
+		const __m256i   carryB = _mm256_set1_epi64x((long long) carry[1]);
+
+		for (int v = 0; v < VECTORS; v++)
+		{
+			__m256i hit = _mm256_cmpeq_epi64(_mm256_add_epi64(a[v], b[v]), goal);
+
+			hits |= (uint32_t) _mm256_movemask_pd(_mm256_castsi256_pd(hit)) << (4 * v);
+			a[v]  = _mm256_xor_si256(a[v], carryA);
+			b[v]  = _mm256_xor_si256(b[v], carryB);
+		}
+		group++;
+		i++;
+	}
+	for (int v = 0; v < VECTORS; v++)
+	{
+		_mm256_storeu_si256((__m256i*) (lanes.a + 4 * v), a[v]);
+		_mm256_storeu_si256((__m256i*) (lanes.b + 4 * v), b[v]);
+	}
+	return i;
+}
+
+// ## AVX-512 ##
+
+CPU_TARGET("avx512f")
+static uint64_t scanAvx512(ResyncLanes &lanes, const ResyncImages &images, uint64_t &group, uint64_t count, uint64_t target, uint32_t &hits)
+{
+	const int     VECTORS = LANES / 8;
+	const __m512i goal    = _mm512_set1_epi64((long long) target);
+	__m512i       a[VECTORS];
+	__m512i       b[VECTORS];
+	uint64_t      i       = 0;
+
+	for (int v = 0; v < VECTORS; v++)
+	{
+		a[v] = _mm512_loadu_si512(lanes.a + 8 * v);
+		b[v] = _mm512_loadu_si512(lanes.b + 8 * v);
+	}
+	hits = 0;
+	while (i < count && hits == 0)
+	{
+		const uint64_t *carry  = images.carries[trailingOnes(group)];
+		const __m512i   carryA = _mm512_set1_epi64((long long) carry[0]);
+		const __m512i   carryB = _mm512_set1_epi64((long long) carry[1]);
+
+		for (int v = 0; v < VECTORS; v++)
+		{
+			hits |= (uint32_t) _mm512_cmpeq_epi64_mask(_mm512_add_epi64(a[v], b[v]), goal) << (8 * v);
+			a[v]  = _mm512_xor_si512(a[v], carryA);
+			b[v]  = _mm512_xor_si512(b[v], carryB);
+		}
+		group++;
+		i++;
+	}
+	for (int v = 0; v < VECTORS; v++)
+	{
+		_mm512_storeu_si512(lanes.a + 8 * v, a[v]);
+		_mm512_storeu_si512(lanes.b + 8 * v, b[v]);
+	}
+	return i;
+}
+
+#endif
+
+// ## Dispatch ##
+// No SSE4.2 version, two lanes isn't faster than scalar
+
+static const ScanFunc SCAN[] =
+{
+	scanScalar,
+#ifdef CPU_X86
+	NULL,
+	scanAvx2,
+	scanAvx512,
+#endif
+};
+
+static int selectLevel()
+{
+	int level = cpu_level();
+
+	if (level >= (int) (sizeof(SCAN) / sizeof(*SCAN)))
+	{
+		level = (int) (sizeof(SCAN) / sizeof(*SCAN)) - 1;
+	}
+	if (level == CPU_LEVEL_SSE42)
+	{
+		level = CPU_LEVEL_SCALAR;
+	}
+
+#ifndef NDEBUG
+	// Random state with a hit planted part way in
+	const uint64_t COUNT = 29;
+	ResyncImages   images;
+	ResyncLanes    lanes[2];
+	uint64_t       xorshft128_state[2];
+	uint64_t       group[2];
+	uint64_t       done[2];
+	uint32_t       hits[2];
+	uint64_t       target;
+
+	xorshft128_state[0] = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+	xorshft128_state[1] = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+	makeImages(images, xorshft128_state, 1, 0);
+	startLanes(lanes[0], images, 1000 + 17);
+	target = lanes[0].a[13] + lanes[0].b[13];
+	for (int i = CPU_LEVEL_AVX2; i <= level; i++)
+	{
+		for (int j = 0; j < 2; j++)
+		{
+			startLanes(lanes[j], images, 1000);
+			group[j] = 1000;
+			done[j]  = (j == 0 ? scanScalar : SCAN[i])(lanes[j], images, group[j], COUNT, target, hits[j]);
+		}
+		if (done[0] != done[1] || group[0] != group[1] || hits[0] != hits[1] || memcmp(&lanes[0], &lanes[1], sizeof(lanes[0])) != 0)
+		{
+			cpu_checkFailed("resyncScan", i);
+		}
+	}
+#endif
+
+	return level;
+}
+
+static int scanLevel()
+{
+	static const int level = selectLevel();
+
+	return level;
+}
+
+const char *resyncSrandomIsa()
+{
+	return cpu_levelName(scanLevel());
+}
+
+// ## Resync ##
+
+// Does work_thread() iteration with nsec on a copy of before and reads from it. Most wrong
+// guesses are already off in the second block, so that's checked before the whole read.
+static bool explains(SrandomSim &before, int iteration, uint64_t nsec, const uint8_t *read, size_t size, SrandomSim &after)
+{
+	SrandomSim           sim(before);
+	std::vector<uint8_t> out(size);
+
+	sim.workThreadIteration() = iteration;
+	sim.workThreadStep(nsec);
+	{
+		SrandomSim prefix(sim);
+
+		prefix.read(out.data(), MIN_READ_SIZE);
+		if (memcmp(out.data(), read, MIN_READ_SIZE) != 0)
+		{
+			return false;
+		}
+	}
+	sim.read(out.data(), size);
+	if (memcmp(out.data(), read, size) != 0)
+	{
+		return false;
+	}
+	after = sim;
+	return true;
+}
+
+// Where the read's nextbuffer() wraps, its update of the index array comes before the second
+// block's update_sarray()
+static void stepsBeforeUpdate(SrandomSim &before, int64_t &steps64, int64_t &steps128)
+{
+	const bool wraps = before.arraysBufferPosition() + 1 >= 1021;
+
+	steps64  = wraps ?  3 : 0;
+	steps128 = wraps ? 32 : 0;
+}
+
+// The first block is the array as it was, so with the second block's first round and both
+// generators all but one unknown drops out:
+//   z1 even: w0 = p1 ^ x ^ y,  w1 = p2 ^ y ^ z1, w2 = p3 ^ x ^ z2, w3 = x ^ y ^ z3
+//   z1 odd:  w0 = p1 ^ x ^ z2, w1 = p2 ^ x ^ y,  w2 = p3 ^ y ^ z3, w3 = x ^ y ^ z1
+static void readWords(const uint8_t *read, uint64_t p[4], uint64_t w[4])
+{
+	memcpy(p, read,       4 * sizeof(uint64_t));
+	memcpy(w, read + 512, 4 * sizeof(uint64_t));
+}
+
+// seed_PRND_x(): x is undone from z1 for both of its low bits
+static bool solveSeedX(SrandomSim &before, const uint8_t *read, size_t size, SrandomSim &after, uint64_t &nsec)
+{
+	uint64_t    state[2] = {before.xorshft128State()[0], before.xorshft128State()[1]};
+	int64_t     steps64;
+	int64_t     steps128;
+	uint64_t    p[4];
+	uint64_t    w[4];
+	uint64_t    x;
+	uint64_t    y;
+
+	stepsBeforeUpdate(before, steps64, steps128);
+	readWords(read, p, w);
+	xorshft128_jump(state, steps128);
+	x = xorshft128(state);
+	y = xorshft128(state);
+	for (int z1Odd = 0; z1Odd < 2; z1Odd++)
+	{
+		uint64_t z1              = z1Odd ? w[3] ^ x ^ y : w[1] ^ p[2] ^ y;
+		uint64_t xorshft64_state = xorshft64_getState(z1);
+
+		if ((int) (z1 & 1) != z1Odd)
+		{
+			continue;
+		}
+		xorshft64_skip(xorshft64_state, -(steps64 + 1));
+		nsec = xorshft64_state ^ (before.xorshft64State() << 32);
+		if (nsec < NSEC_PER_SEC && explains(before, ITERATION_SEED_X, nsec, read, size, after))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// seed_PRND_s0() or seed_PRND_s1(): x and so the z are known, which leaves the first xorshft128()
+// output to find over every tv_nsec
+static bool searchSeedS(SrandomSim &before, int word, const uint8_t *read, size_t size, ThreadPool *pool, SrandomSim &after, uint64_t &nsec, uint64_t &candidates)
+{
+	static const ScanFunc scan = SCAN[scanLevel()];
+
+	const uint64_t        groups          = (NSEC_PER_SEC + LANES - 1) / LANES;
+	const size_t          chunks          = (size_t) ((groups + CHUNK_GROUPS - 1) / CHUNK_GROUPS);
+	uint64_t              xorshft64_state = before.xorshft64State();
+	int64_t               steps64;
+	int64_t               steps128;
+	uint64_t              p[4];
+	uint64_t              w[4];
+	uint64_t              z1;
+	uint64_t              z2;
+	uint64_t              target;
+	ResyncImages          images;
+	std::atomic<bool>     found(false);
+	std::atomic<uint64_t> tried(0);
+	std::mutex            mutex;
+
+	stepsBeforeUpdate(before, steps64, steps128);
+	readWords(read, p, w);
+	xorshft64_skip(xorshft64_state, steps64);
+	z1     = xorshft64(xorshft64_state);
+	z2     = xorshft64(xorshft64_state);
+	target = (z1 & 1) == 0 ? w[2] ^ p[3] ^ z2 : w[0] ^ p[1] ^ z2;
+	makeImages(images, before.xorshft128State(), word, steps128);
+
+	auto job = [&](size_t chunk, int)
+	{
+		ResyncLanes lanes;
+		uint64_t    group = chunk * CHUNK_GROUPS;
+		uint64_t    end   = std::min<uint64_t>(group + CHUNK_GROUPS, groups);
+
+		if (found)
+		{
+			return;
+		}
+		startLanes(lanes, images, group);
+		while (group < end && !found)
+		{
+			uint32_t hits;
+
+			tried += scan(lanes, images, group, end - group, target, hits) * LANES;
+			for (int lane = 0; lane < LANES && hits != 0; lane++)
+			{
+				SrandomSim candidate(before.version());
+				uint64_t   n = (group - 1) * LANES + lane;
+
+				if (((hits >> lane) & 1) == 0 || n >= NSEC_PER_SEC || !explains(before, word == 0 ? ITERATION_SEED_S0 : ITERATION_SEED_S1, n, read, size, candidate))
+				{
+					continue;
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+
+				if (!found)
+				{
+					after = candidate;
+					nsec  = n;
+					found = true;
+				}
+			}
+		}
+	};
+
+	if (pool != NULL)
+	{
+		pool->run(chunks, job);
+	}
+	else
+	{
+		for (size_t chunk = 0; chunk < chunks && !found; chunk++)
+		{
+			job(chunk, 0);
+		}
+	}
+	candidates += tried;
+	return found;
+}
+
+int resyncSrandom(SrandomSim &state, const void *read, size_t size, ThreadPool *pool, ResyncResult *result)
+{
+	const uint8_t *bytes      = (const uint8_t*) read;
+	int            due        = state.workThreadIteration() % ITERATIONS;
+	int            iteration  = -1;
+	bool           found      = false;
+	uint64_t       nsec       = 0;
+	uint64_t       candidates = 0;
+	SrandomSim     after(state.version());
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if ((state.version() == SRANDOM_VERSION_NORM_ARRAY_BUG || state.version() == SRANDOM_VERSION_NORM) && size >= MIN_READ_SIZE)
+	{
+		// The ones that cost next to nothing first, from the one that's due
+		for (int i = 0; i < ITERATIONS && !found; i++)
+		{
+			int guess = (due + i) % ITERATIONS;
+
+			if (guess <= NUMBER_OF_PRNG_ARRAYS_NORM)
+			{
+				found = explains(state, guess, 0, bytes, size, after);
+			}
+			else if (guess == ITERATION_SEED_X)
+			{
+				found = solveSeedX(state, bytes, size, after, nsec);
+			}
+			iteration = found ? guess : -1;
+		}
+		if (!found)
+		{
+			int first = due == ITERATION_SEED_S1 ? ITERATION_SEED_S1 : ITERATION_SEED_S0;
+
+			for (int i = 0; i < 2 && !found; i++)
+			{
+				int guess = i == 0 ? first : ITERATION_SEED_S0 + ITERATION_SEED_S1 - first;
+
+				found     = searchSeedS(state, guess - ITERATION_SEED_S0, bytes, size, pool, after, nsec, candidates);
+				iteration = found ? guess : -1;
+			}
+		}
+	}
+
+	if (result != NULL)
+	{
+		result->iteration  = iteration;
+		result->nsec       = iteration >= ITERATION_SEED_S0 ? nsec : 0;
+		result->candidates = candidates;
+		result->seconds    = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	if (!found)
+	{
+		return 1;
+	}
+	state = after;
+	return 0;
+}
+
+int resyncSrandomIteration(SrandomSim &state, int iteration, const void *read, size_t size)
+{
+	SrandomSim after(state.version());
+
+	if ((state.version() != SRANDOM_VERSION_NORM_ARRAY_BUG && state.version() != SRANDOM_VERSION_NORM) || size < MIN_READ_SIZE ||
+		iteration < 0 || iteration > NUMBER_OF_PRNG_ARRAYS_NORM || !explains(state, iteration, 0, (const uint8_t*) read, size, after))
+	{
+		return 1;
+	}
+	state = after;
+	return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "srandom.h"
+#include "threadpool.h"
+
+struct ResyncResult
+{
+	int      iteration;  // work_thread() iteration found (see SrandomSim::workThreadStep()), -1 if none
+	uint64_t nsec;       // tv_nsec the reseed saw
+	uint64_t candidates; // nsec tried by the brute force
+	double   seconds;
+};
+
+// Works out what work_thread() did just before a read that didn't match, from the state before
+// the read and the read itself, instead of recovering from scratch. Every iteration is tried:
+// the 17 array updates need nothing more, seed_PRND_x() is undone from the first word of the
+// second block, and seed_PRND_s0() and seed_PRND_s1() are brute forced over every tv_nsec.
+// For those the xorshft128 output that word holds is known from x, and the state it comes from
+// is linear in tv_nsec, so each candidate is two xors, an add and a compare, 8 or 4 at a time
+// with AVX-512 or AVX2 (see cpu.h), split over pool if given. The iteration after the last one
+// state went through is tried first. Hits are checked against the whole read.
+//
+// An update of any array but the one read moves the generators the same, so which one it was
+// is only told by the iteration that's due. After a recovery from scratch that's 0, not the
+// kthread's, so it's a guess. A wrong one shows up later as a mismatch nothing here explains,
+// SrandomTracker then retries the other arrays with resyncSrandomIteration().
+//
+// Only one work_thread() step between the reads is covered, it sleeps THREAD_SLEEP_VALUE (11)
+// seconds between them. Only SRANDOM_VERSION_NORM_ARRAY_BUG and SRANDOM_VERSION_NORM, UHS has no
+// kthread. The read has to be at least 544 bytes. On success state is left after the read and
+// 0 is returned, otherwise 1 and state is untouched.
+int resyncSrandom(SrandomSim &state, const void *read, size_t size, ThreadPool *pool = NULL, ResyncResult *result = NULL);
+
+// Does work_thread() iteration (an array update, 0 to NUMBER_OF_PRNG_ARRAYS_NORM) and checks the
+// read against it. Tells which other arrays an update could have been. On success state is left
+// after the read and 0 is returned, otherwise 1 and state is untouched.
+int resyncSrandomIteration(SrandomSim &state, int iteration, const void *read, size_t size);
+
+// Which code path the brute force uses
+const char *resyncSrandomIsa();
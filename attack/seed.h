@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Deterministic stand in for Csprng so benchmarks and batch trials can be rerun bit for bit.
+// Counter based: word i of a stream is splitmix64's output for counter i, starting from a
+// point picked by (seed, stream), so streams are independent and each trial can take its own
+// without caring which thread gets there first. Not cryptographic.
+class SeedStream
+{
+public:
+	SeedStream(uint64_t seed, uint64_t stream = 0) : m_counter(mix(mix(seed) + stream * GOLDEN)) {}
+
+	uint64_t next()
+	{
+		m_counter += GOLDEN;
+		return mix(m_counter);
+	}
+
+	void get(void *buffer, size_t size)
+	{
+		uint8_t *out = (uint8_t*) buffer;
+
+		for (; size >= sizeof(uint64_t); out += sizeof(uint64_t), size -= sizeof(uint64_t))
+		{
+			uint64_t word = next();
+
+			memcpy(out, &word, sizeof(uint64_t));
+		}
+		if (size > 0)
+		{
+			uint64_t word = next();
+
+			memcpy(out, &word, size);
+		}
+	}
+
+private:
+	static const uint64_t GOLDEN = UINT64_C(0x9E3779B97F4A7C15);
+
+	static uint64_t mix(uint64_t z)
+	{
+		z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+		z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+		return z ^ (z >> 31);
+	}
+
+	uint64_t m_counter;
+};
@@ -13,225 +13,309 @@
  */
  
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include "srandom.h"
 #include "csprng.h"
-
-// srandom 1.41.1
-
-#define PRNG_ARRAY_SIZE_UHS         65 // Must be at least 64. (actual size used will be 64, anything greater is thrown away).
-#define PRNG_ARRAY_SIZE_NORM        67 // Must be at least 64. (actual size used will be 64, anything greater is thrown away). Recommended multible of 4.
-#define NUMBER_OF_PRNG_ARRAYS_UHS   32 // Number of 512 byte arrays (Must be power of 2)
-#define NUMBER_OF_PRNG_ARRAYS_NORM  16 // Number of 512 byte arrays (Must be power of 2)
+#include "seed.h"
+#include "instrument.h"
+#ifdef SRANDOM_INSTRUMENT
+	#ifdef _WIN32
+		#include <windows.h>
+	#else
+		#include <time.h>
+	#endif
+#endif
 
 static uint64_t xorshft64 (uint64_t &state);
 static uint64_t xorshft128(uint64_t state[2]);
 
-static uint64_t xorshft64_state[4];
-static uint64_t xorshft128_state[8];
-static int      arraysBufferPositions[4];
-
-static uint64_t (*prngArraysNorm         )[PRNG_ARRAY_SIZE_NORM          ] = NULL;
-static uint64_t (*prngArraysNorm_arrayBug)[NUMBER_OF_PRNG_ARRAYS_NORM + 1] = NULL;
-static uint64_t (*prngArraysUhs          )[PRNG_ARRAY_SIZE_UHS           ] = NULL;
-static uint64_t (*prngArraysUhs_arrayBug )[NUMBER_OF_PRNG_ARRAYS_UHS  + 1] = NULL;
-
-void srandom_reset()
+// Kernels specialized on version, so the geometry is constant and there is nothing to branch on
+template <int VERSION>
+static inline void updateArray(uint64_t *prngArray, uint64_t &xorshft64_state, uint64_t xorshft128_state[2])
 {
-	const size_t PRNG_ARRAYS_SIZE_NORM = (NUMBER_OF_PRNG_ARRAYS_NORM + 1) * PRNG_ARRAY_SIZE_NORM * sizeof(uint64_t);
-	const size_t PRNG_ARRAYS_SIZE_UHS  = (NUMBER_OF_PRNG_ARRAYS_UHS  + 1) * PRNG_ARRAY_SIZE_UHS  * sizeof(uint64_t);
-
-	if (prngArraysNorm == NULL)
+	if (SrandomGeometry<VERSION>::UHS)
 	{
-		prngArraysNorm          = (uint64_t (*)[PRNG_ARRAY_SIZE_NORM          ]) malloc(PRNG_ARRAYS_SIZE_NORM);
-		prngArraysNorm_arrayBug = (uint64_t (*)[NUMBER_OF_PRNG_ARRAYS_NORM + 1]) malloc(PRNG_ARRAYS_SIZE_NORM);
-		prngArraysUhs           = (uint64_t (*)[PRNG_ARRAY_SIZE_UHS           ]) malloc(PRNG_ARRAYS_SIZE_UHS);
-		prngArraysUhs_arrayBug  = (uint64_t (*)[NUMBER_OF_PRNG_ARRAYS_UHS  + 1]) malloc(PRNG_ARRAYS_SIZE_UHS);
-
-		if (
-			prngArraysNorm == NULL || prngArraysNorm_arrayBug == NULL ||
-			prngArraysUhs  == NULL || prngArraysUhs_arrayBug  == NULL)
-		{
-			fprintf(stderr, "srandom_reset(): malloc failed\n");
-			exit(1);
-		}
+		update_sarray_uhs(prngArray, xorshft64_state);
+	}
+	else
+	{
+		update_sarray(prngArray, xorshft64_state, xorshft128_state);
 	}
-
-	arraysBufferPositions[0] = 0;
-	arraysBufferPositions[1] = 0;
-	arraysBufferPositions[2] = 0;
-	arraysBufferPositions[3] = 0;
-
-	// Seed with real random... unless srandom is installed
-	Csprng::get(xorshft64_state,         sizeof(xorshft64_state));
-	Csprng::get(xorshft128_state,        sizeof(xorshft128_state));
-	Csprng::get(prngArraysNorm,          PRNG_ARRAYS_SIZE_NORM);
-	Csprng::get(prngArraysNorm_arrayBug, PRNG_ARRAYS_SIZE_NORM);
-	Csprng::get(prngArraysUhs,           PRNG_ARRAYS_SIZE_UHS);
-	Csprng::get(prngArraysUhs_arrayBug,  PRNG_ARRAYS_SIZE_UHS);
 }
 
-size_t srandom_read(void *buffer, size_t bufferSize, uint64_t *prngArrays, uint64_t &xorshft64_state, uint64_t xorshft128_state[2], int &arraysBufferPosition, int version)
+template <int VERSION>
+static inline int nextbufferT(uint64_t *prngArrays, uint64_t &xorshft64_state, uint64_t xorshft128_state[2], int &arraysBufferPosition)
 {
-	uint64_t  numPrngArrays;
-	uint64_t *prngArray;
-	uint8_t  *tmpBuffer;
+	typedef SrandomGeometry<VERSION> Geometry;
 
-	if (version < 0 || version > 3)
-	{
-		return 0;
-	}
+	uint64_t *indexArray = prngArrays + Geometry::NUM_ARRAYS * Geometry::ROW_STRIDE;
+	int       position   = arraysBufferPosition / 16;
+	int       roll       = arraysBufferPosition % 16;
+	int       arrayIndex;
+
+	arrayIndex = (int) ((indexArray[position] >> (roll * 4)) & (Geometry::NUM_ARRAYS - 1));
 
-	tmpBuffer = (uint8_t*) malloc((bufferSize + 512) * sizeof(uint8_t));
-	if (!tmpBuffer)
+	arraysBufferPosition++;
+	if (arraysBufferPosition >= 1021)
 	{
-		return 0;
+		arraysBufferPosition = 0;
+		update_sarray(indexArray, xorshft64_state, xorshft128_state);
 	}
 
+	return arrayIndex;
+}
+
+// Copies each block straight from the array into the caller's buffer. Like the module, a
+// read always generates bufferSize / 512 + 1 blocks and the unused tail of the last one is
+// thrown away, so the array itself holds the partial block and no temporary buffer is needed.
+template <int VERSION>
+static inline size_t srandomReadT(void *buffer, size_t bufferSize, uint64_t *prngArrays, uint64_t &xorshft64_state, uint64_t xorshft128_state[2], int &arraysBufferPosition)
+{
 	// Select a RND array
-	if (version == SRANDOM_VERSION_NORM_ARRAY_BUG)
-	{
-		prngArray = prngArraysNorm_arrayBug[NUMBER_OF_PRNG_ARRAYS_NORM];
-		numPrngArrays = NUMBER_OF_PRNG_ARRAYS_NORM;
-	}
-	else if (version == SRANDOM_VERSION_NORM)
-	{
-		prngArray = prngArraysNorm[NUMBER_OF_PRNG_ARRAYS_NORM];
-		numPrngArrays = NUMBER_OF_PRNG_ARRAYS_NORM;
-	}
-	else if (version == SRANDOM_VERSION_UHS_ARRAY_BUG)
-	{
-		prngArray = prngArraysUhs_arrayBug[NUMBER_OF_PRNG_ARRAYS_UHS];
-		numPrngArrays = NUMBER_OF_PRNG_ARRAYS_UHS;
-	}
-	else
-	{
-		prngArray = prngArraysUhs[NUMBER_OF_PRNG_ARRAYS_UHS];
-		numPrngArrays = NUMBER_OF_PRNG_ARRAYS_UHS;
-	}
-	int arraysPosition = nextbuffer(prngArray, numPrngArrays, xorshft64_state, xorshft128_state, arraysBufferPosition);
-	if (version == SRANDOM_VERSION_NORM_ARRAY_BUG)
-	{
-		prngArray = ((uint64_t (*)[NUMBER_OF_PRNG_ARRAYS_NORM + 1]) prngArrays)[arraysPosition];
-	}
-	else if (version == SRANDOM_VERSION_NORM)
-	{
-		prngArray = ((uint64_t (*)[PRNG_ARRAY_SIZE_NORM          ]) prngArrays)[arraysPosition];
-	}
-	else if (version == SRANDOM_VERSION_UHS_ARRAY_BUG)
-	{
-		prngArray = ((uint64_t (*)[NUMBER_OF_PRNG_ARRAYS_UHS  + 1]) prngArrays)[arraysPosition];
-	}
-	else
-	{
-		prngArray = ((uint64_t (*)[PRNG_ARRAY_SIZE_UHS           ]) prngArrays)[arraysPosition];
-	}
+	int       arraysPosition = nextbufferT<VERSION>(prngArrays, xorshft64_state, xorshft128_state, arraysBufferPosition);
+	uint64_t *prngArray      = prngArrays + arraysPosition * SrandomGeometry<VERSION>::ROW_STRIDE;
+
+	INSTRUMENT_ADD(srandomReads, 1);
+	INSTRUMENT_ADD(srandomBytes, bufferSize);
 
 	// Send the Array of RND to USER
-	for (int block = 0; block <= bufferSize / 512; block++)
+	for (size_t offset = 0; offset <= bufferSize; offset += 512)
 	{
-		memcpy(tmpBuffer + 512 * block, prngArray, 512);
-		if (version < 2)
-		{
-			update_sarray(prngArray, xorshft64_state, xorshft128_state);
-		}
-		else
+		size_t size = bufferSize - offset;
+
+		if (size > 512)
 		{
-			update_sarray_uhs(prngArray, xorshft64_state);
+			size = 512;
 		}
+		memcpy((uint8_t*) buffer + offset, prngArray, size);
+		updateArray<VERSION>(prngArray, xorshft64_state, xorshft128_state);
 	}
 
-	memcpy(buffer, tmpBuffer, bufferSize);
-	free(tmpBuffer);
-
 	return bufferSize;
 }
 
-size_t srandom_read(void *buffer, size_t bufferSize, int version)
+template <int VERSION>
+SrandomSimT<VERSION>::SrandomSimT()
 {
-	uint64_t  numPrngArrays;
-	uint64_t *prngArray;
-	uint8_t  *tmpBuffer;
+	memset(m_prngArrays, 0, sizeof(m_prngArrays));
+	m_xorshft64_state      = 0;
+	m_xorshft128_state[0]  = 0;
+	m_xorshft128_state[1]  = 0;
+	m_arraysBufferPosition = 0;
+}
 
-	if (version < 0 || version > 3)
-	{
-		return 0;
-	}
-	if (prngArraysNorm == NULL)
-	{
-		srandom_reset();
-	}
+template <int VERSION>
+void SrandomSimT<VERSION>::reset()
+{
+	m_arraysBufferPosition = 0;
+
+	// Seed with real random... unless srandom is installed
+	Csprng::get(&m_xorshft64_state, sizeof(m_xorshft64_state));
+	Csprng::get(m_xorshft128_state, sizeof(m_xorshft128_state));
+	Csprng::get(m_prngArrays, sizeof(m_prngArrays));
+}
+
+template <int VERSION>
+void SrandomSimT<VERSION>::reset(uint64_t seed, uint64_t stream)
+{
+	SeedStream seeder(seed, stream);
+
+	m_arraysBufferPosition = 0;
+	seeder.get(&m_xorshft64_state, sizeof(m_xorshft64_state));
+	seeder.get(m_xorshft128_state, sizeof(m_xorshft128_state));
+	seeder.get(m_prngArrays, sizeof(m_prngArrays));
+}
+
+template <int VERSION>
+size_t SrandomSimT<VERSION>::read(void *buffer, size_t bufferSize)
+{
+	return srandomReadT<VERSION>(buffer, bufferSize, m_prngArrays, m_xorshft64_state, m_xorshft128_state, m_arraysBufferPosition);
+}
+
+template <int VERSION>
+int SrandomSimT<VERSION>::nextbuffer()
+{
+	return nextbufferT<VERSION>(m_prngArrays, m_xorshft64_state, m_xorshft128_state, m_arraysBufferPosition);
+}
 
-	tmpBuffer = (uint8_t*) malloc((bufferSize + 512) * sizeof(uint8_t));
-	if (!tmpBuffer)
+template <int VERSION>
+void SrandomSimT<VERSION>::update(int arrayIndex)
+{
+	updateArray<VERSION>(prngArray(arrayIndex), m_xorshft64_state, m_xorshft128_state);
+}
+
+template class SrandomSimT<SRANDOM_VERSION_NORM_ARRAY_BUG>;
+template class SrandomSimT<SRANDOM_VERSION_NORM>;
+template class SrandomSimT<SRANDOM_VERSION_UHS_ARRAY_BUG>;
+template class SrandomSimT<SRANDOM_VERSION_UHS>;
+
+SrandomSim::SrandomSim(int version)
+{
+	m_version              = version;
+	m_xorshft64_state      = 0;
+	m_xorshft128_state[0]  = 0;
+	m_xorshft128_state[1]  = 0;
+	m_arraysBufferPosition = 0;
+	m_workThreadIteration  = 0;
+	switch (version)
 	{
-		return 0;
+		case SRANDOM_VERSION_NORM_ARRAY_BUG: m_prngArrays.resize(SrandomGeometry<SRANDOM_VERSION_NORM_ARRAY_BUG>::TOTAL_WORDS); break;
+		case SRANDOM_VERSION_NORM:           m_prngArrays.resize(SrandomGeometry<SRANDOM_VERSION_NORM          >::TOTAL_WORDS); break;
+		case SRANDOM_VERSION_UHS_ARRAY_BUG:  m_prngArrays.resize(SrandomGeometry<SRANDOM_VERSION_UHS_ARRAY_BUG >::TOTAL_WORDS); break;
+		case SRANDOM_VERSION_UHS:            m_prngArrays.resize(SrandomGeometry<SRANDOM_VERSION_UHS           >::TOTAL_WORDS); break;
 	}
+}
 
-	// Select a RND array
-	if (version == SRANDOM_VERSION_NORM_ARRAY_BUG)
+void SrandomSim::reset()
+{
+	m_arraysBufferPosition = 0;
+	m_workThreadIteration  = 0;
+
+	// Seed with real random... unless srandom is installed
+	Csprng::get(&m_xorshft64_state, sizeof(m_xorshft64_state));
+	Csprng::get(m_xorshft128_state, sizeof(m_xorshft128_state));
+	Csprng::get(m_prngArrays.data(), m_prngArrays.size() * sizeof(uint64_t));
+}
+
+// Same order as reset() so a seed means the same state in SrandomSimT
+void SrandomSim::reset(uint64_t seed, uint64_t stream)
+{
+	SeedStream seeder(seed, stream);
+
+	m_arraysBufferPosition = 0;
+	m_workThreadIteration  = 0;
+	seeder.get(&m_xorshft64_state, sizeof(m_xorshft64_state));
+	seeder.get(m_xorshft128_state, sizeof(m_xorshft128_state));
+	seeder.get(m_prngArrays.data(), m_prngArrays.size() * sizeof(uint64_t));
+}
+
+// Each array is filled with one word more than it has. It lands on the next array's first
+// word, which is overwritten when that's filled, or for the last array off the end of the
+// allocation and is dropped here. mod_init() calls update_sarray() in every mode, not
+// update_sarray_uhs().
+void SrandomSim::modInit(const uint64_t nsec[4])
+{
+	const size_t arraySize = m_version < 2 ? PRNG_ARRAY_SIZE_NORM : PRNG_ARRAY_SIZE_UHS;
+
+	m_xorshft64_state     = nsec[0];
+	m_xorshft128_state[0] = xorshft64(m_xorshft64_state);
+	m_xorshft128_state[1] = xorshft64(m_xorshft64_state);
+
+	m_xorshft128_state[0] = (m_xorshft128_state[0] << 31) ^ nsec[1];
+	m_xorshft128_state[1] = (m_xorshft128_state[1] << 24) ^ nsec[2];
+	m_xorshft64_state     = (m_xorshft64_state    << 32) ^ nsec[3];
+
+	for (int i = 0; i <= numPrngArrays(); i++)
 	{
-		prngArray = prngArraysNorm_arrayBug[NUMBER_OF_PRNG_ARRAYS_NORM];
-		numPrngArrays = NUMBER_OF_PRNG_ARRAYS_NORM;
+		size_t start = (size_t) (prngArray(i) - m_prngArrays.data());
+
+		for (size_t j = 0; j <= arraySize; j++)
+		{
+			uint64_t word = xorshft128(m_xorshft128_state);
+
+			if (start + j < m_prngArrays.size())
+			{
+				m_prngArrays[start + j] = word;
+			}
+		}
+		update_sarray(prngArray(i), m_xorshft64_state, m_xorshft128_state);
 	}
-	else if (version == SRANDOM_VERSION_NORM)
+	m_arraysBufferPosition = 0;
+	m_workThreadIteration  = 0;
+}
+
+size_t SrandomSim::read(void *buffer, size_t bufferSize)
+{
+	return srandom_read(buffer, bufferSize, m_prngArrays.data(), m_xorshft64_state, m_xorshft128_state, m_arraysBufferPosition, m_version);
+}
+
+int SrandomSim::nextbuffer()
+{
+	switch (m_version)
 	{
-		prngArray = prngArraysNorm[NUMBER_OF_PRNG_ARRAYS_NORM];
-		numPrngArrays = NUMBER_OF_PRNG_ARRAYS_NORM;
+		case SRANDOM_VERSION_NORM_ARRAY_BUG: return nextbufferT<SRANDOM_VERSION_NORM_ARRAY_BUG>(m_prngArrays.data(), m_xorshft64_state, m_xorshft128_state, m_arraysBufferPosition);
+		case SRANDOM_VERSION_NORM:           return nextbufferT<SRANDOM_VERSION_NORM          >(m_prngArrays.data(), m_xorshft64_state, m_xorshft128_state, m_arraysBufferPosition);
+		case SRANDOM_VERSION_UHS_ARRAY_BUG:  return nextbufferT<SRANDOM_VERSION_UHS_ARRAY_BUG >(m_prngArrays.data(), m_xorshft64_state, m_xorshft128_state, m_arraysBufferPosition);
+		case SRANDOM_VERSION_UHS:            return nextbufferT<SRANDOM_VERSION_UHS           >(m_prngArrays.data(), m_xorshft64_state, m_xorshft128_state, m_arraysBufferPosition);
 	}
-	else if (version == SRANDOM_VERSION_UHS_ARRAY_BUG)
+	return 0;
+}
+
+void SrandomSim::update(int arrayIndex)
+{
+	if (m_version < 2)
 	{
-		prngArray = prngArraysUhs_arrayBug[NUMBER_OF_PRNG_ARRAYS_UHS];
-		numPrngArrays = NUMBER_OF_PRNG_ARRAYS_UHS;
+		update_sarray(prngArray(arrayIndex), m_xorshft64_state, m_xorshft128_state);
 	}
 	else
 	{
-		prngArray = prngArraysUhs[NUMBER_OF_PRNG_ARRAYS_UHS];
-		numPrngArrays = NUMBER_OF_PRNG_ARRAYS_UHS;
+		update_sarray_uhs(prngArray(arrayIndex), m_xorshft64_state);
 	}
-	int arraysPosition = nextbuffer(prngArray, numPrngArrays, xorshft64_state[version], xorshft128_state + 2 * version, arraysBufferPositions[version]);
+}
 
-	if (version == SRANDOM_VERSION_NORM_ARRAY_BUG)
+void SrandomSim::workThreadStep(uint64_t nsec)
+{
+	const int numArrays = numPrngArrays();
+
+	if (m_workThreadIteration <= numArrays)
 	{
-		prngArray = prngArraysNorm_arrayBug[arraysPosition];
+		update(m_workThreadIteration);
 	}
-	else if (version == SRANDOM_VERSION_NORM)
+	else if (m_workThreadIteration == numArrays + 1)
 	{
-		prngArray = prngArraysNorm[arraysPosition];
+		m_xorshft128_state[0] = (m_xorshft128_state[0] << 31) ^ nsec; // seed_PRND_s0()
 	}
-	else if (version == SRANDOM_VERSION_UHS_ARRAY_BUG)
+	else if (m_workThreadIteration == numArrays + 2)
 	{
-		prngArray = prngArraysUhs_arrayBug[arraysPosition];
+		m_xorshft128_state[1] = (m_xorshft128_state[1] << 24) ^ nsec; // seed_PRND_s1()
+	}
+	else if (m_workThreadIteration == numArrays + 3)
+	{
+		m_xorshft64_state = (m_xorshft64_state << 32) ^ nsec; // seed_PRND_x()
 	}
 	else
 	{
-		prngArray = prngArraysUhs[arraysPosition];
+		m_workThreadIteration = -1;
 	}
+	m_workThreadIteration++;
+}
 
-	// Send the Array of RND to USER
-	for (int block = 0; block <= bufferSize / 512; block++)
+int SrandomSim::numPrngArrays() const
+{
+	return m_version < 2 ? NUMBER_OF_PRNG_ARRAYS_NORM : NUMBER_OF_PRNG_ARRAYS_UHS;
+}
+
+uint64_t *SrandomSim::prngArray(int arrayIndex)
+{
+	switch (m_version)
 	{
-		memcpy(tmpBuffer + 512 * block, prngArray, 512);
-		if (version < 2)
-		{
-			update_sarray(prngArray, xorshft64_state[version], xorshft128_state + 2 * version);
-		}
-		else
-		{
-			update_sarray_uhs(prngArray, xorshft64_state[version]);
-		}
+		case SRANDOM_VERSION_NORM_ARRAY_BUG: return m_prngArrays.data() + arrayIndex * SrandomGeometry<SRANDOM_VERSION_NORM_ARRAY_BUG>::ROW_STRIDE;
+		case SRANDOM_VERSION_NORM:           return m_prngArrays.data() + arrayIndex * SrandomGeometry<SRANDOM_VERSION_NORM          >::ROW_STRIDE;
+		case SRANDOM_VERSION_UHS_ARRAY_BUG:  return m_prngArrays.data() + arrayIndex * SrandomGeometry<SRANDOM_VERSION_UHS_ARRAY_BUG >::ROW_STRIDE;
+		case SRANDOM_VERSION_UHS:            return m_prngArrays.data() + arrayIndex * SrandomGeometry<SRANDOM_VERSION_UHS           >::ROW_STRIDE;
 	}
+	return NULL;
+}
 
-	memcpy(buffer, tmpBuffer, bufferSize);
-	free(tmpBuffer);
-
-	return bufferSize;
+size_t srandom_read(void *buffer, size_t bufferSize, uint64_t *prngArrays, uint64_t &xorshft64_state, uint64_t xorshft128_state[2], int &arraysBufferPosition, int version)
+{
+	switch (version)
+	{
+		case SRANDOM_VERSION_NORM_ARRAY_BUG: return srandomReadT<SRANDOM_VERSION_NORM_ARRAY_BUG>(buffer, bufferSize, prngArrays, xorshft64_state, xorshft128_state, arraysBufferPosition);
+		case SRANDOM_VERSION_NORM:           return srandomReadT<SRANDOM_VERSION_NORM          >(buffer, bufferSize, prngArrays, xorshft64_state, xorshft128_state, arraysBufferPosition);
+		case SRANDOM_VERSION_UHS_ARRAY_BUG:  return srandomReadT<SRANDOM_VERSION_UHS_ARRAY_BUG >(buffer, bufferSize, prngArrays, xorshft64_state, xorshft128_state, arraysBufferPosition);
+		case SRANDOM_VERSION_UHS:            return srandomReadT<SRANDOM_VERSION_UHS           >(buffer, bufferSize, prngArrays, xorshft64_state, xorshft128_state, arraysBufferPosition);
+	}
+	return 0;
 }
 
 void update_sarray(uint64_t *prngArray, uint64_t &xorshft64_state, uint64_t xorshft128_state[2])
 {
 	uint64_t x, y, z1, z2, z3;
 
+	INSTRUMENT_ADD(updateSarray, 1);
 	z1 = xorshft64(xorshft64_state);
 	z2 = xorshft64(xorshft64_state);
 	z3 = xorshft64(xorshft64_state);
@@ -266,6 +350,7 @@ void update_sarray_uhs(uint64_t *prngArray, uint64_t &xorshft64_state)
 {
 	uint64_t x, z1;
 
+	INSTRUMENT_ADD(updateSarray, 1);
 	z1 = xorshft64(xorshft64_state);
 	if ((z1 & 1) == 0)
 	{
@@ -329,3 +414,31 @@ int nextbuffer(uint64_t *prngArray, uint64_t numPrngArrays, uint64_t &xorshft64_
 
 	return arrayIndex;
 }
+
+#ifdef SRANDOM_INSTRUMENT
+
+thread_local InstrumentCounters g_instrument;
+
+double instrument_cpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+	{
+		return 0.0;
+	}
+	return ((((uint64_t) kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) +
+	        (((uint64_t) user.dwHighDateTime   << 32) | user.dwLowDateTime)) / 1e7;
+#else
+	struct timespec now;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0)
+	{
+		return 0.0;
+	}
+	return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+#endif
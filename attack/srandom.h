@@ -1,14 +1,104 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
+#include <vector>
 
 const int SRANDOM_VERSION_NORM_ARRAY_BUG = 0;
 const int SRANDOM_VERSION_NORM           = 1;
 const int SRANDOM_VERSION_UHS_ARRAY_BUG  = 2;
 const int SRANDOM_VERSION_UHS            = 3;
 
-void   srandom_reset();
-size_t srandom_read(void *buffer, size_t bufferSize, int version);
+// srandom 1.41.1
+#define PRNG_ARRAY_SIZE_UHS         65 // Must be at least 64. (actual size used will be 64, anything greater is thrown away).
+#define PRNG_ARRAY_SIZE_NORM        67 // Must be at least 64. (actual size used will be 64, anything greater is thrown away). Recommended multible of 4.
+#define NUMBER_OF_PRNG_ARRAYS_UHS   32 // Number of 512 byte arrays (Must be power of 2)
+#define NUMBER_OF_PRNG_ARRAYS_NORM  16 // Number of 512 byte arrays (Must be power of 2)
+
+// Geometry of each version. The array bug versions index the arrays with the wrong
+// dimension, so consecutive arrays overlap.
+template <int VERSION>
+struct SrandomGeometry
+{
+	static const bool   UHS         = VERSION >= SRANDOM_VERSION_UHS_ARRAY_BUG;
+	static const bool   ARRAY_BUG   = VERSION == SRANDOM_VERSION_NORM_ARRAY_BUG || VERSION == SRANDOM_VERSION_UHS_ARRAY_BUG;
+	static const int    NUM_ARRAYS  = UHS ? NUMBER_OF_PRNG_ARRAYS_UHS : NUMBER_OF_PRNG_ARRAYS_NORM;
+	static const int    ARRAY_SIZE  = UHS ? PRNG_ARRAY_SIZE_UHS : PRNG_ARRAY_SIZE_NORM;
+	static const size_t ROW_STRIDE  = ARRAY_BUG ? NUM_ARRAYS + 1 : ARRAY_SIZE;
+	static const size_t TOTAL_WORDS = (NUM_ARRAYS + 1) * ARRAY_SIZE;
+};
+
+// One simulated /dev/srandom device with the version fixed at compile time. Use this in hot
+// loops, the runtime version check and array geometry all fold away.
+template <int VERSION>
+class SrandomSimT
+{
+public:
+	SrandomSimT();
+
+	void      reset();
+	void      reset(uint64_t seed, uint64_t stream = 0);
+	size_t    read(void *buffer, size_t bufferSize);
+	int       nextbuffer();
+	void      update(int arrayIndex);
+
+	int       version()              const { return VERSION; }
+	int       numPrngArrays()        const { return SrandomGeometry<VERSION>::NUM_ARRAYS; }
+	size_t    prngArraysSize()       const { return SrandomGeometry<VERSION>::TOTAL_WORDS; }
+	uint64_t *prngArrays()                 { return m_prngArrays; }
+	uint64_t *prngArray(int arrayIndex)    { return m_prngArrays + arrayIndex * SrandomGeometry<VERSION>::ROW_STRIDE; }
+	uint64_t &xorshft64State()             { return m_xorshft64_state; }
+	uint64_t *xorshft128State()            { return m_xorshft128_state; }
+	int      &arraysBufferPosition()       { return m_arraysBufferPosition; }
+
+private:
+	uint64_t m_prngArrays[SrandomGeometry<VERSION>::TOTAL_WORDS];
+	uint64_t m_xorshft64_state;
+	uint64_t m_xorshft128_state[2];
+	int      m_arraysBufferPosition;
+};
+
+// One simulated /dev/srandom device. All state is owned by the object, so any number of
+// them can be used at once (e.g. one per thread). The version is picked at runtime and each
+// call is dispatched to the same kernels as SrandomSimT.
+class SrandomSim
+{
+public:
+	SrandomSim(int version = SRANDOM_VERSION_NORM);
+
+	// Random state from Csprng, or from SeedStream(seed, stream) so it's the same every run
+	void      reset();
+	void      reset(uint64_t seed, uint64_t stream = 0);
+	size_t    read(void *buffer, size_t bufferSize);
+	int       nextbuffer();
+	void      update(int arrayIndex);
+
+	// The state mod_init() leaves from the tv_nsec of its four ktime reads: entropy initialize
+	// #1, then seed_PRND_s0(), seed_PRND_s1() and seed_PRND_x(). Its kthread hasn't run yet.
+	void      modInit(const uint64_t nsec[4]);
+
+	// One wake up of the kernel's work_thread(). It sleeps THREAD_SLEEP_VALUE seconds between
+	// them, so the caller picks when it happens and the nanoseconds it sees.
+	void      workThreadStep(uint64_t nsec);
+
+	int       version()              const { return m_version; }
+	int       numPrngArrays()        const;
+	size_t    prngArraysSize()       const { return m_prngArrays.size(); }
+	uint64_t *prngArrays()                 { return m_prngArrays.data(); }
+	uint64_t *prngArray(int arrayIndex);
+	uint64_t &xorshft64State()             { return m_xorshft64_state; }
+	uint64_t *xorshft128State()            { return m_xorshft128_state; }
+	int      &arraysBufferPosition()       { return m_arraysBufferPosition; }
+	int      &workThreadIteration()        { return m_workThreadIteration; }
+
+private:
+	int                   m_version;
+	std::vector<uint64_t> m_prngArrays;
+	uint64_t              m_xorshft64_state;
+	uint64_t              m_xorshft128_state[2];
+	int                   m_arraysBufferPosition;
+	int                   m_workThreadIteration;
+};
 
 // For breaking
 size_t srandom_read(void *buffer, size_t bufferSize, uint64_t *prngArrays, uint64_t &xorshft64_state, uint64_t xorshft128_state[2], int &arraysBufferPosition, int version);
@@ -0,0 +1,781 @@
+#include <stdio.h>
+#include <string.h>
+#include "srandomsimd.h"
+#include "csprng.h"
+#include "cpu.h"
+
+// The largest array is read up to word 64 (the "i + 1" of the last group of 4)
+#define SIMD_ARRAY_WORDS 65
+
+// The kernels are templates on the vector type of a CPU level and each level's copy is
+// inlined into a CPU_TARGET() wrapper, so it's compiled for that level's registers. flatten is
+// needed because the level's mul() can't be inlined into the template on its own.
+#if defined(__GNUC__)
+	#define SIMD_FLATTEN __attribute__((flatten))
+
+	typedef uint64_t u64x2 __attribute__((vector_size(16)));
+	typedef uint64_t u64x4 __attribute__((vector_size(32)));
+	typedef uint64_t u64x8 __attribute__((vector_size(64)));
+	typedef u64x2    ScalarVector;
+	#ifdef CPU_X86
+		#define SIMD_X86
+	#endif
+#else
+	#define SIMD_FLATTEN
+
+	typedef uint64_t ScalarVector;
+#endif
+
+// One word for each of WIDTH lanes, as N native vectors. Not one LANES wide vector because GCC
+// splits those up through the stack when the target's registers are narrower, and the kernels
+// work on WIDTH lanes at a time so the level's registers hold them. It's passed by reference so
+// the ABI doesn't depend on the ISA (-Wpsabi), everything is inlined anyway.
+template <typename V, int N_>
+struct u64xN
+{
+	static const int N     = N_;
+	static const int WIDTH = N * sizeof(V) / sizeof(uint64_t);
+
+	V v[N];
+
+	u64xN() {}
+	u64xN(uint64_t x) { for (int i = 0; i < N; i++) v[i] = V() + x; }
+
+	u64xN  operator^ (const u64xN &b) const { u64xN r; for (int i = 0; i < N; i++) r.v[i] = v[i] ^ b.v[i]; return r; }
+	u64xN  operator& (const u64xN &b) const { u64xN r; for (int i = 0; i < N; i++) r.v[i] = v[i] & b.v[i]; return r; }
+	u64xN  operator+ (const u64xN &b) const { u64xN r; for (int i = 0; i < N; i++) r.v[i] = v[i] + b.v[i]; return r; }
+	u64xN  operator- (const u64xN &b) const { u64xN r; for (int i = 0; i < N; i++) r.v[i] = v[i] - b.v[i]; return r; }
+	u64xN  operator<<(int n)          const { u64xN r; for (int i = 0; i < N; i++) r.v[i] = v[i] << n;     return r; }
+	u64xN  operator>>(int n)          const { u64xN r; for (int i = 0; i < N; i++) r.v[i] = v[i] >> n;     return r; }
+	u64xN &operator+=(const u64xN &b)       { *this = *this + b; return *this; }
+};
+
+template <typename V, int N>
+static inline void load(u64xN<V, N> &a, const uint64_t *p)
+{
+	for (int i = 0; i < N; i++)
+	{
+		memcpy(&a.v[i], p + i * sizeof(V) / sizeof(uint64_t), sizeof(V));
+	}
+}
+
+template <typename V, int N>
+static inline void store(uint64_t *p, const u64xN<V, N> &a)
+{
+	for (int i = 0; i < N; i++)
+	{
+		memcpy(p + i * sizeof(V) / sizeof(uint64_t), &a.v[i], sizeof(V));
+	}
+}
+
+// ## Multiply ##
+// a *= b. There's no 64 bit vector multiply before AVX-512DQ and the compiler turns a constant
+// one into a long chain of shifts and adds. Build it from 32x32->64 bit multiplies instead.
+
+template <int N>
+static inline void mul(u64xN<ScalarVector, N> &a, uint64_t b)
+{
+#if defined(SIMD_X86) && defined(__SSE2__)
+	// SSE2 is always there on x86-64, so it's the scalar level
+	__m128i bLo = _mm_set1_epi64x(b & 0xffffffff);
+	__m128i bHi = _mm_set1_epi64x(b >> 32);
+
+	for (int i = 0; i < N; i++)
+	{
+		__m128i r     = (__m128i) a.v[i];
+		__m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(r, 32), bLo), _mm_mul_epu32(r, bHi));
+
+		a.v[i] = (u64x2) _mm_add_epi64(_mm_mul_epu32(r, bLo), _mm_slli_epi64(cross, 32));
+	}
+#else
+	for (int i = 0; i < N; i++)
+	{
+		a.v[i] = a.v[i] * b;
+	}
+#endif
+}
+
+#ifdef SIMD_X86
+
+template <int N>
+CPU_TARGET("avx2")
+static inline void mul(u64xN<u64x4, N> &a, uint64_t b)
+{
+	__m256i bLo = _mm256_set1_epi64x(b & 0xffffffff);
+	__m256i bHi = _mm256_set1_epi64x(b >> 32);
+
+	for (int i = 0; i < N; i++)
+	{
+		__m256i r     = (__m256i) a.v[i];
+		__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(r, 32), bLo), _mm256_mul_epu32(r, bHi));
+
+		a.v[i] = (u64x4) _mm256_add_epi64(_mm256_mul_epu32(r, bLo), _mm256_slli_epi64(cross, 32));
+	}
+}
+
+template <int N>
+CPU_TARGET("avx512f,avx512dq")
+static inline void mul(u64xN<u64x8, N> &a, uint64_t b)
+{
+	for (int i = 0; i < N; i++)
+	{
+		a.v[i] = a.v[i] * b;
+	}
+}
+
+#endif
+
+// ## Kernels ##
+
+template <typename V, int N>
+static inline void xorshft64(u64xN<V, N> &out, u64xN<V, N> &state)
+{
+	u64xN<V, N> z = (state += UINT64_C(0x9E3779B97F4A7C15));
+
+	z = z ^ (z >> 30);
+	mul(z, UINT64_C(0xBF58476D1CE4E5B9));
+	z = z ^ (z >> 27);
+	mul(z, UINT64_C(0x94D049BB133111EB));
+	out = z ^ (z >> 31);
+}
+
+// mask ? a : b, per bit
+#define SELECT(mask, a, b) ((b) ^ (((a) ^ (b)) & (mask)))
+
+template <typename V, int N>
+static inline void xorshft128(u64xN<V, N> &out, u64xN<V, N> &state0, u64xN<V, N> &state1)
+{
+	u64xN<V, N> s0 = state0;
+	u64xN<V, N> s1 = state1;
+
+	s0 = s0 ^ (s0 << 23);
+	s0 = s0 ^ (s0 >> 17) ^ s1 ^ (s1 >> 26);
+
+	state0 = s1;
+	state1 = s0;
+	out = s0 + s1;
+}
+
+// update_sarray() on every lane, WIDTH lanes at a time. Word w of the array is at
+// prngArray + w * LANES and each state is LANES words, one per lane. Lanes take different
+// branches on z1, "even" selects each lane's terms. The state is copied to locals for the loop
+// since the compiler can't tell the pointers from the array and would keep it in memory.
+template <typename V, int N>
+static inline void updateSarray(uint64_t *prngArray, uint64_t *xorshft64_state_, uint64_t *xorshft128_state0_, uint64_t *xorshft128_state1_)
+{
+	typedef u64xN<V, N> u64xW;
+
+	const int L = SrandomSimd::LANES;
+
+	for (int lane = 0; lane < L; lane += u64xW::WIDTH)
+	{
+		u64xW xorshft64_state;
+		u64xW xorshft128_state0;
+		u64xW xorshft128_state1;
+		u64xW x, y, z1, z2, z3, even, c2, c3, w1, w2, w3;
+
+		load(xorshft64_state,   xorshft64_state_   + lane);
+		load(xorshft128_state0, xorshft128_state0_ + lane);
+		load(xorshft128_state1, xorshft128_state1_ + lane);
+		xorshft64(z1, xorshft64_state);
+		xorshft64(z2, xorshft64_state);
+		xorshft64(z3, xorshft64_state);
+
+		even = (z1 & 1) - 1;
+		c2   = SELECT(even, z2, z3);
+		c3   = SELECT(even, z3, z1);
+		for (size_t i = 0; i < PRNG_ARRAY_SIZE_NORM - 4; i += 4)
+		{
+			xorshft128(x, xorshft128_state0, xorshft128_state1);
+			xorshft128(y, xorshft128_state0, xorshft128_state1);
+			load(w1, prngArray + (i + 1) * L + lane);
+			load(w2, prngArray + (i + 2) * L + lane);
+			load(w3, prngArray + (i + 3) * L + lane);
+			w1 = w1 ^ x ^ SELECT(even, y,  z2);
+			w2 = w2 ^ y ^ SELECT(even, z1, x);
+			w3 = w3 ^ SELECT(even, x, y) ^ c2;
+			store(prngArray + (i    ) * L + lane, w1);
+			store(prngArray + (i + 1) * L + lane, w2);
+			store(prngArray + (i + 2) * L + lane, w3);
+			store(prngArray + (i + 3) * L + lane, x ^ y ^ c3);
+		}
+
+		store(xorshft64_state_   + lane, xorshft64_state);
+		store(xorshft128_state0_ + lane, xorshft128_state0);
+		store(xorshft128_state1_ + lane, xorshft128_state1);
+	}
+}
+
+// update_sarray_uhs() on every lane. Same arguments as updateSarray(), the xorshft128 state
+// isn't used.
+template <typename V, int N>
+static inline void updateSarrayUhs(uint64_t *prngArray, uint64_t *xorshft64_state_, uint64_t*, uint64_t*)
+{
+	typedef u64xN<V, N> u64xW;
+
+	const int L = SrandomSimd::LANES;
+
+	for (int lane = 0; lane < L; lane += u64xW::WIDTH)
+	{
+		u64xW xorshft64_state;
+		u64xW x, z1, zEven, zOdd, w1, w2, w3;
+
+		load(xorshft64_state, xorshft64_state_ + lane);
+		xorshft64(z1, xorshft64_state);
+		zEven = z1 & ((z1 & 1) - 1);
+		zOdd  = z1 ^ zEven;
+		for (size_t i = 0; i < PRNG_ARRAY_SIZE_UHS - 4; i += 4)
+		{
+			xorshft64(x, xorshft64_state);
+			load(w1, prngArray + (i + 1) * L + lane);
+			load(w2, prngArray + (i + 2) * L + lane);
+			load(w3, prngArray + (i + 3) * L + lane);
+			w1 = w1 ^ x ^ zOdd;
+			w2 = w2 ^ x ^ zEven;
+			w3 = w3 ^ x ^ z1;
+			store(prngArray + (i    ) * L + lane, w1);
+			store(prngArray + (i + 1) * L + lane, w2);
+			store(prngArray + (i + 2) * L + lane, w3);
+			store(prngArray + (i + 3) * L + lane, x ^ z1);
+		}
+
+		store(xorshft64_state_ + lane, xorshft64_state);
+	}
+}
+
+typedef void (*UpdateFunc)(uint64_t *prngArray, uint64_t *xorshft64_state, uint64_t *xorshft128_state0, uint64_t *xorshft128_state1);
+
+// Two vectors at a time where they're narrower than LANES, so there are two independent
+// xorshft chains to overlap. Four SSE2 vectors spill.
+
+SIMD_FLATTEN
+static void updateSarrayScalar(uint64_t *prngArray, uint64_t *xorshft64_state, uint64_t *xorshft128_state0, uint64_t *xorshft128_state1)
+{
+	updateSarray<ScalarVector, 2>(prngArray, xorshft64_state, xorshft128_state0, xorshft128_state1);
+}
+
+SIMD_FLATTEN
+static void updateSarrayUhsScalar(uint64_t *prngArray, uint64_t *xorshft64_state, uint64_t *xorshft128_state0, uint64_t *xorshft128_state1)
+{
+	updateSarrayUhs<ScalarVector, 2>(prngArray, xorshft64_state, xorshft128_state0, xorshft128_state1);
+}
+
+#ifdef SIMD_X86
+
+CPU_TARGET("avx2") SIMD_FLATTEN
+static void updateSarrayAvx2(uint64_t *prngArray, uint64_t *xorshft64_state, uint64_t *xorshft128_state0, uint64_t *xorshft128_state1)
+{
+	updateSarray<u64x4, 2>(prngArray, xorshft64_state, xorshft128_state0, xorshft128_state1);
+}
+
+CPU_TARGET("avx2") SIMD_FLATTEN
+static void updateSarrayUhsAvx2(uint64_t *prngArray, uint64_t *xorshft64_state, uint64_t *xorshft128_state0, uint64_t *xorshft128_state1)
+{
+	updateSarrayUhs<u64x4, 2>(prngArray, xorshft64_state, xorshft128_state0, xorshft128_state1);
+}
+
+CPU_TARGET("avx512f,avx512dq") SIMD_FLATTEN
+static void updateSarrayAvx512(uint64_t *prngArray, uint64_t *xorshft64_state, uint64_t *xorshft128_state0, uint64_t *xorshft128_state1)
+{
+	updateSarray<u64x8, 1>(prngArray, xorshft64_state, xorshft128_state0, xorshft128_state1);
+}
+
+CPU_TARGET("avx512f,avx512dq") SIMD_FLATTEN
+static void updateSarrayUhsAvx512(uint64_t *prngArray, uint64_t *xorshft64_state, uint64_t *xorshft128_state0, uint64_t *xorshft128_state1)
+{
+	updateSarrayUhs<u64x8, 1>(prngArray, xorshft64_state, xorshft128_state0, xorshft128_state1);
+}
+
+#endif
+
+// ## Transpose ##
+// The kernels work on a block of one vector per word, [word][lane], while each instance's words
+// are contiguous (its arrays, and its part of read()'s buffer). Word w of lane l is
+// block[w * LANES + l] and lanes[l] + w * 8. A square of words at a time with unpacks, which
+// turns it either way.
+
+#define SIMD_BLOCK_WORDS (512 / 8)
+
+typedef void (*ToLanesFunc)  (uint8_t *const lanes[], const uint64_t *block);
+typedef void (*FromLanesFunc)(uint64_t *block, const uint8_t *const lanes[]);
+
+#if defined(SIMD_X86) && defined(__SSE2__)
+
+static inline void transposeSse2(__m128i &r0, __m128i &r1)
+{
+	__m128i t0 = _mm_unpacklo_epi64(r0, r1);
+
+	r1 = _mm_unpackhi_epi64(r0, r1);
+	r0 = t0;
+}
+
+static void toLanesScalar(uint8_t *const lanes[], const uint64_t *block)
+{
+	const int L = SrandomSimd::LANES;
+
+	for (int w = 0; w < SIMD_BLOCK_WORDS; w += 2)
+	{
+		for (int lane = 0; lane < L; lane += 2)
+		{
+			__m128i r0 = _mm_loadu_si128((const __m128i*) (block + (w    ) * L + lane));
+			__m128i r1 = _mm_loadu_si128((const __m128i*) (block + (w + 1) * L + lane));
+
+			transposeSse2(r0, r1);
+			_mm_storeu_si128((__m128i*) (lanes[lane    ] + w * 8), r0);
+			_mm_storeu_si128((__m128i*) (lanes[lane + 1] + w * 8), r1);
+		}
+	}
+}
+
+static void fromLanesScalar(uint64_t *block, const uint8_t *const lanes[])
+{
+	const int L = SrandomSimd::LANES;
+
+	for (int w = 0; w < SIMD_BLOCK_WORDS; w += 2)
+	{
+		for (int lane = 0; lane < L; lane += 2)
+		{
+			__m128i r0 = _mm_loadu_si128((const __m128i*) (lanes[lane    ] + w * 8));
+			__m128i r1 = _mm_loadu_si128((const __m128i*) (lanes[lane + 1] + w * 8));
+
+			transposeSse2(r0, r1);
+			_mm_storeu_si128((__m128i*) (block + (w    ) * L + lane), r0);
+			_mm_storeu_si128((__m128i*) (block + (w + 1) * L + lane), r1);
+		}
+	}
+}
+
+#else
+
+static void toLanesScalar(uint8_t *const lanes[], const uint64_t *block)
+{
+	for (int w = 0; w < SIMD_BLOCK_WORDS; w++)
+	{
+		for (int lane = 0; lane < SrandomSimd::LANES; lane++)
+		{
+			memcpy(lanes[lane] + w * 8, block + w * SrandomSimd::LANES + lane, 8);
+		}
+	}
+}
+
+static void fromLanesScalar(uint64_t *block, const uint8_t *const lanes[])
+{
+	for (int w = 0; w < SIMD_BLOCK_WORDS; w++)
+	{
+		for (int lane = 0; lane < SrandomSimd::LANES; lane++)
+		{
+			memcpy(block + w * SrandomSimd::LANES + lane, lanes[lane] + w * 8, 8);
+		}
+	}
+}
+
+#endif
+
+#ifdef SIMD_X86
+
+CPU_TARGET("avx2")
+static inline void transposeAvx2(__m256i r[4])
+{
+	__m256i t0 = _mm256_unpacklo_epi64(r[0], r[1]); // Columns 0 and 2 of rows 0 and 1
+	__m256i t1 = _mm256_unpackhi_epi64(r[0], r[1]); // Columns 1 and 3 of rows 0 and 1
+	__m256i t2 = _mm256_unpacklo_epi64(r[2], r[3]); // Columns 0 and 2 of rows 2 and 3
+	__m256i t3 = _mm256_unpackhi_epi64(r[2], r[3]); // Columns 1 and 3 of rows 2 and 3
+
+	r[0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+	r[1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+	r[2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+	r[3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+}
+
+CPU_TARGET("avx2")
+static void toLanesAvx2(uint8_t *const lanes[], const uint64_t *block)
+{
+	const int L = SrandomSimd::LANES;
+
+	for (int w = 0; w < SIMD_BLOCK_WORDS; w += 4)
+	{
+		for (int lane = 0; lane < L; lane += 4)
+		{
+			__m256i r[4];
+
+			for (int i = 0; i < 4; i++)
+			{
+				r[i] = _mm256_loadu_si256((const __m256i*) (block + (w + i) * L + lane));
+			}
+			transposeAvx2(r);
+			for (int i = 0; i < 4; i++)
+			{
+				_mm256_storeu_si256((__m256i*) (lanes[lane + i] + w * 8), r[i]);
+			}
+		}
+	}
+}
+
+CPU_TARGET("avx2")
+static void fromLanesAvx2(uint64_t *block, const uint8_t *const lanes[])
+{
+	const int L = SrandomSimd::LANES;
+
+	for (int w = 0; w < SIMD_BLOCK_WORDS; w += 4)
+	{
+		for (int lane = 0; lane < L; lane += 4)
+		{
+			__m256i r[4];
+
+			for (int i = 0; i < 4; i++)
+			{
+				r[i] = _mm256_loadu_si256((const __m256i*) (lanes[lane + i] + w * 8));
+			}
+			transposeAvx2(r);
+			for (int i = 0; i < 4; i++)
+			{
+				_mm256_storeu_si256((__m256i*) (block + (w + i) * L + lane), r[i]);
+			}
+		}
+	}
+}
+
+#endif
+
+// ## Dispatch ##
+// No SSE4.2 versions, the scalar level already has SSE2's two lanes per register. Only GCC
+// and Clang have the vector types, other compilers get the scalar level with plain words.
+
+static const UpdateFunc UPDATE_SARRAY[] =
+{
+	updateSarrayScalar,
+#ifdef SIMD_X86
+	NULL,
+	updateSarrayAvx2,
+	updateSarrayAvx512,
+#endif
+};
+
+static const UpdateFunc UPDATE_SARRAY_UHS[] =
+{
+	updateSarrayUhsScalar,
+#ifdef SIMD_X86
+	NULL,
+	updateSarrayUhsAvx2,
+	updateSarrayUhsAvx512,
+#endif
+};
+
+// AVX-512 uses the AVX2 transposes, an 8x8 one wasn't reliably faster
+static const ToLanesFunc TO_LANES[] =
+{
+	toLanesScalar,
+#ifdef SIMD_X86
+	NULL,
+	toLanesAvx2,
+	toLanesAvx2,
+#endif
+};
+
+static const FromLanesFunc FROM_LANES[] =
+{
+	fromLanesScalar,
+#ifdef SIMD_X86
+	NULL,
+	fromLanesAvx2,
+	fromLanesAvx2,
+#endif
+};
+
+#ifndef NDEBUG
+// Array 0 of LANES random instances through one level's update and through SrandomSimT's.
+// Returns 0 if they match.
+template <int VERSION>
+static int checkLevel(int level)
+{
+	const int            L      = SrandomSimd::LANES;
+	const UpdateFunc     update = (VERSION < 2 ? UPDATE_SARRAY : UPDATE_SARRAY_UHS)[level];
+	SrandomSimT<VERSION> sim;
+	uint64_t             prngArray[SIMD_ARRAY_WORDS * L];
+	uint64_t             expected[SIMD_ARRAY_WORDS * L];
+	uint64_t             states[3][L];
+	uint64_t             expectedStates[3][L];
+
+	for (int lane = 0; lane < L; lane++)
+	{
+		sim.reset();
+		for (int i = 0; i < SIMD_ARRAY_WORDS; i++)
+		{
+			prngArray[i * L + lane] = sim.prngArray(0)[i];
+		}
+		states[0][lane] = sim.xorshft64State();
+		states[1][lane] = sim.xorshft128State()[0];
+		states[2][lane] = sim.xorshft128State()[1];
+
+		sim.update(0);
+		for (int i = 0; i < SIMD_ARRAY_WORDS; i++)
+		{
+			expected[i * L + lane] = sim.prngArray(0)[i];
+		}
+		expectedStates[0][lane] = sim.xorshft64State();
+		expectedStates[1][lane] = sim.xorshft128State()[0];
+		expectedStates[2][lane] = sim.xorshft128State()[1];
+	}
+	update(prngArray, states[0], states[1], states[2]);
+	return memcmp(prngArray, expected, sizeof(expected)) != 0 || memcmp(states, expectedStates, sizeof(states)) != 0;
+}
+
+// A random block through one level's transposes and word by word, to lanes that aren't 8 byte
+// aligned. Returns 0 if they match.
+static int checkTranspose(int level)
+{
+	const int L      = SrandomSimd::LANES;
+	const int STRIDE = 512 + 20;
+	uint64_t  block[SIMD_BLOCK_WORDS * L];
+	uint64_t  back[SIMD_BLOCK_WORDS * L];
+	uint8_t   out[L * STRIDE];
+	uint8_t   expected[L * STRIDE];
+	uint8_t  *lanes[L];
+
+	for (int i = 0; i < SIMD_BLOCK_WORDS * L; i++)
+	{
+		block[i] = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+	}
+	memset(out,      0, sizeof(out));
+	memset(expected, 0, sizeof(expected));
+	for (int lane = 0; lane < L; lane++)
+	{
+		lanes[lane] = out + lane * STRIDE + 4;
+		for (int w = 0; w < SIMD_BLOCK_WORDS; w++)
+		{
+			memcpy(expected + lane * STRIDE + 4 + w * 8, block + w * L + lane, 8);
+		}
+	}
+	TO_LANES[level](lanes, block);
+	FROM_LANES[level](back, lanes);
+	return memcmp(out, expected, sizeof(out)) != 0 || memcmp(back, block, sizeof(back)) != 0;
+}
+#endif
+
+static int selectLevel()
+{
+	int level = cpu_level();
+
+	if (level >= (int) (sizeof(UPDATE_SARRAY) / sizeof(*UPDATE_SARRAY)))
+	{
+		level = (int) (sizeof(UPDATE_SARRAY) / sizeof(*UPDATE_SARRAY)) - 1;
+	}
+	if (level == CPU_LEVEL_SSE42)
+	{
+		level = CPU_LEVEL_SCALAR;
+	}
+
+#ifndef NDEBUG
+	// The scalar level is vector code too, so it's checked as well
+	for (int i = CPU_LEVEL_SCALAR; i <= level; i++)
+	{
+		if (UPDATE_SARRAY[i] != NULL && (checkLevel<SRANDOM_VERSION_NORM>(i) || checkLevel<SRANDOM_VERSION_UHS>(i) || checkTranspose(i)))
+		{
+			cpu_checkFailed("srandomsimd_update", i);
+		}
+	}
+#endif
+
+	return level;
+}
+
+static int simdLevel()
+{
+	static const int level = selectLevel();
+
+	return level;
+}
+
+SrandomSimd::SrandomSimd(int version, size_t count)
+{
+	SrandomSim geometry(version);
+
+	m_version       = version;
+	m_count         = count;
+	m_groups        = (count + LANES - 1) / LANES;
+	m_numPrngArrays = geometry.numPrngArrays();
+	m_rowStride     = geometry.prngArray(1) - geometry.prngArray(0);
+	m_totalWords    = geometry.prngArraysSize();
+	m_prngArrays.resize(m_groups * m_totalWords * LANES);
+	m_xorshft64_state.resize(m_groups * LANES);
+	m_xorshft128_state[0].resize(m_groups * LANES);
+	m_xorshft128_state[1].resize(m_groups * LANES);
+	m_arraysBufferPosition.resize(m_groups * LANES);
+}
+
+void SrandomSimd::reset()
+{
+	// Seed with real random... unless srandom is installed
+	Csprng::get(m_xorshft64_state.data(),     m_xorshft64_state.size()     * sizeof(uint64_t));
+	Csprng::get(m_xorshft128_state[0].data(), m_xorshft128_state[0].size() * sizeof(uint64_t));
+	Csprng::get(m_xorshft128_state[1].data(), m_xorshft128_state[1].size() * sizeof(uint64_t));
+	Csprng::get(m_prngArrays.data(),          m_prngArrays.size()          * sizeof(uint64_t));
+	for (size_t i = 0; i < m_arraysBufferPosition.size(); i++)
+	{
+		m_arraysBufferPosition[i] = 0;
+	}
+}
+
+void SrandomSimd::reset(uint64_t seed)
+{
+	SrandomSim sim(m_version);
+
+	for (size_t i = 0; i < m_count; i++)
+	{
+		sim.reset(seed, i);
+		setInstance(i, sim);
+	}
+}
+
+// Same as SrandomSim::read() on each instance. Instance i's output goes to
+// buffer + i * bufferSize.
+void SrandomSimd::read(void *buffer, size_t bufferSize)
+{
+	UpdateFunc    update    = (m_version < 2 ? UPDATE_SARRAY : UPDATE_SARRAY_UHS)[simdLevel()];
+	ToLanesFunc   toLanes   = TO_LANES[simdLevel()];
+	FromLanesFunc fromLanes = FROM_LANES[simdLevel()];
+	uint64_t      block[SIMD_ARRAY_WORDS * LANES];
+	uint64_t     *arrays[LANES];
+	uint8_t      *lanes[LANES];
+	uint8_t      *out[LANES];
+
+	for (size_t group = 0; group < m_groups; group++)
+	{
+		uint64_t *xorshft64_state   = m_xorshft64_state.data()     + group * LANES;
+		uint64_t *xorshft128_state0 = m_xorshft128_state[0].data() + group * LANES;
+		uint64_t *xorshft128_state1 = m_xorshft128_state[1].data() + group * LANES;
+
+		// Select a RND array per lane and gather them
+		selectArrays(group, arrays);
+		for (int lane = 0; lane < LANES; lane++)
+		{
+			lanes[lane] = (uint8_t*) arrays[lane];
+			out[lane]   = (uint8_t*) buffer + (group * LANES + lane) * bufferSize;
+			block[SIMD_BLOCK_WORDS * LANES + lane] = arrays[lane][SIMD_BLOCK_WORDS];
+		}
+		fromLanes(block, lanes);
+
+		// Send the Array of RND to USER
+		for (size_t offset = 0; offset <= bufferSize; offset += 512)
+		{
+			size_t size = bufferSize - offset;
+
+			if (size > 512)
+			{
+				size = 512;
+			}
+			if (size == 512 && (group + 1) * LANES <= m_count)
+			{
+				toLanes(out, block);
+				for (int lane = 0; lane < LANES; lane++)
+				{
+					out[lane] += 512;
+				}
+			}
+			else
+			{
+				// The end of the buffer or a group that isn't full
+				for (int lane = 0; lane < LANES && group * LANES + lane < m_count; lane++)
+				{
+					for (size_t i = 0; i < size; i += 8)
+					{
+						memcpy(out[lane] + i, block + (i / 8) * LANES + lane, size - i < 8 ? size - i : 8);
+					}
+					out[lane] += size;
+				}
+			}
+			update(block, xorshft64_state, xorshft128_state0, xorshft128_state1);
+		}
+
+		// Scatter them back
+		toLanes(lanes, block);
+	}
+}
+
+// Same as SrandomSim::update() on each instance
+void SrandomSimd::update(int arrayIndex)
+{
+	UpdateFunc    update    = (m_version < 2 ? UPDATE_SARRAY : UPDATE_SARRAY_UHS)[simdLevel()];
+	ToLanesFunc   toLanes   = TO_LANES[simdLevel()];
+	FromLanesFunc fromLanes = FROM_LANES[simdLevel()];
+	uint64_t      block[SIMD_ARRAY_WORDS * LANES];
+	uint8_t      *lanes[LANES];
+
+	for (size_t group = 0; group < m_groups; group++)
+	{
+		for (int lane = 0; lane < LANES; lane++)
+		{
+			lanes[lane] = (uint8_t*) (m_prngArrays.data() + (group * LANES + lane) * m_totalWords + arrayIndex * m_rowStride);
+		}
+		fromLanes(block, lanes);
+		update(
+			block,
+			m_xorshft64_state.data()     + group * LANES,
+			m_xorshft128_state[0].data() + group * LANES,
+			m_xorshft128_state[1].data() + group * LANES);
+		toLanes(lanes, block);
+	}
+}
+
+// nextbuffer() on each lane of a group, gives each lane's selected array. The index array
+// update is rare (once every 1021 reads) so it's done a lane at a time.
+void SrandomSimd::selectArrays(size_t group, uint64_t *arrays[LANES])
+{
+	for (int lane = 0; lane < LANES; lane++)
+	{
+		size_t    index                = group * LANES + lane;
+		uint64_t *prngArrays           = m_prngArrays.data() + index * m_totalWords;
+		int      &arraysBufferPosition = m_arraysBufferPosition[index];
+		uint64_t *indexArray           = prngArrays + m_numPrngArrays * m_rowStride;
+		int       position             = arraysBufferPosition / 16;
+		int       roll                 = arraysBufferPosition % 16;
+
+		arrays[lane] = prngArrays + ((indexArray[position] >> (roll * 4)) & (m_numPrngArrays - 1)) * m_rowStride;
+
+		arraysBufferPosition++;
+		if (arraysBufferPosition >= 1021)
+		{
+			uint64_t xorshft128_state[2] = {m_xorshft128_state[0][index], m_xorshft128_state[1][index]};
+
+			arraysBufferPosition = 0;
+			update_sarray(indexArray, m_xorshft64_state[index], xorshft128_state);
+			m_xorshft128_state[0][index] = xorshft128_state[0];
+			m_xorshft128_state[1][index] = xorshft128_state[1];
+		}
+	}
+}
+
+int SrandomSimd::setInstance(size_t index, SrandomSim &sim)
+{
+	if (index >= m_count || sim.version() != m_version)
+	{
+		fprintf(stderr, "Error SrandomSimd::setInstance: bad instance\n");
+		return 1;
+	}
+	memcpy(m_prngArrays.data() + index * m_totalWords, sim.prngArrays(), m_totalWords * sizeof(uint64_t));
+	m_xorshft64_state    [index] = sim.xorshft64State();
+	m_xorshft128_state[0][index] = sim.xorshft128State()[0];
+	m_xorshft128_state[1][index] = sim.xorshft128State()[1];
+	m_arraysBufferPosition[index] = sim.arraysBufferPosition();
+	return 0;
+}
+
+int SrandomSimd::getInstance(size_t index, SrandomSim &sim) const
+{
+	if (index >= m_count || sim.version() != m_version)
+	{
+		fprintf(stderr, "Error SrandomSimd::getInstance: bad instance\n");
+		return 1;
+	}
+	memcpy(sim.prngArrays(), m_prngArrays.data() + index * m_totalWords, m_totalWords * sizeof(uint64_t));
+	sim.xorshft64State()      = m_xorshft64_state    [index];
+	sim.xorshft128State()[0]  = m_xorshft128_state[0][index];
+	sim.xorshft128State()[1]  = m_xorshft128_state[1][index];
+	sim.arraysBufferPosition() = m_arraysBufferPosition[index];
+	return 0;
+}
+
+const char *SrandomSimd::isa()
+{
+	return cpu_levelName(simdLevel());
+}
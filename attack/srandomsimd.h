@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "srandom.h"
+
+// Many simulated /dev/srandom devices advanced in lockstep, in groups of LANES. Each instance's
+// state is contiguous. read() transposes the array each instance in a group selected into one
+// vector per word, so the group is updated per instruction, and transposes it back at the end.
+// The kernels are compiled for each CPU level and picked at runtime (cpu.h): 2 instances per
+// register with SSE2, 4 with AVX2 and 8 with AVX-512.
+class SrandomSimd
+{
+public:
+	static const int LANES = 8;
+
+	SrandomSimd(int version = SRANDOM_VERSION_NORM, size_t count = LANES);
+
+	void   reset();
+	void   reset(uint64_t seed); // Instance i gets SrandomSim::reset(seed, i)'s state
+	void   read(void *buffer, size_t bufferSize);
+	void   update(int arrayIndex);
+
+	int    setInstance(size_t index, SrandomSim &sim);
+	int    getInstance(size_t index, SrandomSim &sim) const;
+
+	int    version() const { return m_version; }
+	size_t count()   const { return m_count; }
+
+	static const char *isa(); // The CPU level the update runs at
+
+private:
+	void selectArrays(size_t group, uint64_t *arrays[LANES]);
+
+	int                   m_version;
+	size_t                m_count;
+	size_t                m_groups;
+	int                   m_numPrngArrays;
+	size_t                m_rowStride;
+	size_t                m_totalWords;
+	std::vector<uint64_t> m_prngArrays;          // [instance][word]
+	std::vector<uint64_t> m_xorshft64_state;     // [instance]
+	std::vector<uint64_t> m_xorshft128_state[2]; // [instance]
+	std::vector<int>      m_arraysBufferPosition;
+};
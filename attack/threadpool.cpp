@@ -0,0 +1,159 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int threads) : m_slices(0), m_job(NULL), m_generation(0), m_running(0), m_stop(false)
+{
+	if (threads <= 0)
+	{
+		threads = (int) std::thread::hardware_concurrency();
+		if (threads <= 0)
+		{
+			threads = 1;
+		}
+	}
+	m_threads = threads;
+	m_slices  = std::vector<Slice>(threads);
+	for (int i = 0; i < threads; i++)
+	{
+		m_workers.push_back(std::thread(&ThreadPool::worker, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_start.notify_all();
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+}
+
+bool ThreadPool::take(int thread, size_t &index)
+{
+	Slice                      &slice = m_slices[thread];
+	std::lock_guard<std::mutex> lock(slice.mutex);
+
+	if (slice.begin == slice.end)
+	{
+		return false;
+	}
+	index = slice.begin++;
+	return true;
+}
+
+bool ThreadPool::steal(int thread)
+{
+	for (;;)
+	{
+		int    victim = -1;
+		size_t most   = 0;
+
+		// Only a hint, the victim is checked again once locked
+		for (int i = 0; i < m_threads; i++)
+		{
+			size_t left;
+
+			if (i == thread)
+			{
+				continue;
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_slices[i].mutex);
+				left = m_slices[i].end - m_slices[i].begin;
+			}
+			if (left > most)
+			{
+				most   = left;
+				victim = i;
+			}
+		}
+		if (victim < 0)
+		{
+			return false;
+		}
+
+		// Lock in index order so two thieves can't deadlock
+		Slice &mine   = m_slices[thread];
+		Slice &theirs = m_slices[victim];
+		std::unique_lock<std::mutex> first (thread < victim ? mine.mutex   : theirs.mutex);
+		std::unique_lock<std::mutex> second(thread < victim ? theirs.mutex : mine.mutex);
+		size_t left = theirs.end - theirs.begin;
+
+		if (left == 0)
+		{
+			continue;
+		}
+		mine.end    = theirs.end;
+		theirs.end -= (left + 1) / 2;
+		mine.begin  = theirs.end;
+		return true;
+	}
+}
+
+void ThreadPool::worker(int thread)
+{
+	uint64_t generation = 0;
+
+	for (;;)
+	{
+		const std::function<void(size_t index, int thread)> *job;
+		size_t index;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			m_start.wait(lock, [&]() { return m_stop || m_generation != generation; });
+			if (m_stop)
+			{
+				return;
+			}
+			generation = m_generation;
+			job        = m_job;
+		}
+
+		do
+		{
+			while (take(thread, index))
+			{
+				(*job)(index, thread);
+			}
+		} while (steal(thread));
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if (--m_running == 0)
+			{
+				m_done.notify_one();
+			}
+		}
+	}
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t index, int thread)> &job)
+{
+	std::lock_guard<std::mutex> runLock(m_runMutex);
+
+	// The workers are all waiting, so nothing else touches the slices
+	for (int i = 0; i < m_threads; i++)
+	{
+		m_slices[i].begin = count *  i      / m_threads;
+		m_slices[i].end   = count * (i + 1) / m_threads;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_job     = &job;
+		m_running = m_threads;
+		m_generation++;
+	}
+	m_start.notify_all();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [&]() { return m_running == 0; });
+	m_job = NULL;
+}
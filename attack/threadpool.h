@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs job(index, thread) for every index in [0, count). Each thread starts with an even slice
+// of the indexes and takes from the front of it, a thread that runs out steals the back half of
+// the biggest slice left. So jobs that take wildly different times (like a recovery that hits
+// the array bug retry) don't leave threads idle.
+//
+// The threads are started once and wait between runs, so run() is cheap enough for the resync
+// and tracker paths that call it for every mismatch. run() can be called from several threads,
+// the calls are done one after the other. It must not be called from inside a job.
+class ThreadPool
+{
+public:
+	ThreadPool(int threads = 0); // 0 is one per hardware thread
+	~ThreadPool();
+
+	void run(size_t count, const std::function<void(size_t index, int thread)> &job);
+
+	int  threads() const { return m_threads; }
+
+private:
+	struct Slice
+	{
+		std::mutex mutex;
+		size_t     begin;
+		size_t     end;
+	};
+
+	bool take(int thread, size_t &index);
+	bool steal(int thread);
+	void worker(int thread);
+
+	int                      m_threads;
+	std::vector<Slice>       m_slices;
+	std::vector<std::thread> m_workers;
+	std::mutex               m_runMutex; // One run() at a time
+	std::mutex               m_mutex;    // Guards everything below
+	std::condition_variable  m_start;
+	std::condition_variable  m_done;
+	const std::function<void(size_t index, int thread)> *m_job;
+	uint64_t                 m_generation; // Bumped by each run()
+	int                      m_running;    // Workers still on the current run
+	bool                     m_stop;
+};
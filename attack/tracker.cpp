@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <string.h>
+#include "tracker.h"
+#include "checkpoint.h"
+#include "resync.h"
+
+// Reads kept after a guess. Each read has a 1/16 chance to be of the array it really was, so a
+// wrong guess is still open after 128 reads about once in 2^12. It's kept then, and a later
+// read of that array that nothing explains falls back to sync().
+#define GUESS_READS 128
+
+SrandomTracker::SrandomTracker(SrandomTarget &source, size_t readSize, size_t ringReads, ThreadPool *pool) :
+	m_source(source),
+	m_state(source.version()),
+	m_before(source.version()),
+	m_pool(pool),
+	m_readSize(readSize),
+	m_ringReads(ringReads > 0 ? ringReads : 1),
+	m_ring(readSize * m_ringReads),
+	m_predicted(readSize),
+	m_ringPosition(0),
+	m_ringFilled(0),
+	m_inSync(false),
+	m_stats(),
+	m_checkpointEvery(0),
+	m_skippedReads(0),
+	m_duePinned(false),
+	m_guessBefore(source.version()),
+	m_guessArray(-1),
+	m_guessArrays(0)
+{
+}
+
+void SrandomTracker::setCheckpoint(const char *fileName, uint64_t everyReads)
+{
+	m_checkpointName  = fileName != NULL ? fileName : "";
+	m_checkpointEvery = fileName != NULL ? everyReads : 0;
+}
+
+int SrandomTracker::resume(const char *fileName, uint64_t maxSkippedReads)
+{
+	SrandomSim state(m_state.version());
+	uint64_t   reads;
+
+	if (checkpoint_load(fileName, state, &reads))
+	{
+		return 1;
+	}
+	if (state.version() != m_source.version())
+	{
+		fprintf(stderr, "Error \"%s\" is for version %d not %d\n", fileName, state.version(), m_source.version());
+		return 1;
+	}
+	m_state        = state;
+	m_stats.reads  = reads;
+	m_stats.bytes  = reads * m_readSize;
+	m_inSync       = true;
+	m_skippedReads = maxSkippedReads;
+	closeGuess(false);
+	return 0;
+}
+
+int SrandomTracker::sync(int print)
+{
+	RecoveryStats recovery;
+
+	closeGuess(false);
+	m_inSync = recoverSrandom(m_source, m_state, &recovery, print) == 0;
+	m_stats.recoveryBytes += recovery.bytes;
+	for (int i = 0; i < RECOVERY_PHASES; i++)
+	{
+		m_stats.recoverySeconds += recovery.phaseSeconds[i];
+	}
+	if (m_inSync)
+	{
+		m_stats.resyncs++;
+	}
+	else
+	{
+		m_stats.failedResyncs++;
+	}
+	return m_inSync ? 0 : 1;
+}
+
+int SrandomTracker::step()
+{
+	uint8_t *slot = m_ring.data() + m_ringPosition * m_readSize;
+
+	if (!m_inSync && sync())
+	{
+		return 1;
+	}
+
+	if (m_source.read(slot, m_readSize) != m_readSize)
+	{
+		return 1;
+	}
+	m_before = m_state;
+	m_state.read(m_predicted.data(), m_readSize);
+
+	// Fresh from resume(), the source might be a few reads past the checkpoint
+	for (; m_skippedReads > 0 && memcmp(slot, m_predicted.data(), m_readSize) != 0; m_skippedReads--)
+	{
+		m_before = m_state;
+		m_state.read(m_predicted.data(), m_readSize);
+	}
+	m_skippedReads = 0;
+
+	if (m_guessArrays != 0)
+	{
+		m_guessReads.insert(m_guessReads.end(), slot, slot + m_readSize);
+	}
+
+	// glibc's memcmp() is already vectorized (SSE2/AVX2/EVEX picked at load time)
+	bool match = memcmp(slot, m_predicted.data(), m_readSize) == 0;
+
+	if (m_guessArrays != 0)
+	{
+		if (match)
+		{
+			SrandomSim peek(m_before);
+
+			// The guessed array was read as predicted, so it was the one updated
+			if (peek.nextbuffer() == m_guessArray)
+			{
+				closeGuess(true);
+			}
+		}
+		else
+		{
+			m_stats.mismatches++;
+			if (retryGuess())
+			{
+				m_inSync = false;
+				return sync();
+			}
+			m_stats.fastResyncs++;
+			if ((m_guessArrays & (m_guessArrays - 1)) == 0)
+			{
+				closeGuess(true);
+			}
+		}
+	}
+	else if (!match)
+	{
+		ResyncResult resync;
+		bool         guessing = !m_duePinned && m_guessArrays == 0;
+		SrandomSim   before(guessing ? m_before : SrandomSim(m_before.version()));
+		int          failed   = resyncSrandom(m_before, slot, m_readSize, m_pool, &resync);
+
+		m_stats.mismatches++;
+		m_stats.fastResyncSeconds += resync.seconds;
+		if (failed)
+		{
+			m_inSync = false;
+			return sync();
+		}
+		m_state = m_before;
+		m_stats.fastResyncs++;
+		if (guessing && resync.iteration <= NUMBER_OF_PRNG_ARRAYS_NORM)
+		{
+			for (int i = 0; i <= NUMBER_OF_PRNG_ARRAYS_NORM; i++)
+			{
+				SrandomSim other(before);
+
+				if (i != resync.iteration && resyncSrandomIteration(other, i, slot, m_readSize) == 0)
+				{
+					m_guessArrays |= UINT32_C(1) << i;
+				}
+			}
+			if (m_guessArrays != 0)
+			{
+				m_guessArrays |= UINT32_C(1) << resync.iteration;
+				m_guessBefore  = before;
+				m_guessArray   = resync.iteration;
+				m_guessReads.assign(slot, slot + m_readSize);
+				m_stats.guesses++;
+			}
+		}
+		if (guessing && m_guessArrays == 0)
+		{
+			// A reseed or an update of the array read, only one iteration does that
+			m_duePinned = true;
+		}
+	}
+	if (m_guessArrays != 0 && m_guessReads.size() >= GUESS_READS * m_readSize)
+	{
+		closeGuess(true);
+	}
+
+	m_stats.reads++;
+	m_stats.bytes += m_readSize;
+	m_ringPosition = (m_ringPosition + 1) % m_ringReads;
+	if (m_ringFilled < m_ringReads)
+	{
+		m_ringFilled++;
+	}
+	// A failed save has already been reported and the tracking itself is fine, so carry on
+	if (m_checkpointEvery != 0 && m_stats.reads % m_checkpointEvery == 0)
+	{
+		checkpoint_save(m_checkpointName.c_str(), m_state, m_stats.reads);
+	}
+	return 0;
+}
+
+// A read since the guess didn't match. Replays every read since on each array it could still
+// be, resyncing as usual. A wrong array can still get through by resyncing steps
+// work_thread() never did, so only the ones that need the fewest resyncs are kept and m_state
+// is left after the first of them. Returns 1 if none works.
+int SrandomTracker::retryGuess()
+{
+	const size_t reads = m_guessReads.size() / m_readSize;
+	const int    guess = m_guessArray;
+	size_t       best  = SIZE_MAX;
+	uint32_t     kept  = 0;
+
+	// The guess first so it's kept on a tie
+	for (int k = 0; k <= NUMBER_OF_PRNG_ARRAYS_NORM; k++)
+	{
+		int        i       = (guess + k) % (NUMBER_OF_PRNG_ARRAYS_NORM + 1);
+		SrandomSim state(m_guessBefore);
+		size_t     resyncs = 0;
+		bool       explained;
+
+		if (((m_guessArrays >> i) & 1) == 0)
+		{
+			continue;
+		}
+		explained = resyncSrandomIteration(state, i, m_guessReads.data(), m_readSize) == 0;
+		for (size_t j = 1; j < reads && explained && resyncs <= best; j++)
+		{
+			const uint8_t *read = m_guessReads.data() + j * m_readSize;
+			SrandomSim     before(state);
+
+			state.read(m_predicted.data(), m_readSize);
+			if (memcmp(read, m_predicted.data(), m_readSize) != 0)
+			{
+				state     = before;
+				explained = resyncSrandom(state, read, m_readSize, m_pool) == 0;
+				resyncs++;
+			}
+		}
+		if (!explained || resyncs > best)
+		{
+			continue;
+		}
+		if (resyncs < best)
+		{
+			best         = resyncs;
+			kept         = 0;
+			m_state      = state;
+			m_guessArray = i;
+		}
+		kept |= UINT32_C(1) << i;
+	}
+	if (kept != 0 && m_guessArray != guess)
+	{
+		m_stats.guessRetries++;
+	}
+	m_guessArrays = kept;
+	return kept == 0;
+}
+
+void SrandomTracker::closeGuess(bool duePinned)
+{
+	m_duePinned   = duePinned;
+	m_guessArray  = -1;
+	m_guessArrays = 0;
+	m_guessReads.clear();
+}
+
+const uint8_t *SrandomTracker::read(size_t age) const
+{
+	if (age >= m_ringFilled)
+	{
+		return NULL;
+	}
+	return m_ring.data() + ((m_ringPosition + m_ringReads - 1 - age) % m_ringReads) * m_readSize;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "recover.h"
+#include "srandom.h"
+#include "threadpool.h"
+
+struct TrackerStats
+{
+	uint64_t reads;           // Reads verified against the prediction
+	uint64_t bytes;           // Bytes verified against the prediction
+	uint64_t mismatches;      // Reads that didn't match (work_thread() changed something)
+	uint64_t resyncs;         // Recoveries that worked
+	uint64_t failedResyncs;   // Recoveries that didn't
+	uint64_t recoveryBytes;   // Bytes read by recoveries
+	double   recoverySeconds;
+	uint64_t fastResyncs;     // Mismatches explained by resyncSrandom(), not counted in resyncs
+	double   fastResyncSeconds;
+	uint64_t guesses;         // Fast resyncs that had to guess which array work_thread() updated
+	uint64_t guessRetries;    // Wrong guesses fixed by replaying the reads on the other arrays
+};
+
+// Follows a live /dev/srandom stream. Each step reads readSize bytes from the source into the
+// next slot of a ring of ringReads reads and checks it against the same size read from the
+// recovered state. As long as they match nothing else is done, so the tracker costs one
+// simulated read and one memcmp() per read. When work_thread() updates an array or reseeds,
+// the next read won't match. resyncSrandom() works out what it did from the state before that
+// read and the read, on pool if given, and only if that fails is the state recovered again
+// from the stream.
+//
+// After a recovery the iteration work_thread() is on isn't known, so the first array update
+// it's seen doing is a guess between every array that explains the read (see resync.h). The
+// reads since are kept, up to GUESS_READS of them, or until a read of the guessed array matches
+// and confirms it. A mismatch in the meantime replays them on each array it could be, and only
+// if none of them works is the state recovered again.
+//
+// Reads have to be the same size as the ones predicted since every read starts on a fresh
+// array, so the tracker must be the only reader of the source.
+class SrandomTracker
+{
+public:
+	SrandomTracker(SrandomTarget &source, size_t readSize = 64 * 1024, size_t ringReads = 16, ThreadPool *pool = NULL);
+
+	// Recovers the state from scratch. Returns 0 on success, otherwise 1.
+	int  sync(int print = 0);
+
+	// Reads and verifies one read, resyncing if needed. Returns 0 if the tracker is in sync
+	// afterwards, otherwise 1.
+	int  step();
+
+	// Saves the state to fileName (see checkpoint.h) after every everyReads verified reads,
+	// 0 turns it off
+	void setCheckpoint(const char *fileName, uint64_t everyReads);
+
+	// Starts from a checkpoint instead of recovering. The source may have moved on by up to
+	// maxSkippedReads reads since it was saved (e.g. the reads after the last checkpoint before
+	// a restart), so the first read is looked for that far ahead. If it isn't found the tracker
+	// resyncs as usual. Returns 0 on success, otherwise 1.
+	int  resume(const char *fileName, uint64_t maxSkippedReads = 0);
+
+	// Last ringReads verified reads, read(0) is the newest. Returns NULL if there isn't one.
+	const uint8_t *read(size_t age) const;
+
+	size_t              readSize()  const { return m_readSize; }
+	size_t              ringReads() const { return m_ringReads; }
+	bool                inSync()    const { return m_inSync; }
+	const TrackerStats &stats()     const { return m_stats; }
+	SrandomSim         &state()           { return m_state; }
+
+private:
+	int  retryGuess();
+	void closeGuess(bool duePinned);
+
+	SrandomTarget        &m_source;
+	SrandomSim            m_state;
+	SrandomSim            m_before;       // m_state before the last predicted read
+	ThreadPool           *m_pool;
+	size_t                m_readSize;
+	size_t                m_ringReads;
+	std::vector<uint8_t>  m_ring;
+	std::vector<uint8_t>  m_predicted;
+	size_t                m_ringPosition; // Slot the next read goes in
+	size_t                m_ringFilled;
+	bool                  m_inSync;
+	TrackerStats          m_stats;
+	std::string           m_checkpointName;
+	uint64_t              m_checkpointEvery;
+	uint64_t              m_skippedReads; // Left to look through after resume()
+	bool                  m_duePinned;    // The work_thread() iteration that's due is known
+	SrandomSim            m_guessBefore;  // m_before of the resync that guessed
+	int                   m_guessArray;   // Array it guessed was updated
+	uint32_t              m_guessArrays;  // Arrays it could still be (bit per array), 0 if no guess is open
+	std::vector<uint8_t>  m_guessReads;   // Reads since, starting with the one resynced
+};
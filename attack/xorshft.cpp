@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include "xorshft.h"
+#include "xorshftmatrix.h"
+
+typedef XorshftPlus<64, 23, 17, 26> Xorshft128Matrix;
 
 uint64_t xorshft64(uint64_t &state)
 {
@@ -52,85 +55,101 @@ void xorshft128_undo(uint64_t state[2])
 	state[1] = s1;
 }
 
-
-
-// #########################################
-// #########################################
-// ###                                   ###
-// ###         Now the fun part          ###
-// ###  Solving the system of equations  ###
-// ###                                   ###
-// #########################################
-// #########################################
-
-
-// #####################################
-// ## Follow the bits in xorshft128() ##
-// #####################################
-
-struct bits128
+// xorshft128()'s state transition is linear over GF(2), so jumping 2**k steps is a 128x128
+// bit matrix. Column i of a matrix is where bit i of the state goes (bits 0-63 are state[0]).
+struct Xorshft128JumpTables
 {
-	uint64_t lo;
-	uint64_t hi;
-};
+	uint64_t forward [64][128][2];
+	uint64_t backward[64][128][2];
 
-struct uint64_bits
-{
-	bits128 bits[64];
+	Xorshft128JumpTables();
 };
 
-bits128 operator^(const bits128 &a, const bits128 &b)
+static void xorshft128_mul(const uint64_t matrix[128][2], uint64_t state[2])
 {
-	bits128 ret;
+	uint64_t ret[2] = {0, 0};
 
-	ret.lo = a.lo ^ b.lo;
-	ret.hi = a.hi ^ b.hi;
-	return ret;
+	for (int i = 0; i < 128; i++)
+	{
+		uint64_t mask = 0 - ((state[i / 64] >> (i % 64)) & 1);
+
+		ret[0] ^= matrix[i][0] & mask;
+		ret[1] ^= matrix[i][1] & mask;
+	}
+	state[0] = ret[0];
+	state[1] = ret[1];
 }
 
-uint64_bits operator^(const uint64_bits &a, const uint64_bits &b)
+static constexpr Gf2Bits<128> XORSHFT128_TRANSITION = Xorshft128Matrix::transition();
+static constexpr Gf2Bits<128> XORSHFT128_UNDO       = gf2_invert(XORSHFT128_TRANSITION);
+static_assert(XORSHFT128_UNDO.invertible, "xorshft128() can't be undone");
+
+static void xorshft128_initJumpTable(uint64_t table[64][128][2], const Gf2Bits<128> &step)
 {
-	uint64_bits ret;
+	for (int i = 0; i < 128; i++)
+	{
+		table[0][i][0] = step.rows[i][0];
+		table[0][i][1] = step.rows[i][1];
+	}
 
-	for (int i = 0; i < 64; i++)
+	// M**(2**(k+1)) = M**(2**k) * M**(2**k)
+	for (int k = 1; k < 64; k++)
 	{
-		ret.bits[i] = a.bits[i] ^ b.bits[i];
+		for (int i = 0; i < 128; i++)
+		{
+			table[k][i][0] = table[k - 1][i][0];
+			table[k][i][1] = table[k - 1][i][1];
+			xorshft128_mul(table[k - 1], table[k][i]);
+		}
 	}
-	return ret;
 }
 
-uint64_bits operator>>(const uint64_bits &a, int shift)
+Xorshft128JumpTables::Xorshft128JumpTables()
 {
-	uint64_bits ret = {0};
-
-	for (int i = 0; i < 64 - shift; i++)
-	{
-		ret.bits[i] = a.bits[i + shift];
-	}
-	return ret;
+	xorshft128_initJumpTable(forward,  XORSHFT128_TRANSITION);
+	xorshft128_initJumpTable(backward, XORSHFT128_UNDO);
 }
 
-uint64_bits operator<<(const uint64_bits &a, int shift)
+// Same as calling xorshft128() count times (or xorshft128_undo() -count times) but takes at
+// most 64 matrix multiplies. The 256 KiB of tables are built on first use.
+void xorshft128_jump(uint64_t state[2], int64_t count)
 {
-	uint64_bits ret = {0};
+	static const Xorshft128JumpTables tables;
+
+	const uint64_t (*table)[128][2] = tables.forward;
+	uint64_t          steps         = (uint64_t) count;
 
-	for (int i = 63 - shift; i >= 0; i--)
+	if (count < 0)
 	{
-		ret.bits[i + shift] = a.bits[i];
+		table = tables.backward;
+		steps = 0 - steps;
+	}
+	for (int k = 0; steps != 0; k++, steps >>= 1)
+	{
+		if (steps & 1)
+		{
+			xorshft128_mul(table[k], state);
+		}
 	}
-	return ret;
 }
 
-void xorshft128(uint64_bits &s0_, uint64_bits &s1)
-{
-	uint64_bits s0 = s0_;
 
-	s0 = s0 ^ (s0 << 23);
-	s0 = s0 ^ (s0 >> 17) ^ s1 ^ (s1 >> 26);
 
-	s0_ = s1;
-	s1  = s0;
-}
+// #########################################
+// #########################################
+// ###                                   ###
+// ###         Now the fun part          ###
+// ###  Solving the system of equations  ###
+// ###                                   ###
+// #########################################
+// #########################################
+
+
+struct bits128
+{
+	uint64_t lo;
+	uint64_t hi;
+};
 
 
 // ###################################
@@ -321,25 +340,81 @@ int saveBmp(const bits128 matrix[128], bits128 answers, int frame)
 }
 
 
+// ##############################################
+// ## Precomputed inverse (done by the compiler) ##
+// ##############################################
+
+// The matrix only depends on xorshft128(), not the output. So invert it once at compile time.
+// Column j of the inverse is what output bit j contributes to the state, and the columns are
+// grouped 8 at a time into byte tables so recovery is 16 lookups.
+struct Xorshft128Inverse
+{
+	uint64_t table[16][256][2];
+	bool     invertible;
+};
+
+constexpr Xorshft128Inverse xorshft128_makeInverse()
+{
+	Xorshft128Inverse inverse = {};
+	Gf2Bits<128>      columns = gf2_transpose(Xorshft128Matrix::recovery());
+
+	if (!columns.invertible)
+	{
+		return inverse;
+	}
+
+	// Column j of the inverse is what output bit j contributes to the state
+	for (int byte = 0; byte < 16; byte++)
+	{
+		for (int value = 1; value < 256; value++)
+		{
+			int low = 0;
+
+			while (((value >> low) & 1) == 0)
+			{
+				low++;
+			}
+			inverse.table[byte][value][0] = inverse.table[byte][value & (value - 1)][0] ^ columns.rows[8 * byte + low][0];
+			inverse.table[byte][value][1] = inverse.table[byte][value & (value - 1)][1] ^ columns.rows[8 * byte + low][1];
+		}
+	}
+	inverse.invertible = true;
+	return inverse;
+}
+
+static constexpr Xorshft128Inverse XORSHFT128_INVERSE = xorshft128_makeInverse();
+static_assert(XORSHFT128_INVERSE.invertible, "xorshft128() output bits don't determine the state");
+
+
 // ###################################
 // ## Solve the system of equations ##
 // ###################################
 
 int xorshft128_getState(uint64_t state[2], uint64_t leastSignificantBitsOutput[2], int showWork, int saveFrames)
 {
+	if (showWork == 0 && saveFrames == 0)
+	{
+		uint64_t recovered[2] = {0, 0};
+
+		for (int byte = 0; byte < 16; byte++)
+		{
+			const uint64_t *column = XORSHFT128_INVERSE.table[byte][(leastSignificantBitsOutput[byte / 8] >> (8 * (byte % 8))) & 0xff];
+
+			recovered[0] ^= column[0];
+			recovered[1] ^= column[1];
+		}
+		state[0] = recovered[0];
+		state[1] = recovered[1];
+		return 0;
+	}
+
+	// Same thing the long way, showing the work
+	static constexpr Gf2Bits<128> OBSERVATION = Xorshft128Matrix::observation();
+
 	bits128     matrix[128] = {0};
 	bits128     answers     = {0};
-	uint64_bits s0          = {0};
-	uint64_bits s1          = {0};
 	int         frame       = 0;
 
-	// Init bits
-	for (int i = 0; i < 64; i++)
-	{
-		s0.bits[i].lo |= UINT64_C(1) << i;
-		s1.bits[i].hi |= UINT64_C(1) << i;
-	}
-
 	if (showWork)
 	{
 		printf(
@@ -357,9 +432,8 @@ int xorshft128_getState(uint64_t state[2], uint64_t leastSignificantBitsOutput[2
 	}
 	for (int i = 0; i < 128; i++)
 	{
-		xorshft128(s0, s1);
-		matrix[i].lo = s0.bits[0].lo ^ s1.bits[0].lo;
-		matrix[i].hi = s0.bits[0].hi ^ s1.bits[0].hi;
+		matrix[i].lo = OBSERVATION.rows[i][0];
+		matrix[i].hi = OBSERVATION.rows[i][1];
 
 		if (saveFrames > 0 && i % saveFrames == saveFrames - 1)
 		{
@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "xorshft.h"
+#include "xorshftbatch.h"
+
+#define XORSHFT64_GOLDEN    UINT64_C(0x9E3779B97F4A7C15)
+#define XORSHFT64_MUL1      UINT64_C(0xBF58476D1CE4E5B9)
+#define XORSHFT64_MUL2      UINT64_C(0x94D049BB133111EB)
+#define XORSHFT64_MUL1_INV  UINT64_C(0x96de1b173f119089)
+#define XORSHFT64_MUL2_INV  UINT64_C(0x319642b2d24d8ec3)
+
+typedef void   (*GetStatesFunc)(uint64_t *states, const uint64_t *outputs, size_t count);
+typedef size_t (*VerifyFunc)   (const uint64_t *outputs, const uint64_t *expected, size_t count, int64_t step, size_t *matches);
+
+// getState() gives the state after an output, xorshft64() adds one more before outputting
+static uint64_t verifyJump(int64_t step)
+{
+	return (uint64_t) (INT64_C(0x9E3779B97F4A7C15) * (step - 1));
+}
+
+// ## Scalar ##
+
+static void getStatesScalar(uint64_t *states, const uint64_t *outputs, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		states[i] = xorshft64_getState(outputs[i]);
+	}
+}
+
+// Matches are numbered from base, for the tails of the vector versions
+static size_t verifyScalarFrom(const uint64_t *outputs, const uint64_t *expected, size_t base, size_t count, int64_t step, size_t *matches)
+{
+	const uint64_t jump       = verifyJump(step);
+	size_t         numMatches = 0;
+
+	for (size_t i = base; i < count; i++)
+	{
+		uint64_t state = xorshft64_getState(outputs[i]) + jump;
+
+		if (xorshft64(state) == expected[i])
+		{
+			matches[numMatches++] = i;
+		}
+	}
+
+	return numMatches;
+}
+
+static size_t verifyScalar(const uint64_t *outputs, const uint64_t *expected, size_t count, int64_t step, size_t *matches)
+{
+	return verifyScalarFrom(outputs, expected, 0, count, step, matches);
+}
+
+#ifdef CPU_X86
+
+// ## AVX2 ##
+// No 64 bit multiply, each is lo*lo + ((hi*lo + lo*hi) << 32)
+
+CPU_TARGET("avx2")
+static inline __m256i mulAvx2(__m256i a, uint64_t b)
+{
+	__m256i bLo   = _mm256_set1_epi64x((long long) (b & 0xffffffff));
+	__m256i bHi   = _mm256_set1_epi64x((long long) (b >> 32));
+	__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), bLo), _mm256_mul_epu32(a, bHi));
+
+	return _mm256_add_epi64(_mm256_mul_epu32(a, bLo), _mm256_slli_epi64(cross, 32));
+}
+
+CPU_TARGET("avx2")
+static inline __m256i getStateAvx2(__m256i z)
+{
+	z = mulAvx2(_mm256_xor_si256(_mm256_xor_si256(z, _mm256_srli_epi64(z, 31)), _mm256_srli_epi64(z, 2*31)), XORSHFT64_MUL2_INV);
+	z = mulAvx2(_mm256_xor_si256(_mm256_xor_si256(z, _mm256_srli_epi64(z, 27)), _mm256_srli_epi64(z, 2*27)), XORSHFT64_MUL1_INV);
+	return _mm256_xor_si256(_mm256_xor_si256(z, _mm256_srli_epi64(z, 30)), _mm256_srli_epi64(z, 2*30));
+}
+
+CPU_TARGET("avx2")
+static inline __m256i outputAvx2(__m256i z)
+{
+	z = mulAvx2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 30)), XORSHFT64_MUL1);
+	z = mulAvx2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 27)), XORSHFT64_MUL2);
+	return _mm256_xor_si256(z, _mm256_srli_epi64(z, 31));
+}
+
+CPU_TARGET("avx2")
+static void getStatesAvx2(uint64_t *states, const uint64_t *outputs, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm256_storeu_si256((__m256i*) (states + i), getStateAvx2(_mm256_loadu_si256((const __m256i*) (outputs + i))));
+	}
+	getStatesScalar(states + i, outputs + i, count - i);
+}
+
+CPU_TARGET("avx2")
+static size_t verifyAvx2(const uint64_t *outputs, const uint64_t *expected, size_t count, int64_t step, size_t *matches)
+{
+	const __m256i jump       = _mm256_set1_epi64x((long long) (verifyJump(step) + XORSHFT64_GOLDEN));
+	size_t        numMatches = 0;
+	size_t        i          = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256i  state = _mm256_add_epi64(getStateAvx2(_mm256_loadu_si256((const __m256i*) (outputs + i))), jump);
+		unsigned mask  = (unsigned) _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(outputAvx2(state), _mm256_loadu_si256((const __m256i*) (expected + i)))));
+
+		// Matches are rare so this is almost never taken
+		for (size_t lane = 0; mask != 0 && lane < 4; lane++)
+		{
+			if ((mask >> lane) & 1)
+			{
+				matches[numMatches++] = i + lane;
+			}
+		}
+	}
+
+	return numMatches + verifyScalarFrom(outputs, expected, i, count, step, matches + numMatches);
+}
+
+// ## AVX-512 ##
+// vpmullq is AVX-512DQ
+
+// Same as _mm512_srli_epi64(), which GCC warns about when inlined into a target() function
+// because of the undefined value it uses as the unused mask source
+CPU_TARGET("avx512f")
+static inline __m512i srliAvx512(__m512i a, unsigned int shift)
+{
+	return _mm512_maskz_srli_epi64((__mmask8) 0xff, a, shift);
+}
+
+CPU_TARGET("avx512f,avx512dq")
+static inline __m512i getStateAvx512(__m512i z)
+{
+	z = _mm512_mullo_epi64(_mm512_ternarylogic_epi64(z, srliAvx512(z, 31), srliAvx512(z, 2*31), 0x96), _mm512_set1_epi64((long long) XORSHFT64_MUL2_INV));
+	z = _mm512_mullo_epi64(_mm512_ternarylogic_epi64(z, srliAvx512(z, 27), srliAvx512(z, 2*27), 0x96), _mm512_set1_epi64((long long) XORSHFT64_MUL1_INV));
+	return _mm512_ternarylogic_epi64(z, srliAvx512(z, 30), srliAvx512(z, 2*30), 0x96);
+}
+
+CPU_TARGET("avx512f,avx512dq")
+static inline __m512i outputAvx512(__m512i z)
+{
+	z = _mm512_mullo_epi64(_mm512_xor_si512(z, srliAvx512(z, 30)), _mm512_set1_epi64((long long) XORSHFT64_MUL1));
+	z = _mm512_mullo_epi64(_mm512_xor_si512(z, srliAvx512(z, 27)), _mm512_set1_epi64((long long) XORSHFT64_MUL2));
+	return _mm512_xor_si512(z, srliAvx512(z, 31));
+}
+
+CPU_TARGET("avx512f,avx512dq")
+static void getStatesAvx512(uint64_t *states, const uint64_t *outputs, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm512_storeu_si512((void*) (states + i), getStateAvx512(_mm512_loadu_si512((const void*) (outputs + i))));
+	}
+	getStatesScalar(states + i, outputs + i, count - i);
+}
+
+CPU_TARGET("avx512f,avx512dq")
+static size_t verifyAvx512(const uint64_t *outputs, const uint64_t *expected, size_t count, int64_t step, size_t *matches)
+{
+	const __m512i jump       = _mm512_set1_epi64((long long) (verifyJump(step) + XORSHFT64_GOLDEN));
+	size_t        numMatches = 0;
+	size_t        i          = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m512i  state = _mm512_add_epi64(getStateAvx512(_mm512_loadu_si512((const void*) (outputs + i))), jump);
+		unsigned mask  = _mm512_cmpeq_epi64_mask(outputAvx512(state), _mm512_loadu_si512((const void*) (expected + i)));
+
+		// Matches are rare so this is almost never taken
+		for (size_t lane = 0; mask != 0 && lane < 8; lane++)
+		{
+			if ((mask >> lane) & 1)
+			{
+				matches[numMatches++] = i + lane;
+			}
+		}
+	}
+
+	return numMatches + verifyScalarFrom(outputs, expected, i, count, step, matches + numMatches);
+}
+
+#endif
+
+// ## Dispatch ##
+// No SSE4.2 versions, two lanes with the multiply split up isn't faster than scalar
+
+static const GetStatesFunc GET_STATES[] =
+{
+	getStatesScalar,
+#ifdef CPU_X86
+	NULL,
+	getStatesAvx2,
+	getStatesAvx512,
+#endif
+};
+
+static const VerifyFunc VERIFY[] =
+{
+	verifyScalar,
+#ifdef CPU_X86
+	NULL,
+	verifyAvx2,
+	verifyAvx512,
+#endif
+};
+
+static int selectLevel()
+{
+	int level = cpu_level();
+
+	if (level >= (int) (sizeof(VERIFY) / sizeof(*VERIFY)))
+	{
+		level = (int) (sizeof(VERIFY) / sizeof(*VERIFY)) - 1;
+	}
+	if (level == CPU_LEVEL_SSE42)
+	{
+		level = CPU_LEVEL_SCALAR;
+	}
+
+#ifndef NDEBUG
+	// Some outputs followed by their real next output, so there's something to match
+	const size_t COUNT = 67;
+	uint64_t     outputs[COUNT];
+	uint64_t     expected[COUNT];
+	uint64_t     states[2][COUNT];
+	size_t       matches[2][COUNT];
+	size_t       numMatches[2];
+
+	for (size_t i = 0; i < COUNT; i++)
+	{
+		outputs[i]  = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+		expected[i] = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+		if (i % 3 == 0)
+		{
+			uint64_t state = xorshft64_getState(outputs[i]);
+
+			expected[i] = xorshft64(state);
+		}
+	}
+	for (int i = CPU_LEVEL_AVX2; i <= level; i++)
+	{
+		getStatesScalar(states[0], outputs, COUNT);
+		GET_STATES[i]  (states[1], outputs, COUNT);
+		numMatches[0] = verifyScalar(outputs, expected, COUNT, 1, matches[0]);
+		numMatches[1] = VERIFY[i]   (outputs, expected, COUNT, 1, matches[1]);
+		if (memcmp(states[0], states[1], sizeof(states[0])) != 0 ||
+			numMatches[0] != numMatches[1] || memcmp(matches[0], matches[1], numMatches[0] * sizeof(size_t)) != 0)
+		{
+			cpu_checkFailed("xorshft64_verify", i);
+		}
+	}
+#endif
+
+	return level;
+}
+
+static int batchLevel()
+{
+	static const int level = selectLevel();
+
+	return level;
+}
+
+void xorshft64_getStates(uint64_t *states, const uint64_t *outputs, size_t count)
+{
+	GET_STATES[batchLevel()](states, outputs, count);
+}
+
+size_t xorshft64_verify(const uint64_t *outputs, const uint64_t *expected, size_t count, int64_t step, size_t *matches)
+{
+	return VERIFY[batchLevel()](outputs, expected, count, step, matches);
+}
+
+const char *xorshft64_batchIsa()
+{
+	return cpu_levelName(batchLevel());
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Many xorshft64() inversions at once, for testing lots of candidate outputs (every offset of
+// a buffer, every xor of a few words, ...). Uses AVX-512DQ's vpmullq when the CPU has it,
+// otherwise AVX2 with each 64 bit multiply done as three 32x32 bit multiplies, otherwise plain
+// C (see cpu.h).
+
+// states[i] = xorshft64_getState(outputs[i])
+void   xorshft64_getStates(uint64_t *states, const uint64_t *outputs, size_t count);
+
+// For each i treats outputs[i] as an xorshft64() output, jumps step outputs ahead and checks
+// the output there against expected[i]. Writes each i that matches to matches (which needs
+// room for count) and returns how many there are. step = 1 checks that expected[i] is the
+// output right after outputs[i].
+size_t xorshft64_verify(const uint64_t *outputs, const uint64_t *expected, size_t count, int64_t step, size_t *matches);
+
+// Which code path the above use
+const char *xorshft64_batchIsa();
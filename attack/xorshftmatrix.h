@@ -0,0 +1,199 @@
+#pragma once
+
+#include <stdint.h>
+
+// GF(2) matrices of the xorshift+ family built by the compiler. The generator has two
+// WORD_BITS bit words and is xorshft128() with its shifts as parameters:
+//
+//   s0 = state[0] ^ (state[0] << A);
+//   s0 = s0 ^ (s0 >> B) ^ state[1] ^ (state[1] >> C);
+//   state[0] = state[1]; state[1] = s0; output s0 + state[0]
+//
+// State bit i is bit i of state[0] for i < WORD_BITS, otherwise bit i - WORD_BITS of state[1].
+// A bit vector is packed into 64 bit words, bit i is bit i % 64 of word i / 64.
+
+template <int N>
+struct Gf2Bits
+{
+	static const int WORDS = (N + 63) / 64;
+
+	uint64_t rows[N][WORDS];
+	bool     invertible;
+};
+
+// Gauss-Jordan elimination. invertible is false (and the rest is junk) if matrix is singular.
+template <int N>
+constexpr Gf2Bits<N> gf2_invert(Gf2Bits<N> matrix)
+{
+	const int  WORDS   = Gf2Bits<N>::WORDS;
+	Gf2Bits<N> inverse = {};
+
+	for (int i = 0; i < N; i++)
+	{
+		inverse.rows[i][i / 64] = UINT64_C(1) << (i % 64);
+	}
+	for (int i = 0; i < N; i++)
+	{
+		int row = i;
+
+		while (row < N && ((matrix.rows[row][i / 64] >> (i % 64)) & 1) == 0)
+		{
+			row++;
+		}
+		if (row == N)
+		{
+			return inverse;
+		}
+		for (int j = 0; j < WORDS; j++)
+		{
+			uint64_t tmp = matrix.rows[i][j];
+
+			matrix.rows[i][j]    = matrix.rows[row][j];
+			matrix.rows[row][j]  = tmp;
+			tmp                  = inverse.rows[i][j];
+			inverse.rows[i][j]   = inverse.rows[row][j];
+			inverse.rows[row][j] = tmp;
+		}
+		for (row = 0; row < N; row++)
+		{
+			if (row != i && ((matrix.rows[row][i / 64] >> (i % 64)) & 1) != 0)
+			{
+				for (int j = 0; j < WORDS; j++)
+				{
+					matrix.rows[row][j]  ^= matrix.rows[i][j];
+					inverse.rows[row][j] ^= inverse.rows[i][j];
+				}
+			}
+		}
+	}
+	inverse.invertible = true;
+	return inverse;
+}
+
+template <int N>
+constexpr Gf2Bits<N> gf2_transpose(const Gf2Bits<N> &matrix)
+{
+	Gf2Bits<N> ret = {};
+
+	for (int i = 0; i < N; i++)
+	{
+		for (int j = 0; j < N; j++)
+		{
+			ret.rows[j][i / 64] |= ((matrix.rows[i][j / 64] >> (j % 64)) & 1) << (i % 64);
+		}
+	}
+	ret.invertible = matrix.invertible;
+	return ret;
+}
+
+template <int WORD_BITS, int A, int B, int C>
+struct XorshftPlus
+{
+	static const int      STATE_BITS = 2 * WORD_BITS;
+	static const int      WORDS      = Gf2Bits<STATE_BITS>::WORDS;
+	static const uint64_t MASK       = WORD_BITS == 64 ? ~UINT64_C(0) : (UINT64_C(1) << (WORD_BITS % 64)) - 1;
+
+	static constexpr uint64_t step(uint64_t state[2])
+	{
+		uint64_t s0 = state[0];
+		uint64_t s1 = state[1];
+
+		s0 = (s0 ^ (s0 << A)) & MASK;
+		s0 = s0 ^ (s0 >> B) ^ s1 ^ (s1 >> C);
+
+		state[0] = s1;
+		state[1] = s0;
+		return (s0 + s1) & MASK;
+	}
+
+	static constexpr void unitState(int bit, uint64_t state[2])
+	{
+		state[0] = bit <  WORD_BITS ? UINT64_C(1) << bit               : 0;
+		state[1] = bit >= WORD_BITS ? UINT64_C(1) << (bit - WORD_BITS) : 0;
+	}
+
+	static constexpr void packState(const uint64_t state[2], uint64_t bits[WORDS])
+	{
+		for (int i = 0; i < STATE_BITS; i++)
+		{
+			uint64_t bit = (state[i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+
+			bits[i / 64] |= bit << (i % 64);
+		}
+	}
+
+	// One step as columns: rows[j] is where state bit j goes. Applying it is xoring the rows
+	// picked by the state's set bits.
+	static constexpr Gf2Bits<STATE_BITS> transition()
+	{
+		Gf2Bits<STATE_BITS> matrix = {};
+
+		for (int bit = 0; bit < STATE_BITS; bit++)
+		{
+			uint64_t state[2] = {};
+
+			unitState(bit, state);
+			step(state);
+			packState(state, matrix.rows[bit]);
+		}
+		matrix.invertible = true;
+		return matrix;
+	}
+
+	// rows[i] is the state bits that xor to the least significant bit of output i
+	static constexpr Gf2Bits<STATE_BITS> observation()
+	{
+		Gf2Bits<STATE_BITS> matrix = {};
+
+		for (int bit = 0; bit < STATE_BITS; bit++)
+		{
+			uint64_t state[2] = {};
+
+			unitState(bit, state);
+			for (int i = 0; i < STATE_BITS; i++)
+			{
+				matrix.rows[i][bit / 64] |= (step(state) & 1) << (bit % 64);
+			}
+		}
+		return matrix;
+	}
+
+	// rows[i] is the output bits that xor to state bit i. invertible is false if the first
+	// STATE_BITS outputs don't determine the state.
+	static constexpr Gf2Bits<STATE_BITS> recovery()
+	{
+		return gf2_invert(observation());
+	}
+};
+
+// State from the least significant bits of the first STATE_BITS outputs (output i is bit i % 64
+// of leastSignificantBitsOutput[i / 64]). Returns 1 if the outputs don't determine the state.
+template <class Xorshft>
+int xorshftPlus_getState(uint64_t state[2], const uint64_t leastSignificantBitsOutput[Xorshft::WORDS])
+{
+	static constexpr Gf2Bits<Xorshft::STATE_BITS> RECOVERY = Xorshft::recovery();
+
+	if (!RECOVERY.invertible)
+	{
+		return 1;
+	}
+	state[0] = 0;
+	state[1] = 0;
+	for (int i = 0; i < Xorshft::STATE_BITS; i++)
+	{
+		uint64_t parity = 0;
+
+		for (int j = 0; j < Xorshft::WORDS; j++)
+		{
+			parity ^= RECOVERY.rows[i][j] & leastSignificantBitsOutput[j];
+		}
+		parity ^= parity >> 32;
+		parity ^= parity >> 16;
+		parity ^= parity >> 8;
+		parity ^= parity >> 4;
+		parity ^= parity >> 2;
+		parity ^= parity >> 1;
+		state[i / (Xorshft::STATE_BITS / 2)] |= (parity & 1) << (i % (Xorshft::STATE_BITS / 2));
+	}
+	return 0;
+}
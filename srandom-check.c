@@ -0,0 +1,518 @@
+/*
+ * Copyright (C) 2015 Jonathan Senkerik
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * srandom-check - health check and benchmark for /dev/srandom
+ *
+ * Reads from one or more sources (device files or getrandom()) with a
+ * configurable block size and thread count, then reports throughput, read
+ * latency percentiles, duplicate 64bit words and byte/bit bias.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#define DEFAULT_BLOCK_SIZE  (1024 * 1024)       /* Bytes per read() */
+#define DEFAULT_TOTAL_SIZE  (1024ULL * 1024 * 1024)  /* Bytes per source */
+#define QUICK_TOTAL_SIZE    (8 * 1024 * 1024)   /* Bytes per source in quick mode */
+#define BUFFER_ALIGNMENT    4096                /* Alignment of read buffers (O_DIRECT friendly) */
+#define DUP_TABLE_MIN_BITS  16                  /* Duplicate table holds at least 2^DUP_TABLE_MIN_BITS words */
+#define DUP_TABLE_MAX_BITS  26                  /* and at most 2^DUP_TABLE_MAX_BITS words (512 MiB) */
+#define DUP_SAMPLE_STRIDE   64                  /* Check one 64bit word every 512 bytes for duplicates */
+#define GETRANDOM_SOURCE    "getrandom"
+
+/*
+ * Chi-square bounds for 255 degrees of freedom and the monobit z-score bound.  A healthy source is
+ * outside the first set about once in 10000 runs, so it only flags the statistics as suspicious.
+ * The second set fails the check, a healthy source is outside it with p < 3e-12.
+ */
+#define CHI2_LOW            173.0               /* p=0.00002 */
+#define CHI2_HIGH           350.0               /* p=0.99993 */
+#define MONOBIT_MAX_Z       4.5                 /* p=0.000007 (two sided) */
+#define CHI2_FAIL_LOW       126.0               /* p=6.5e-13 */
+#define CHI2_FAIL_HIGH      448.0               /* p=1-9e-13 */
+#define MONOBIT_FAIL_Z      8.0                 /* p=1.2e-15 (two sided) */
+
+struct source_stats {
+        uint64_t  bytes;
+        uint64_t  reads;
+        uint64_t  errors;
+        uint64_t  duplicates;
+        uint64_t  dupChecked;           /* Words checked for duplicates (a full table region skips words) */
+        uint64_t  ones;                 /* Number of set bits */
+        uint64_t  histogram[256];
+        uint64_t *latencies;            /* Nanoseconds per read */
+        uint64_t  latencyCount;
+        double    seconds;              /* Wall time including the checks */
+        double    readSeconds;          /* Time spent inside read() */
+};
+
+struct thread_args {
+        const char          *source;
+        int                  fd;
+        size_t               blockSize;
+        uint64_t             size;
+        struct source_stats  stats;
+        pthread_t            thread;
+};
+
+static uint64_t *dupTable;
+static int       dupTableBits;
+static int       dupZeroSeen;
+static int       quiet;
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Fill buffer from the source.  Returns bytes read or -1.
+ */
+static ssize_t read_source(int fd, void *buffer, size_t size)
+{
+        ssize_t ret;
+
+        do {
+                if (fd < 0) {
+                        ret = syscall(SYS_getrandom, buffer, size, 0);
+                } else {
+                        ret = read(fd, buffer, size);
+                }
+        } while (ret < 0 && errno == EINTR);
+
+        return ret;
+}
+
+/*
+ * Insert a word into the shared duplicate table.  Returns 1 if it was already there, 0 if it
+ * was added and -1 if it wasn't checked.  Zero marks an empty slot, so zero words are tracked
+ * by a flag instead.
+ */
+static int dup_insert(uint64_t word)
+{
+        uint64_t mask = (1ULL << dupTableBits) - 1;
+        uint64_t slot = (word * 0x9E3779B97F4A7C15ULL) >> (64 - dupTableBits);
+        uint64_t expected;
+        int      probe;
+
+        if (word == 0) {
+                return __atomic_exchange_n(&dupZeroSeen, 1, __ATOMIC_RELAXED);
+        }
+
+        for (probe = 0; probe < 64; probe++) {
+                expected = 0;
+                if (__atomic_compare_exchange_n(&dupTable[slot], &expected, word, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                        return 0;
+                }
+                if (expected == word) {
+                        return 1;
+                }
+                slot = (slot + 1) & mask;
+        }
+
+        /*
+         * Table region is full, the word is simply not tracked
+         */
+        return -1;
+}
+
+/*
+ * Update bit, byte and duplicate statistics for a block of data
+ */
+static void analyze(struct source_stats *stats, const uint8_t *data, size_t size)
+{
+        uint32_t counts[4][256];
+        const uint64_t *words = (const uint64_t *)data;
+        size_t   i, wordCount = size / 8;
+        uint64_t ones = 0;
+
+        memset(counts, 0, sizeof(counts));
+
+        /*
+         * Four interleaved tables avoid store-to-load stalls on repeated bytes
+         */
+        for (i = 0; i + 4 <= size; i += 4) {
+                counts[0][data[i]]++;
+                counts[1][data[i + 1]]++;
+                counts[2][data[i + 2]]++;
+                counts[3][data[i + 3]]++;
+        }
+        for (; i < size; i++) {
+                counts[0][data[i]]++;
+        }
+        for (i = 0; i < 256; i++) {
+                stats->histogram[i] += (uint64_t)counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+        }
+
+        for (i = 0; i < wordCount; i++) {
+                ones += __builtin_popcountll(words[i]);
+        }
+        for (i = wordCount * 8; i < size; i++) {
+                ones += __builtin_popcount(data[i]);
+        }
+        stats->ones += ones;
+
+        for (i = 0; i < wordCount; i += DUP_SAMPLE_STRIDE) {
+                int found = dup_insert(words[i]);
+
+                if (found >= 0) {
+                        stats->duplicates += found;
+                        stats->dupChecked++;
+                }
+        }
+}
+
+static void *reader_thread(void *data)
+{
+        struct thread_args  *args  = (struct thread_args *)data;
+        struct source_stats *stats = &args->stats;
+        uint8_t  *buffer;
+        uint64_t  start, end, remaining;
+        size_t    request, blockBytes;
+        ssize_t   got;
+
+        if (posix_memalign((void **)&buffer, BUFFER_ALIGNMENT, args->blockSize)) {
+                stats->errors++;
+                return NULL;
+        }
+
+        stats->latencies = malloc(((args->size + args->blockSize - 1) / args->blockSize + 1) * sizeof(uint64_t));
+        if (!stats->latencies) {
+                free(buffer);
+                stats->errors++;
+                return NULL;
+        }
+
+        start = now_ns();
+        remaining = args->size;
+        while (remaining > 0) {
+                uint64_t readStart, readEnd;
+
+                request = args->blockSize;
+                if (request > remaining) {
+                        request = remaining;
+                }
+
+                /*
+                 * Read one whole block, even if the source returns it in pieces
+                 */
+                readStart  = now_ns();
+                blockBytes = 0;
+                while (blockBytes < request) {
+                        got = read_source(args->fd, buffer + blockBytes, request - blockBytes);
+                        if (got <= 0) {
+                                break;
+                        }
+                        blockBytes += got;
+                }
+                readEnd = now_ns();
+
+                if (blockBytes == 0) {
+                        stats->errors++;
+                        break;
+                }
+
+                stats->latencies[stats->latencyCount++] = readEnd - readStart;
+                stats->readSeconds += (readEnd - readStart) / 1e9;
+                stats->reads++;
+                stats->bytes += blockBytes;
+                remaining -= blockBytes;
+
+                analyze(stats, buffer, blockBytes);
+        }
+        end = now_ns();
+        stats->seconds = (end - start) / 1e9;
+
+        free(buffer);
+        return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *)a;
+        uint64_t y = *(const uint64_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+static double percentile(const uint64_t *sorted, uint64_t count, double p)
+{
+        uint64_t index;
+
+        if (count == 0) {
+                return 0;
+        }
+        index = (uint64_t)(p * (count - 1) + 0.5);
+        return sorted[index] / 1000.0;
+}
+
+/*
+ * Open a source.  Returns the fd, -1 for getrandom() or -2 on error.
+ */
+static int open_source(const char *source)
+{
+        int fd;
+
+        if (strcmp(source, GETRANDOM_SOURCE) == 0) {
+                return -1;
+        }
+
+        /*
+         * Character devices usually reject or ignore O_DIRECT, so fall back to a normal open
+         */
+        fd = open(source, O_RDONLY | O_DIRECT);
+        if (fd < 0) {
+                fd = open(source, O_RDONLY);
+        }
+        if (fd < 0) {
+                fprintf(stderr, "srandom-check: open \"%s\": %s\n", source, strerror(errno));
+                return -2;
+        }
+        return fd;
+}
+
+/*
+ * Benchmark and check one source.  Returns 0 if all checks passed.
+ */
+static int check_source(const char *source, size_t blockSize, int threads, uint64_t size)
+{
+        struct thread_args *args;
+        struct source_stats total;
+        uint64_t *latencies;
+        uint64_t  latencyCount = 0;
+        uint64_t  samples;
+        double    seconds = 0, readSeconds = 0, chi2 = 0, expected, z;
+        int       i, j, fd, failed = 0, suspicious = 0;
+
+        fd = open_source(source);
+        if (fd == -2) {
+                return 1;
+        }
+
+        /*
+         * Size the duplicate table for a load of at most 1/2 with the words analyze() samples,
+         * one per 512 bytes plus one per read
+         */
+        samples = size / (DUP_SAMPLE_STRIDE * 8) + size / blockSize + threads;
+        for (dupTableBits = DUP_TABLE_MIN_BITS; dupTableBits < DUP_TABLE_MAX_BITS && (1ULL << dupTableBits) < 2 * samples; dupTableBits++);
+
+        dupTable = calloc(1ULL << dupTableBits, sizeof(uint64_t));
+        dupZeroSeen = 0;
+        args = calloc(threads, sizeof(*args));
+        if (!dupTable || !args) {
+                fprintf(stderr, "srandom-check: out of memory\n");
+                free(args);
+                free(dupTable);
+                if (fd >= 0) {
+                        close(fd);
+                }
+                return 1;
+        }
+
+        for (i = 0; i < threads; i++) {
+                args[i].source    = source;
+                args[i].fd        = fd;
+                args[i].blockSize = blockSize;
+                args[i].size      = size / threads + (i < (int)(size % threads));
+                errno = pthread_create(&args[i].thread, NULL, reader_thread, &args[i]);
+                if (errno) {
+                        perror("srandom-check: pthread_create");
+                        threads = i;
+                        failed  = 1;
+                        break;
+                }
+        }
+
+        memset(&total, 0, sizeof(total));
+        for (i = 0; i < threads; i++) {
+                pthread_join(args[i].thread, NULL);
+                total.bytes      += args[i].stats.bytes;
+                total.reads      += args[i].stats.reads;
+                total.errors     += args[i].stats.errors;
+                total.duplicates += args[i].stats.duplicates;
+                total.dupChecked += args[i].stats.dupChecked;
+                total.ones       += args[i].stats.ones;
+                for (j = 0; j < 256; j++) {
+                        total.histogram[j] += args[i].stats.histogram[j];
+                }
+                latencyCount += args[i].stats.latencyCount;
+                if (args[i].stats.seconds > seconds) {
+                        seconds = args[i].stats.seconds;
+                }
+                if (args[i].stats.readSeconds > readSeconds) {
+                        readSeconds = args[i].stats.readSeconds;
+                }
+        }
+
+        latencies = malloc((latencyCount + 1) * sizeof(uint64_t));
+        latencyCount = 0;
+        for (i = 0; i < threads; i++) {
+                if (latencies) {
+                        memcpy(latencies + latencyCount, args[i].stats.latencies, args[i].stats.latencyCount * sizeof(uint64_t));
+                        latencyCount += args[i].stats.latencyCount;
+                }
+                free(args[i].stats.latencies);
+        }
+        if (latencies) {
+                qsort(latencies, latencyCount, sizeof(uint64_t), compare_u64);
+        }
+
+        /*
+         * Byte distribution (chi-square) and bit balance (monobit z-score)
+         */
+        expected = total.bytes / 256.0;
+        for (j = 0; j < 256 && expected > 0; j++) {
+                chi2 += (total.histogram[j] - expected) * (total.histogram[j] - expected) / expected;
+        }
+        z = 0;
+        if (total.bytes > 0) {
+                z = fabs((double)total.ones - total.bytes * 4.0) / sqrt(total.bytes * 2.0);
+        }
+
+        if (total.errors || total.bytes != size || total.duplicates) {
+                failed = 1;
+        }
+        if (z > MONOBIT_MAX_Z || chi2 < CHI2_LOW || chi2 > CHI2_HIGH) {
+                suspicious = 1;
+        }
+        if (z > MONOBIT_FAIL_Z || chi2 < CHI2_FAIL_LOW || chi2 > CHI2_FAIL_HIGH) {
+                suspicious = 2;
+                failed     = 1;
+        }
+
+        if (!quiet) {
+                printf("-----------------------:----------------------\n");
+                printf("Source                 : %s\n", source);
+                printf("Threads / block size   : %d / %zu\n", threads, blockSize);
+                printf("Bytes read             : %llu\n", (unsigned long long)total.bytes);
+                printf("Throughput             : %.1f MB/s\n", readSeconds > 0 ? total.bytes / readSeconds / 1e6 : 0);
+                printf("Throughput with checks : %.1f MB/s\n", seconds > 0 ? total.bytes / seconds / 1e6 : 0);
+                if (latencies) {
+                        printf("Read latency p50       : %.1f us\n", percentile(latencies, latencyCount, 0.50));
+                        printf("Read latency p90       : %.1f us\n", percentile(latencies, latencyCount, 0.90));
+                        printf("Read latency p99       : %.1f us\n", percentile(latencies, latencyCount, 0.99));
+                        printf("Read latency max       : %.1f us\n", percentile(latencies, latencyCount, 1.00));
+                }
+                printf("Duplicate 64bit words  : %llu (%llu words checked)\n", (unsigned long long)total.duplicates, (unsigned long long)total.dupChecked);
+                printf("Byte chi-square (255)  : %.1f\n", chi2);
+                printf("Monobit z-score        : %.2f\n", z);
+                printf("Statistics             : %s\n", suspicious == 2 ? "FAILED" : suspicious ? "SUSPICIOUS (expected about once in 10000 runs, repeat to confirm)" : "OK");
+                printf("Read errors            : %llu\n", (unsigned long long)total.errors);
+                printf("Result                 : %s\n", failed ? "FAILED" : "OK");
+        }
+
+        free(latencies);
+        free(args);
+        free(dupTable);
+        if (fd >= 0) {
+                close(fd);
+        }
+
+        return failed;
+}
+
+static void usage(void)
+{
+        printf("NAME\n");
+        printf("\n");
+        printf("    srandom-check - /dev/srandom health check and benchmark\n");
+        printf("\n");
+        printf("Usage\n");
+        printf("\n");
+        printf("srandom-check [-b block_size] [-t threads] [-s total_size] [-q] [source ...]\n");
+        printf("\n");
+        printf("   -b - Bytes per read (default %d).  Accepts k, m and g suffixes.\n", DEFAULT_BLOCK_SIZE);
+        printf("\n");
+        printf("   -t - Reader threads per source (default 1).\n");
+        printf("\n");
+        printf("   -s - Total bytes per source (default 1g, 8m with -q).\n");
+        printf("\n");
+        printf("   -q - Quiet, only set the exit status.  Checks /dev/srandom if no source is given.\n");
+        printf("        Statistics only fail the check when a healthy source would be that far off with p < 3e-12.\n");
+        printf("\n");
+        printf("   source - A device file or \"" GETRANDOM_SOURCE "\" (default /dev/srandom, /dev/urandom and " GETRANDOM_SOURCE ").\n");
+        printf("\n");
+}
+
+static uint64_t parse_size(const char *text)
+{
+        char    *end;
+        uint64_t value = strtoull(text, &end, 10);
+
+        switch (*end) {
+        case 'g': case 'G': value <<= 10; /* fall through */
+        case 'm': case 'M': value <<= 10; /* fall through */
+        case 'k': case 'K': value <<= 10; break;
+        }
+        return value;
+}
+
+int main(int argc, char **argv)
+{
+        const char *defaultSources[] = {"/dev/srandom", "/dev/urandom", GETRANDOM_SOURCE};
+        const char **sources;
+        size_t   blockSize = DEFAULT_BLOCK_SIZE;
+        uint64_t size = 0;
+        int      threads = 1;
+        int      sourceCount, opt, i, failed = 0;
+
+        while ((opt = getopt(argc, argv, "b:t:s:qh")) != -1) {
+                switch (opt) {
+                case 'b': blockSize = parse_size(optarg); break;
+                case 't': threads   = atoi(optarg);       break;
+                case 's': size      = parse_size(optarg); break;
+                case 'q': quiet     = 1;                  break;
+                default:
+                        usage();
+                        return 2;
+                }
+        }
+        if (blockSize == 0 || threads <= 0) {
+                usage();
+                return 2;
+        }
+        if (size == 0) {
+                size = quiet ? QUICK_TOTAL_SIZE : DEFAULT_TOTAL_SIZE;
+        }
+
+        sources     = (const char **)argv + optind;
+        sourceCount = argc - optind;
+        if (sourceCount == 0) {
+                sources     = defaultSources;
+                sourceCount = quiet ? 1 : 3;
+        }
+
+        for (i = 0; i < sourceCount; i++) {
+                failed |= check_source(sources[i], blockSize, threads, size);
+        }
+        if (!quiet) {
+                printf("-----------------------:----------------------\n");
+        }
+
+        return failed;
+}
@@ -20,6 +20,10 @@
 #define APP_VERSION "1.41.1"
 #define THREAD_SLEEP_VALUE 11       /* Amount of time in seconds, the background thread should sleep between each operation. Recommended prime */
 #define PAID 0
+#define HEALTH_TESTS 1              /* Set to 0 to disable the continuous health tests on generated blocks */
+#define HEALTH_APT_CUTOFF 19        /* Adaptive proportion cutoff over a 512 byte window (SP 800-90B, H=8, alpha=2^-40. False alarm rate ~2^-40.9 per window) */
+#define HEALTH_DUP_WORDS 1024       /* 64bit words of the previous blocks checked for duplicates. Must be power of 2 */
+#define HEALTH_DUP_STRIDE 16        /* Every 16th word of each block goes through the duplicate test. Must divide 64 */
 
 #if ULTRA_HIGH_SPEED_MODE
     #define rndArraySize 65             /* Size of Array.  Must be >= 65. (actual size used will be 65, anything greater is thrown away).*/
@@ -35,6 +39,7 @@
 //#define DEBUG_WRITE 0
 //#define DEBUG_PRNG_SEED 0
 //#define DEBUG_NEXT_BUFFER 0
+//#define DEBUG_HEALTH 0
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4,12,0)
     #define COPY_TO_USER raw_copy_to_user
@@ -81,6 +86,9 @@ static void update_sarray(int);
 #if ULTRA_HIGH_SPEED_MODE
 static void update_sarray_uhs(int);
 #endif
+#if HEALTH_TESTS
+static void health_test(const uint64_t *);
+#endif
 static void seed_PRND_s0(void);
 static void seed_PRND_s1(void);
 static void seed_PRND_x(void);
@@ -154,6 +162,17 @@ int16_t  sdevOpenCurrent;          /* srandom device current open count */
 int32_t  sdevOpenTotal;            /* srandom device total open count */
 uint64_t generatedCount;           /* Total generated (512byte) */
 
+#if HEALTH_TESTS
+/*
+ * Health test counters and state (protected by UpArr_mutex)
+ */
+uint64_t healthTestedCount;        /* Total blocks checked by the health tests */
+uint32_t healthRctFailures;        /* Repetition count test failures */
+uint32_t healthAptFailures;        /* Adaptive proportion test failures */
+uint32_t healthDupFailures;        /* Duplicate word test failures */
+uint64_t healthDupWords[HEALTH_DUP_WORDS];  /* Sampled words of the previous blocks, indexed by their low bits */
+#endif
+
 
 /*
  * This function is called when the module is loaded
@@ -166,6 +185,14 @@ int mod_init(void)
         sdevOpenTotal   = 0;
         generatedCount  = 0;
 
+        #if HEALTH_TESTS
+        healthTestedCount = 0;
+        healthRctFailures = 0;
+        healthAptFailures = 0;
+        healthDupFailures = 0;
+        memset(healthDupWords, 0, sizeof(healthDupWords));
+        #endif
+
         mutex_init(&UpArr_mutex);
         mutex_init(&Open_mutex);
         mutex_init(&ArrBusy_mutex);
@@ -481,6 +508,10 @@ void update_sarray(int arraysPosition)
                 }
         }
 
+        #if HEALTH_TESTS
+        health_test(prngArrays[arraysPosition]);
+        #endif
+
         mutex_unlock(&UpArr_mutex);
 
         #ifdef DEBUG_UPDATE_ARRAYS
@@ -530,6 +561,10 @@ void update_sarray_uhs(int arraysPosition)
                 }
         }
 
+        #if HEALTH_TESTS
+        health_test(prngArrays[arraysPosition]);
+        #endif
+
         mutex_unlock(&UpArr_mutex);
 
         #ifdef DEBUG_UPDATE_ARRAYS
@@ -539,6 +574,88 @@ void update_sarray_uhs(int arraysPosition)
 }
 
 
+#if HEALTH_TESTS
+/*
+ * Continuous health tests on a freshly generated block.  Must be called with UpArr_mutex held.
+ *
+ * Every block goes through all three tests.  The repetition count and adaptive proportion tests
+ * cover all of its words, the duplicate test every HEALTH_DUP_STRIDE-th word, as a table store
+ * for each word would double the cost again.  Even so a block costs about as much to test as to
+ * generate, sdevice_read() runs at 40-50% of its speed with the tests off (HEALTH_TESTS 0).
+ *
+ *  - Repetition count: no 64bit word may equal the word before it (cutoff 2 for 64bit samples).
+ *  - Adaptive proportion: the first byte of the block may not occur HEALTH_APT_CUTOFF or more
+ *    times in the block's 512 bytes (one window per block).  The cutoff is
+ *    1 + CRITBINOM(512, 2^-8, 1 - alpha) from SP 800-90B with alpha=2^-40 rather than 2^-20,
+ *    as 2^-20 would raise a false alarm every few seconds at full speed.  Testing every block,
+ *    a false alarm is still expected about once in 5 days of reading nonstop.
+ *  - Duplicate: no sampled 64bit word may equal a sampled word of the previous blocks that has
+ *    the same low bits.  The table keeps the last word seen for each of the HEALTH_DUP_WORDS
+ *    low bit values.
+ *
+ * Bytes are compared 8 at a time (SWAR), kernel code can't use vector registers here without
+ * kernel_fpu_begin().
+ */
+void health_test(const uint64_t *block)
+{
+        int16_t C;
+        uint64_t differ, duplicate, pattern, previous, lanes, t;
+        uint32_t aptCount;
+
+        healthTestedCount++;
+
+        pattern  = (block[0] & 0xff) * 0x0101010101010101ULL;
+        differ   = ~0ULL;
+        previous = ~block[0];
+        aptCount = 0;
+        for (C = 0;C < 64 ;C = C + 8) {
+                int16_t W;
+
+                /*
+                 * The top bit of t | -t is set unless t is 0, so differ keeps it only while every
+                 * word differs from the word before it.
+                 * High bit of each byte lane is set where the byte equals the reference byte.
+                 * Each lane counts at most 8, so 8 words can be summed before widening.
+                 */
+                lanes = 0;
+                for (W = C;W < C + 8 ;W++) {
+                        t         = block[W] ^ previous;
+                        differ   &= t | (0 - t);
+                        previous  = block[W];
+
+                        t = block[W] ^ pattern;
+                        t = ~(((t & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | t | 0x7f7f7f7f7f7f7f7fULL);
+                        lanes += t >> 7;
+                }
+                aptCount += (uint32_t)((lanes * 0x0101010101010101ULL) >> 56);
+        }
+
+        duplicate = 0;
+        for (C = 0;C < 64 ;C = C + HEALTH_DUP_STRIDE) {
+                duplicate |= (healthDupWords[block[C] & (HEALTH_DUP_WORDS - 1)] == block[C]);
+                healthDupWords[block[C] & (HEALTH_DUP_WORDS - 1)] = block[C];
+        }
+
+        if ((differ >> 63) == 0) {
+                healthRctFailures++;
+                printk_ratelimited(KERN_WARNING "[srandom] health_test repetition count failure\n");
+        }
+        if (aptCount >= HEALTH_APT_CUTOFF) {
+                healthAptFailures++;
+                printk_ratelimited(KERN_WARNING "[srandom] health_test adaptive proportion failure (count:%u)\n", aptCount);
+        }
+        if (duplicate) {
+                healthDupFailures++;
+                printk_ratelimited(KERN_WARNING "[srandom] health_test duplicate word failure\n");
+        }
+
+        #ifdef DEBUG_HEALTH
+        printk(KERN_INFO "[srandom] health_test tested:%llu, rct:%u, apt:%u, dup:%u\n", healthTestedCount, healthRctFailures, healthAptFailures, healthDupFailures);
+        #endif
+}
+#endif
+
+
 /*
  *  Seeding the xorshft's
  */
@@ -664,6 +781,12 @@ int proc_read(struct seq_file *m, void *v)
         seq_printf(m, "Current open count     : %d\n",sdevOpenCurrent);
         seq_printf(m, "Total open count       : %d\n",sdevOpenTotal);
         seq_printf(m, "Total K bytes          : %llu\n",generatedCount / 2);
+        #if HEALTH_TESTS
+        seq_printf(m, "Health tested blocks   : %llu\n",healthTestedCount);
+        seq_printf(m, "Health RCT failures    : %u\n",healthRctFailures);
+        seq_printf(m, "Health APT failures    : %u\n",healthAptFailures);
+        seq_printf(m, "Health dup failures    : %u\n",healthDupFailures);
+        #endif
         if (PAID == 0) {
                 seq_printf(m, "-----------------------:----------------------\n");
                 seq_printf(m, "Please support my work and efforts contributing\n");